@@ -0,0 +1,423 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/cmdlnarg.h"
+#include "dcmtk/dcmdata/dcdeftag.h"
+#include "dcmtk/dcmdata/dcuid.h"
+#include "dcmtk/dcmnet/assoc.h"
+#include "dcmtk/dcmnet/dimse.h"
+#include "dcmtk/dcmnet/diutil.h"
+#include "dcmtk/ofstd/ofconapp.h"
+
+#include "SessionCapture.hpp"
+
+/*
+ * Serves a capture written by fnostudyqr --capture as Study Root C-FIND/C-MOVE SCP, so runs can be
+ * repeated against the recorded PACS behaviour without the PACS. Requests are matched by their
+ * identifier values and answered with the captured responses at their captured offsets divided by
+ * --speed (0 answers as fast as possible).
+ *
+ * C-STOREs of a move carry the captured UIDs and zero pixel data of the captured instance size and
+ * are sent to --destination, called with the move destination AE title. Moves which were not
+ * captured verbatim (e.g. instance level moves of --incremental runs) are served from the captured
+ * study level move of their StudyInstanceUID without delays.
+ */
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	OFLogger replayLogger = OFLog::getLogger("fno.apps.fnostudyqr-replay");
+
+	const char *TRANSFER_SYNTAXES[]{UID_LittleEndianExplicitTransferSyntax, UID_LittleEndianImplicitTransferSyntax};
+	const char *ABSTRACT_SYNTAXES[]{UID_VerificationSOPClass,
+	                                UID_FINDStudyRootQueryRetrieveInformationModel,
+	                                UID_MOVEStudyRootQueryRetrieveInformationModel};
+
+	struct Replay {
+		Capture        m_capture;
+		T_ASC_Network *m_network{nullptr};
+		double         m_speed{1.0};
+		std::string    m_aeTitle{"REPLAY"};
+		std::string    m_destination{}; // host:port receiving C-STOREs of moves
+
+		// study level moves by StudyInstanceUID, fallback for moves not captured verbatim
+		std::map<std::string, const CapturedMove *> m_studies;
+	};
+
+	std::string capturedValue(const CapturedValues &values, const DcmTagKey &key) {
+		for (const auto &[tag, value] : values) {
+			if (tag == key)
+				return value;
+		}
+		return {};
+	}
+
+	void waitForOffset(const Replay &replay, const Clock::time_point start, const std::uint64_t offset) {
+		if (replay.m_speed > 0)
+			std::this_thread::sleep_until(
+				start + std::chrono::microseconds(static_cast<std::int64_t>(offset / replay.m_speed)));
+	}
+
+	OFCondition receiveIdentifiers(T_ASC_Association *assoc, T_ASC_PresentationContextID pres_id,
+	                               CapturedValues &values) {
+		DcmDataset *      identifiers = nullptr;
+		const OFCondition cond = DIMSE_receiveDataSetInMemory(assoc, DIMSE_BLOCKING, 0, &pres_id, &identifiers, nullptr,
+		                                                      nullptr);
+		if (cond.good() && identifiers != nullptr)
+			values = captureValues(*identifiers);
+		delete identifiers;
+		return cond;
+	}
+
+	OFCondition serveFind(const Replay &replay, T_ASC_Association *assoc, const T_ASC_PresentationContextID pres_id,
+	                      const T_DIMSE_C_FindRQ &request) {
+		CapturedValues values;
+		OFCondition    cond = receiveIdentifiers(assoc, pres_id, values);
+		if (cond.bad())
+			return cond;
+
+		const auto        start = Clock::now();
+		T_DIMSE_C_FindRSP response{};
+		response.DimseStatus = STATUS_Success;
+
+		const auto it = replay.m_capture.m_finds.find(captureKey(values));
+		if (it == replay.m_capture.m_finds.end())
+			OFLOG_WARN(replayLogger, "C-FIND not in capture, answering without matches: " << captureKey(values));
+
+		if (it != replay.m_capture.m_finds.end()) {
+			for (const auto &captured : it->second.m_responses) {
+				waitForOffset(replay, start, captured.m_offset);
+				response.DimseStatus = captured.m_status;
+				if (!DICOM_PENDING_STATUS(captured.m_status))
+					break;
+
+				DcmDataset dataset;
+				for (const auto &[key, value] : captured.m_identifiers)
+					dataset.putAndInsertOFStringArray(key, value.c_str());
+				cond = DIMSE_sendFindResponse(assoc, pres_id, &request, &response, &dataset, nullptr);
+				if (cond.bad())
+					return cond;
+			}
+		}
+
+		// capture ended without final response
+		if (DICOM_PENDING_STATUS(response.DimseStatus))
+			response.DimseStatus = STATUS_Success;
+		return DIMSE_sendFindResponse(assoc, pres_id, &request, &response, nullptr, nullptr);
+	}
+
+	OFCondition requestStoreAssociation(const Replay &                            replay,
+	                                    const char *                              called_ae_title,
+	                                    const std::vector<const CapturedStore *> &stores,
+	                                    T_ASC_Association **                      assoc) {
+		T_ASC_Parameters *params = nullptr;
+		OFCondition       cond   = ASC_createAssociationParameters(&params, ASC_DEFAULTMAXPDU);
+		if (cond.bad())
+			return cond;
+
+		ASC_setAPTitles(params, replay.m_aeTitle.c_str(), called_ae_title, nullptr);
+		cond = ASC_setPresentationAddresses(params, OFStandard::getHostName().c_str(), replay.m_destination.c_str());
+
+		// one context per SOP class, at most 128 contexts
+		std::set<std::string>       sopClasses;
+		T_ASC_PresentationContextID presId{1};
+		for (const auto *store : stores) {
+			if (cond.good() && presId < 255 && sopClasses.insert(store->m_sopClassUid).second) {
+				cond = ASC_addPresentationContext(params, presId, store->m_sopClassUid.c_str(), TRANSFER_SYNTAXES, 2);
+				presId += 2;
+			}
+		}
+
+		if (cond.good())
+			cond = ASC_requestAssociation(replay.m_network, params, assoc);
+		if (cond.bad()) {
+			if (*assoc != nullptr)
+				(void) ASC_destroyAssociation(assoc);
+			else
+				(void) ASC_destroyAssociationParameters(&params);
+		}
+		return cond;
+	}
+
+	DIC_US sendStore(T_ASC_Association *assoc, const CapturedStore &store, const std::string &study_uid) {
+		const T_ASC_PresentationContextID presId = ASC_findAcceptedPresentationContextID(
+			assoc, store.m_sopClassUid.c_str());
+		if (presId == 0)
+			return STATUS_STORE_Error_DataSetDoesNotMatchSOPClass;
+
+		// zero pixel data stands in for the captured instance, DICOM values have even length
+		const std::vector<Uint8> pixels((store.m_bytes + 1) & ~std::uint64_t{1});
+		DcmDataset               dataset;
+		dataset.putAndInsertString(DCM_SOPClassUID, store.m_sopClassUid.c_str());
+		dataset.putAndInsertString(DCM_SOPInstanceUID, store.m_sopInstanceUid.c_str());
+		dataset.putAndInsertString(DCM_StudyInstanceUID, study_uid.c_str());
+		dataset.putAndInsertString(DCM_SeriesInstanceUID, store.m_seriesUid.c_str());
+		dataset.putAndInsertUint8Array(DCM_PixelData, pixels.data(), static_cast<unsigned long>(pixels.size()));
+
+		T_DIMSE_C_StoreRQ  request{};
+		T_DIMSE_C_StoreRSP response{};
+		DcmDataset *       statusDetail = nullptr;
+		request.MessageID               = assoc->nextMsgID++;
+		request.Priority                = DIMSE_PRIORITY_MEDIUM;
+		request.DataSetType             = DIMSE_DATASET_PRESENT;
+		OFStandard::strlcpy(request.AffectedSOPClassUID, store.m_sopClassUid.c_str(),
+		                    sizeof(request.AffectedSOPClassUID));
+		OFStandard::strlcpy(request.AffectedSOPInstanceUID, store.m_sopInstanceUid.c_str(),
+		                    sizeof(request.AffectedSOPInstanceUID));
+
+		const OFCondition cond = DIMSE_storeUser(assoc, presId, &request, nullptr, &dataset, nullptr, nullptr,
+		                                         DIMSE_BLOCKING, 0, &response, &statusDetail);
+		delete statusDetail;
+		return cond.good() ? response.DimseStatus : STATUS_STORE_Refused_OutOfResources;
+	}
+
+	OFCondition serveMove(const Replay &replay, T_ASC_Association *assoc, const T_ASC_PresentationContextID pres_id,
+	                      const T_DIMSE_C_MoveRQ &request) {
+		CapturedValues values;
+		OFCondition    cond = receiveIdentifiers(assoc, pres_id, values);
+		if (cond.bad())
+			return cond;
+
+		const auto        start = Clock::now();
+		const std::string study = capturedValue(values, DCM_StudyInstanceUID);
+		T_DIMSE_C_MoveRSP response{};
+
+		// captured verbatim, or instances of a captured study level move
+		const CapturedMove *               move = nullptr;
+		std::vector<const CapturedStore *> stores;
+		if (const auto it = replay.m_capture.m_moves.find(captureKey(values)); it != replay.m_capture.m_moves.end()) {
+			move = &it->second;
+			for (const auto &store : move->m_stores)
+				stores.push_back(&store);
+		} else if (const auto fallback = replay.m_studies.find(study); fallback != replay.m_studies.end()) {
+			std::set<std::string> instances;
+			std::string           uids = capturedValue(values, DCM_SOPInstanceUID);
+			for (std::size_t pos = 0; !uids.empty(); uids.erase(0, pos == std::string::npos ? pos : pos + 1)) {
+				pos = uids.find('\\');
+				instances.insert(uids.substr(0, pos));
+			}
+			for (const auto &store : fallback->second->m_stores) {
+				if (instances.empty() || instances.contains(store.m_sopInstanceUid))
+					stores.push_back(&store);
+			}
+		} else {
+			OFLOG_WARN(replayLogger, "C-MOVE not in capture: " << captureKey(values));
+			response.DimseStatus = STATUS_MOVE_Failed_UnableToProcess;
+			return DIMSE_sendMoveResponse(assoc, pres_id, &request, &response, nullptr, nullptr);
+		}
+
+		T_ASC_Association *storeAssoc = nullptr;
+		if (!stores.empty()) {
+			const OFCondition storeCond = requestStoreAssociation(replay, request.MoveDestination, stores, &storeAssoc);
+			if (storeCond.bad()) {
+				OFString temp_string;
+				OFLOG_ERROR(replayLogger, "Store association to " << replay.m_destination << " failed: "
+				            << DimseCondition::dump(temp_string, storeCond));
+				response.DimseStatus                 = STATUS_MOVE_Failed_UnableToProcess;
+				response.NumberOfFailedSubOperations = static_cast<DIC_US>(stores.size());
+				return DIMSE_sendMoveResponse(assoc, pres_id, &request, &response, nullptr, nullptr);
+			}
+		}
+
+		// stores and captured responses interleaved by offset, fallbacks report progress after each store
+		const std::vector<CapturedMoveResponse> noResponses;
+		const auto &                            responses = move != nullptr ? move->m_responses : noResponses;
+		const CapturedMoveResponse *            finalResponse{nullptr};
+		std::size_t                             nextResponse{0};
+		DIC_US                                  completed{0};
+		DIC_US                                  failed{0};
+		for (std::size_t i = 0; cond.good() && i <= stores.size(); ++i) {
+			const std::uint64_t storeOffset = i < stores.size() ? stores[i]->m_offset : UINT64_MAX;
+			for (; cond.good() && nextResponse < responses.size() && responses[nextResponse].m_offset <= storeOffset;
+			     ++nextResponse) {
+				const CapturedMoveResponse &captured = responses[nextResponse];
+				if (!DICOM_PENDING_STATUS(captured.m_status)) {
+					finalResponse = &captured;
+					continue;
+				}
+				waitForOffset(replay, start, captured.m_offset);
+				response.DimseStatus                    = captured.m_status;
+				response.NumberOfRemainingSubOperations = captured.m_remaining;
+				response.NumberOfCompletedSubOperations = captured.m_completed;
+				response.NumberOfFailedSubOperations    = captured.m_failed;
+				response.NumberOfWarningSubOperations   = captured.m_warning;
+				cond = DIMSE_sendMoveResponse(assoc, pres_id, &request, &response, nullptr, nullptr);
+			}
+			if (i == stores.size() || cond.bad())
+				break;
+
+			if (move != nullptr)
+				waitForOffset(replay, start, stores[i]->m_offset);
+			const DIC_US status = sendStore(storeAssoc, *stores[i], study);
+			if (status == STATUS_Success || DICOM_WARNING_STATUS(status))
+				++completed;
+			else
+				++failed;
+
+			if (move == nullptr) {
+				response.DimseStatus                    = STATUS_Pending;
+				response.NumberOfRemainingSubOperations = static_cast<DIC_US>(stores.size() - i - 1);
+				response.NumberOfCompletedSubOperations = completed;
+				response.NumberOfFailedSubOperations    = failed;
+				cond = DIMSE_sendMoveResponse(assoc, pres_id, &request, &response, nullptr, nullptr);
+			}
+		}
+
+		if (storeAssoc != nullptr) {
+			(void) ASC_releaseAssociation(storeAssoc);
+			(void) ASC_destroyAssociation(&storeAssoc);
+		}
+		if (cond.bad())
+			return cond;
+
+		// counts of this replay, captured status only when nothing was stored (refusals, failures)
+		if (finalResponse != nullptr)
+			waitForOffset(replay, start, finalResponse->m_offset);
+		response.NumberOfRemainingSubOperations = 0;
+		response.NumberOfCompletedSubOperations = completed;
+		response.NumberOfFailedSubOperations    = failed;
+		response.NumberOfWarningSubOperations   = 0;
+		if (stores.empty() && finalResponse != nullptr)
+			response.DimseStatus = finalResponse->m_status;
+		else
+			response.DimseStatus = failed == 0 ? STATUS_Success : STATUS_MOVE_Warning_SubOperationsCompleteOneOrMoreFailures;
+		return DIMSE_sendMoveResponse(assoc, pres_id, &request, &response, nullptr, nullptr);
+	}
+
+	void serveAssociation(const Replay &replay, T_ASC_Association *assoc) {
+		OFCondition cond;
+		while (cond.good()) {
+			T_ASC_PresentationContextID presId{0};
+			T_DIMSE_Message             message{};
+			cond = DIMSE_receiveCommand(assoc, DIMSE_BLOCKING, 0, &presId, &message, nullptr);
+			if (cond.bad())
+				break;
+
+			switch (message.CommandField) {
+				case DIMSE_C_ECHO_RQ:
+					cond = DIMSE_sendEchoResponse(assoc, presId, &message.msg.CEchoRQ, STATUS_Success, nullptr);
+					break;
+				case DIMSE_C_FIND_RQ:
+					cond = serveFind(replay, assoc, presId, message.msg.CFindRQ);
+					break;
+				case DIMSE_C_MOVE_RQ:
+					cond = serveMove(replay, assoc, presId, message.msg.CMoveRQ);
+					break;
+				case DIMSE_C_CANCEL_RQ:
+					// responses were sent already, find limits cancel after enough matches
+					break;
+				default:
+					cond = DIMSE_BADCOMMANDTYPE;
+					break;
+			}
+		}
+
+		if (cond == DUL_PEERREQUESTEDRELEASE) {
+			(void) ASC_acknowledgeRelease(assoc);
+		} else if (cond != DUL_PEERABORTEDASSOCIATION) {
+			OFString temp_string;
+			OFLOG_ERROR(replayLogger, "Association failed: " << DimseCondition::dump(temp_string, cond));
+			(void) ASC_abortAssociation(assoc);
+		}
+		(void) ASC_dropSCPAssociation(assoc);
+		(void) ASC_destroyAssociation(&assoc);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	constexpr auto REPLAY_APPLICATION{"fnostudyqr-replay"};
+
+	OFConsoleApplication app(REPLAY_APPLICATION, "Replays captured fnostudyqr sessions as C-FIND/C-MOVE SCP", nullptr);
+	OFCommandLine        cmd;
+	Replay               replay;
+	const char *         opt_capturePath{nullptr};
+	OFCmdUnsignedInt     opt_port{0};
+	OFCmdFloat           opt_speed{1.0};
+	const char *         opt_destination{nullptr};
+	const char *         opt_aeTitle{nullptr};
+
+	cmd.setParamColumn(24);
+	cmd.addParam("capture", "capture file written by fnostudyqr --capture");
+	cmd.addParam("port", "tcp/ip port number to listen on");
+
+	cmd.setOptionColumns(20, 4);
+	cmd.addOption("--speed", "-s", 1, "[f]actor: float (default: 1)",
+	              "captured delays are divided by f, 0 answers immediately");
+	cmd.addOption("--destination", "-d", 1, "[a]ddress: host:port",
+	              "receiver of C-STOREs of moves (move destination)");
+	cmd.addOption("--aetitle", "-aet", 1, "[a]etitle: string (default: REPLAY)",
+	              "own AE title, calling AE title of C-STORE associations");
+
+	prepareCmdLineArgs(argc, argv, REPLAY_APPLICATION);
+	if (!app.parseCommandLine(cmd, argc, argv))
+		return 1;
+
+	cmd.getParam(1, opt_capturePath);
+	app.checkParam(cmd.getParamAndCheckMinMax(2, opt_port, 1, 65535));
+	if (cmd.findOption("--speed"))
+		app.checkValue(cmd.getValueAndCheckMin(opt_speed, 0.0));
+	if (cmd.findOption("--destination"))
+		app.checkValue(cmd.getValue(opt_destination));
+	if (cmd.findOption("--aetitle"))
+		app.checkValue(cmd.getValue(opt_aeTitle));
+
+	replay.m_speed = opt_speed;
+	if (opt_destination != nullptr)
+		replay.m_destination = opt_destination;
+	else
+		app.printWarning("no --destination, moves with instances will fail");
+	if (opt_aeTitle != nullptr)
+		replay.m_aeTitle = opt_aeTitle;
+
+	std::string error_msg;
+	if (!readCapture(opt_capturePath, replay.m_capture, error_msg)) {
+		OFLOG_FATAL(replayLogger, error_msg);
+		return 1;
+	}
+	for (const auto &[key, move] : replay.m_capture.m_moves) {
+		const std::string study = capturedValue(move.m_request, DCM_StudyInstanceUID);
+		if (!study.empty() && capturedValue(move.m_request, DCM_SOPInstanceUID).empty())
+			replay.m_studies.try_emplace(study, &move);
+	}
+	fmt::print("REPLAY ----------- {} finds, {} moves from {}, port {}, speed {}\n", replay.m_capture.m_finds.size(),
+	           replay.m_capture.m_moves.size(), opt_capturePath, opt_port, opt_speed);
+
+	OFString    temp_string;
+	OFCondition cond = ASC_initializeNetwork(NET_ACCEPTORREQUESTOR, static_cast<int>(opt_port), 30, &replay.m_network);
+	if (cond.bad()) {
+		OFLOG_FATAL(replayLogger, "Cannot create network: " << DimseCondition::dump(temp_string, cond));
+		return 1;
+	}
+
+	while (true) {
+		T_ASC_Association *assoc = nullptr;
+		cond = ASC_receiveAssociation(replay.m_network, &assoc, ASC_DEFAULTMAXPDU);
+		if (cond.good())
+			cond = ASC_acceptContextsWithPreferredTransferSyntaxes(assoc->params, ABSTRACT_SYNTAXES, 3,
+			                                                       TRANSFER_SYNTAXES, 2);
+		if (cond.good())
+			cond = ASC_acknowledgeAssociation(assoc);
+		if (cond.bad()) {
+			OFLOG_ERROR(replayLogger, "Association not accepted: " << DimseCondition::dump(temp_string, cond));
+			if (assoc != nullptr) {
+				(void) ASC_dropSCPAssociation(assoc);
+				(void) ASC_destroyAssociation(&assoc);
+			}
+			continue;
+		}
+
+		std::thread(serveAssociation, std::cref(replay), assoc).detach();
+	}
+}
@@ -0,0 +1,352 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "fmt/format.h"
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/cmdlnarg.h"
+#include "dcmtk/ofstd/ofconapp.h"
+
+#include "RateLimiter.hpp"
+#include "Utility.hpp"
+
+/*
+ * TCP proxy emulating a WAN link between fnostudyqr and a (mock) PACS. Every forward listens on a
+ * local port and connects each accepted connection to its target; data is delayed by --latency plus
+ * up to --jitter in each direction (order kept), capped by --bandwidth per direction shared by all
+ * connections, and connections are reset after a random amount of data averaging --reset-every.
+ * The C-MOVE callback connection is emulated by a second forward from the PACS' move destination to
+ * the receive port of fnostudyqr:
+ *   fnostudyqr-wanproxy -f 11112:pacs:104 -f 11114:localhost:11113 -l 40 -j 5 -b 100
+ */
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr std::size_t   CHUNK_SIZE{64 * 1024};
+	// data read ahead per direction, the sender is held back by TCP flow control beyond it
+	constexpr std::size_t   QUEUE_LIMIT{4 * MIB};
+
+	OFLogger proxyLogger = OFLog::getLogger("fno.apps.fnostudyqr-wanproxy");
+
+	struct Forward {
+		unsigned short m_listenPort{0};
+		std::string    m_host;
+		std::string    m_port;
+	};
+
+	struct WanSettings {
+		std::chrono::microseconds m_latency{0}; // one way
+		std::chrono::microseconds m_jitter{0};
+		std::uint64_t             m_resetBytes{0}; // mean bytes per connection before reset, 0: never
+		RateLimiter *             m_upstream{nullptr};
+		RateLimiter *             m_downstream{nullptr};
+	};
+
+	// "listen-port:host:port"
+	bool parseForward(const std::string &value, Forward &forward) {
+		const std::size_t first = value.find(':');
+		const std::size_t last  = value.rfind(':');
+		if (first == std::string::npos || first == last)
+			return false;
+		try {
+			const unsigned long port = std::stoul(value.substr(0, first));
+			if (port == 0 || port > 65535)
+				return false;
+			forward.m_listenPort = static_cast<unsigned short>(port);
+		} catch (const std::exception &) {
+			return false;
+		}
+		forward.m_host = value.substr(first + 1, last - first - 1);
+		forward.m_port = value.substr(last + 1);
+		return !forward.m_host.empty() && !forward.m_port.empty();
+	}
+
+	int connectTo(const Forward &forward) {
+		addrinfo hints{};
+		hints.ai_family   = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo *addresses = nullptr;
+		if (getaddrinfo(forward.m_host.c_str(), forward.m_port.c_str(), &hints, &addresses) != 0)
+			return -1;
+
+		int fd = -1;
+		for (const addrinfo *address = addresses; address != nullptr && fd < 0; address = address->ai_next) {
+			fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+			if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+				close(fd);
+				fd = -1;
+			}
+		}
+		freeaddrinfo(addresses);
+		return fd;
+	}
+
+	struct Chunk {
+		Clock::time_point m_release;
+		std::vector<char> m_data; // empty: end of stream
+	};
+
+	// one direction of a connection, chunks are read ahead and written once their delay passed
+	class Pipe {
+	public:
+		Pipe(const int from, const int to, RateLimiter *limiter) : m_from(from), m_to(to), m_limiter(limiter) {}
+
+		void read(const WanSettings &settings, std::mt19937_64 random);
+
+		// true at end of stream, false on error or once both directions transferred reset_after bytes
+		bool write(std::atomic<std::uint64_t> &transferred, std::uint64_t reset_after);
+
+		void stop();
+
+	private:
+		int                     m_from;
+		int                     m_to;
+		RateLimiter *           m_limiter;
+		std::mutex              m_mutex;
+		std::condition_variable m_condition;
+		std::deque<Chunk>       m_chunks;
+		std::size_t             m_queued{0};
+		bool                    m_stopped{false};
+	};
+
+	void Pipe::read(const WanSettings &settings, std::mt19937_64 random) {
+		std::uniform_int_distribution<std::int64_t> jitter(0, settings.m_jitter.count());
+		Clock::time_point                           last{};
+		while (true) {
+			std::vector<char> data(CHUNK_SIZE);
+			const ssize_t     received = recv(m_from, data.data(), data.size(), 0);
+			data.resize(received > 0 ? static_cast<std::size_t>(received) : 0);
+
+			// jitter delays but never reorders
+			last = std::max(last, Clock::now() + settings.m_latency + std::chrono::microseconds(jitter(random)));
+
+			std::unique_lock lock(m_mutex);
+			m_condition.wait(lock, [this] { return m_stopped || m_queued < QUEUE_LIMIT; });
+			if (m_stopped)
+				return;
+			m_queued += data.size();
+			const bool end = data.empty();
+			m_chunks.push_back(Chunk{last, std::move(data)});
+			m_condition.notify_all();
+			if (end)
+				return;
+		}
+	}
+
+	bool Pipe::write(std::atomic<std::uint64_t> &transferred, const std::uint64_t reset_after) {
+		while (true) {
+			Chunk chunk;
+			{
+				std::unique_lock lock(m_mutex);
+				m_condition.wait(lock, [this] { return m_stopped || !m_chunks.empty(); });
+				if (m_stopped)
+					return false;
+				chunk = std::move(m_chunks.front());
+				m_chunks.pop_front();
+				m_queued -= chunk.m_data.size();
+				m_condition.notify_all();
+			}
+
+			std::this_thread::sleep_until(chunk.m_release);
+			if (chunk.m_data.empty()) {
+				shutdown(m_to, SHUT_WR);
+				return true;
+			}
+
+			if (m_limiter != nullptr)
+				m_limiter->consume(chunk.m_data.size());
+			for (std::size_t sent = 0; sent < chunk.m_data.size();) {
+				const ssize_t written = send(m_to, chunk.m_data.data() + sent, chunk.m_data.size() - sent, MSG_NOSIGNAL);
+				if (written <= 0)
+					return false;
+				sent += static_cast<std::size_t>(written);
+			}
+			if (reset_after > 0 && (transferred += chunk.m_data.size()) >= reset_after)
+				return false;
+		}
+	}
+
+	void Pipe::stop() {
+		{
+			std::lock_guard lock(m_mutex);
+			m_stopped = true;
+		}
+		m_condition.notify_all();
+	}
+
+	// aborts both sides with RST, blocked reads and writes return
+	void resetConnection(const int client, const int server) {
+		const linger abort{1, 0};
+		for (const int fd : {client, server}) {
+			setsockopt(fd, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+			shutdown(fd, SHUT_RDWR);
+		}
+	}
+
+	void serveConnection(const WanSettings &settings, const Forward &forward, const int client, std::uint64_t seed) {
+		const int server = connectTo(forward);
+		if (server < 0) {
+			OFLOG_WARN(proxyLogger, fmt::format("Cannot connect to {}:{}", forward.m_host, forward.m_port));
+			close(client);
+			return;
+		}
+		const int noDelay{1};
+		setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+		setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+		// reset after uniformly drawn amount of data, averaging m_resetBytes
+		std::mt19937_64 random(seed);
+		std::uint64_t   resetAfter{0};
+		if (settings.m_resetBytes > 0)
+			resetAfter = std::uniform_int_distribution<std::uint64_t>(1, 2 * settings.m_resetBytes)(random);
+
+		Pipe                       upstream(client, server, settings.m_upstream);
+		Pipe                       downstream(server, client, settings.m_downstream);
+		std::atomic<std::uint64_t> transferred{0};
+		std::atomic<bool>          reset{false};
+		const auto                 run = [&](Pipe &pipe) {
+			if (!pipe.write(transferred, resetAfter) && !reset.exchange(true)) {
+				resetConnection(client, server);
+				upstream.stop();
+				downstream.stop();
+			}
+		};
+
+		std::thread upstreamReader(&Pipe::read, &upstream, std::cref(settings), std::mt19937_64(random()));
+		std::thread downstreamReader(&Pipe::read, &downstream, std::cref(settings), std::mt19937_64(random()));
+		std::thread upstreamWriter(run, std::ref(upstream));
+		run(downstream);
+		upstreamWriter.join();
+		// readers return on end of stream, or on stop once the connection was reset
+		upstreamReader.join();
+		downstreamReader.join();
+
+		if (reset)
+			fmt::print("WANPROXY --------- connection to {}:{} reset after {} bytes\n", forward.m_host, forward.m_port,
+			           transferred.load());
+		close(client);
+		close(server);
+	}
+
+	void listenLoop(const WanSettings &settings, const Forward &forward) {
+		const int fd = socket(AF_INET6, SOCK_STREAM, 0);
+		const int reuse{1};
+		const int dualStack{0};
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &dualStack, sizeof(dualStack));
+
+		sockaddr_in6 address{};
+		address.sin6_family = AF_INET6;
+		address.sin6_addr   = in6addr_any;
+		address.sin6_port   = htons(forward.m_listenPort);
+		if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 16) != 0) {
+			OFLOG_FATAL(proxyLogger, fmt::format("Cannot listen on port {}", forward.m_listenPort));
+			std::exit(1);
+		}
+
+		std::random_device seeds;
+		while (true) {
+			const int client = accept(fd, nullptr, nullptr);
+			if (client >= 0)
+				std::thread(serveConnection, std::cref(settings), std::cref(forward), client, seeds()).detach();
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	constexpr auto PROXY_APPLICATION{"fnostudyqr-wanproxy"};
+
+	OFConsoleApplication app(PROXY_APPLICATION, "TCP proxy emulating WAN latency, bandwidth and resets", nullptr);
+	OFCommandLine        cmd;
+	std::vector<Forward> forwards;
+	WanSettings          settings;
+	OFCmdUnsignedInt     opt_latency{0};
+	OFCmdUnsignedInt     opt_jitter{0};
+	OFCmdUnsignedInt     opt_bandwidth{0};
+	OFCmdUnsignedInt     opt_resetEvery{0};
+
+	cmd.setOptionColumns(20, 4);
+	cmd.addOption("--forward", "-f", 1, "[f]orward: listen-port:host:port",
+	              "accept on listen-port and connect to host:port,\nrepeat for C-MOVE callback connection");
+	cmd.addOption("--latency", "-l", 1, "[n]umber: ms (default: 0)",
+	              "one way delay in each direction, RTT is twice n");
+	cmd.addOption("--jitter", "-j", 1, "[n]umber: ms (default: 0)",
+	              "additional delay of up to n, data is not reordered");
+	cmd.addOption("--bandwidth", "-b", 1, "[n]umber: Mbit/s (default: unlimited)",
+	              "cap of each direction shared by all connections");
+	cmd.addOption("--reset-every", "-r", 1, "[n]umber: MiB (default: never)",
+	              "reset connections after random amount of data\naveraging n");
+
+	prepareCmdLineArgs(argc, argv, PROXY_APPLICATION);
+	if (!app.parseCommandLine(cmd, argc, argv))
+		return 1;
+
+	if (cmd.findOption("--forward", 0, OFCommandLine::FOM_FirstFromLeft)) {
+		do {
+			const char *value{nullptr};
+			app.checkValue(cmd.getValue(value));
+			Forward forward;
+			if (!parseForward(value, forward))
+				app.printError(fmt::format("invalid --forward \"{}\", expected listen-port:host:port", value).c_str());
+			forwards.push_back(forward);
+		} while (cmd.findOption("--forward", 0, OFCommandLine::FOM_NextFromLeft));
+	}
+	if (forwards.empty())
+		app.printError("missing --forward");
+	if (cmd.findOption("--latency"))
+		app.checkValue(cmd.getValue(opt_latency));
+	if (cmd.findOption("--jitter"))
+		app.checkValue(cmd.getValue(opt_jitter));
+	if (cmd.findOption("--bandwidth"))
+		app.checkValue(cmd.getValueAndCheckMin(opt_bandwidth, 1));
+	if (cmd.findOption("--reset-every"))
+		app.checkValue(cmd.getValueAndCheckMin(opt_resetEvery, 1));
+
+	settings.m_latency    = std::chrono::milliseconds(opt_latency);
+	settings.m_jitter     = std::chrono::milliseconds(opt_jitter);
+	settings.m_resetBytes = opt_resetEvery * MIB;
+
+	// whole day window of the retrieval rate limiter, one bucket per direction
+	std::vector<RateWindow> link;
+	if (opt_bandwidth > 0)
+		link.push_back(RateWindow{0, 24 * 60, opt_bandwidth * 1000 * 1000 / 8});
+	RateLimiter upstream(link);
+	RateLimiter downstream(link);
+	if (!link.empty()) {
+		settings.m_upstream   = &upstream;
+		settings.m_downstream = &downstream;
+	}
+
+	std::vector<std::thread> listeners;
+	for (const auto &forward : forwards) {
+		fmt::print("WANPROXY --------- :{} -> {}:{}, latency {} ms, jitter {} ms, bandwidth {}\n", forward.m_listenPort,
+		           forward.m_host, forward.m_port, opt_latency, opt_jitter,
+		           opt_bandwidth > 0 ? fmt::format("{} Mbit/s", opt_bandwidth) : std::string("unlimited"));
+		listeners.emplace_back(listenLoop, std::cref(settings), std::cref(forward));
+	}
+	for (auto &listener : listeners)
+		listener.join();
+	return 0;
+}
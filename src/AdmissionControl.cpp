@@ -0,0 +1,111 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "AdmissionControl.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+#include "fmt/format.h"
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/oflog/oflog.h"
+
+#include "StudyQueryRetriever.hpp"
+#include "Utility.hpp"
+
+std::uint64_t AdmissionControl::estimate(const std::filesystem::path &directory, const std::string_view modalities,
+                                         const unsigned int instances) {
+	std::lock_guard lock(m_mutex);
+	// moves recorded since are kept in memory, they are saved into the same directory by JobRunner
+	if (!m_sizesLoaded || directory != m_sizesDirectory) {
+		m_sizes.load(directory);
+		m_sizesDirectory = directory;
+		m_sizesLoaded    = true;
+	}
+	return m_sizes.estimate(modalities, instances);
+}
+
+bool AdmissionControl::fits(const std::filesystem::path &directory, const std::uint64_t bytes,
+                            std::string &reason) const {
+	if (m_limits.m_minFreeBytes > 0) {
+		std::error_code                   ec;
+		const std::filesystem::space_info space = std::filesystem::space(directory, ec);
+		// study larger than the volume can ever hold is let through alone instead of waiting forever
+		const bool fitsEver = space.capacity >= bytes + m_limits.m_minFreeBytes;
+		if (!ec && (fitsEver || m_reserved > 0) && space.available < m_reserved + bytes + m_limits.m_minFreeBytes) {
+			reason = fmt::format("{} MiB free on {}, {} MiB reserved by moves, next study ~{} MiB, {} MiB kept free",
+			                     space.available / MIB, directory.string(), m_reserved / MIB, bytes / MIB,
+			                     m_limits.m_minFreeBytes / MIB);
+			return false;
+		}
+	}
+
+	if (m_limits.m_maxDirtyBytes > 0) {
+		const std::uint64_t dirty = dirtyPageCacheBytes();
+		if (dirty > m_limits.m_maxDirtyBytes) {
+			reason = fmt::format("{} MiB received data not written back yet, limit {} MiB",
+			                     dirty / MIB, m_limits.m_maxDirtyBytes / MIB);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool AdmissionControl::admit(const std::filesystem::path &directory, const std::uint64_t bytes) {
+	std::unique_lock lock(m_mutex);
+	std::string      reason;
+	bool             paused{false};
+	while (!m_stopped && !this->fits(directory, bytes, reason)) {
+		if (!paused)
+			OFLOG_WARN(qrLogger, fmt::format("Moves paused: {}", reason));
+		paused = true;
+		// space may also be freed outside of this process, checked again after interval
+		m_released.wait_for(lock, std::chrono::seconds(m_limits.m_pollInterval));
+	}
+	if (m_stopped)
+		return false;
+
+	if (paused)
+		OFLOG_INFO(qrLogger, "Moves resumed");
+	m_reserved += bytes;
+	return true;
+}
+
+void AdmissionControl::release(const std::uint64_t bytes) {
+	{
+		std::lock_guard lock(m_mutex);
+		m_reserved -= std::min(bytes, m_reserved);
+	}
+	m_released.notify_all();
+}
+
+void AdmissionControl::record(const std::string_view modalities, const unsigned int instances,
+                              const std::uint64_t bytes) {
+	std::lock_guard lock(m_mutex);
+	m_sizes.record(modalities, instances, bytes);
+}
+
+void AdmissionControl::stop() {
+	{
+		std::lock_guard lock(m_mutex);
+		m_stopped = true;
+	}
+	m_released.notify_all();
+}
+
+std::uint64_t dirtyPageCacheBytes() {
+	std::ifstream meminfo{"/proc/meminfo"};
+	std::uint64_t bytes{0};
+	std::string   name;
+	std::uint64_t kilobytes;
+	std::string   unit;
+	while (meminfo >> name >> kilobytes) {
+		if (name == "Dirty:" || name == "Writeback:")
+			bytes += kilobytes * 1024;
+		std::getline(meminfo, unit);
+	}
+	return bytes;
+}
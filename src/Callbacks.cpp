@@ -4,6 +4,28 @@
 
 #include "Callbacks.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <memory>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
+#include "dcmtk/dcmdata/dcistrmb.h"
+#include "dcmtk/dcmnet/dcmtrans.h"
+
+#include "ContentStore.hpp"
+#include "InstanceIndex.hpp"
+#include "InstanceWriter.hpp"
+#include "SessionCapture.hpp"
+#include "StudyArchive.hpp"
+#include "StudyManifest.hpp"
+#include "UringWriter.hpp"
+
 void moveCallback(void *             move_callback_data,
                   T_DIMSE_C_MoveRQ * request,
                   int                response_count,
@@ -22,6 +44,9 @@ void moveCallback(void *             move_callback_data,
 		DCMNET_DEBUG(DIMSE_dumpMessage(temp_string, *response, DIMSE_INCOMING));
 	}
 
+	if (moveCallbackInfo->capture != nullptr)
+		moveCallbackInfo->capture->moveResponse(moveCallbackInfo->session, *response);
+
 	if (cancel_after_n_responses == response_count) {
 		DCMNET_INFO("Sending cancel request (MsgID " << request->MessageID << ", PresID " << OFstatic_cast(unsigned int,
 			            moveCallbackInfo->presID) << ")");
@@ -31,7 +56,7 @@ void moveCallback(void *             move_callback_data,
 	}
 }
 
-void subOpMoveCallback(void *,
+void subOpMoveCallback(void *                     sub_op_callback_data,
                        T_ASC_Network *            assoc_net,
                        T_ASC_Association **       sub_assoc,
                        std::string &              output_directory,
@@ -43,10 +68,11 @@ void subOpMoveCallback(void *,
 	if (*sub_assoc == nullptr)
 		acceptSubAssoc(assoc_net, sub_assoc);
 	else
-		subOpSCP(sub_assoc, output_directory, block_mode, dimse_timeout);
+		subOpSCP(sub_assoc, output_directory, block_mode, dimse_timeout,
+		         OFstatic_cast(ReceiveContext *, sub_op_callback_data));
 }
 
-void subOpCallback(void * /* subOpCallbackData */,
+void subOpCallback(void *                     sub_op_callback_data,
                    T_ASC_Network *            assoc_net,
                    T_ASC_Association **       sub_assoc,
                    const std::string &        output_directory,
@@ -58,7 +84,8 @@ void subOpCallback(void * /* subOpCallbackData */,
 	if (*sub_assoc == nullptr) {
 		acceptSubAssoc(assoc_net, sub_assoc);
 	} else {
-		subOpSCP(sub_assoc, output_directory, block_mode, dimse_timeout);
+		subOpSCP(sub_assoc, output_directory, block_mode, dimse_timeout,
+		         OFstatic_cast(ReceiveContext *, sub_op_callback_data));
 	}
 }
 
@@ -123,7 +150,8 @@ OFCondition acceptSubAssoc(T_ASC_Network *assoc_net, T_ASC_Association **assoc)
 OFCondition subOpSCP(T_ASC_Association ** sub_assoc,
                      const std::string &  output_directory,
                      T_DIMSE_BlockingMode block_mode,
-                     int                  dimse_timeout) {
+                     int                  dimse_timeout,
+                     ReceiveContext *     context) {
 	T_DIMSE_Message             message{};
 	T_ASC_PresentationContextID presID;
 
@@ -143,7 +171,8 @@ OFCondition subOpSCP(T_ASC_Association ** sub_assoc,
 				                presID,
 				                output_directory,
 				                block_mode,
-				                dimse_timeout);
+				                dimse_timeout,
+				                context);
 				break;
 			default:
 				OFString temp_string;
@@ -181,13 +210,9 @@ void storeSCPCallback(
 	T_DIMSE_StoreProgress *progress,
 	T_DIMSE_C_StoreRQ *    in_request,
 	char *                 filename,
-	DcmDataset **          in_dataset,
 	/* out */
 	T_DIMSE_C_StoreRSP *out_response,
 	DcmDataset **       status_detail) {
-	DIC_UI sopClass;
-	DIC_UI sopInstance;
-
 	OFLogger progressLogger = OFLog::getLogger("dcmtk.apps.fnostudyqr.progress");
 	if (progressLogger.getChainedLogLevel() == OFLogger::DEBUG_LOG_LEVEL) {
 		switch (progress->state) {
@@ -204,40 +229,93 @@ void storeSCPCallback(
 		COUT.flush();
 	}
 
+	// data set was already written bit preserving by storeSCP, only the outcome is recorded
 	if (progress->state == DIMSE_StoreEnd) {
 		*status_detail = nullptr;
-		if ((in_dataset != nullptr) && (*in_dataset != nullptr)) {
-			StoreCallbackData *storecbdata = OFstatic_cast(StoreCallbackData *, store_callback_data);
-			const OFString     ofname(storecbdata->m_filename);
-			if (OFStandard::fileExists(ofname))
-				DCMNET_WARN("DICOM file already exists, overwriting: " << ofname);
-
-			const E_TransferSyntax xfer = (*in_dataset)->getOriginalXfer();
-			//if (xfer == EXS_Unknown)
-			//	xfer = (*in_dataset)->getOriginalXfer();
-			OFCondition cond = storecbdata->m_fileformat->saveFile(ofname, xfer);
-
-			if (cond.bad()) {
-				DCMNET_ERROR("Cannot write DICOM file: " << ofname);
-				out_response->DimseStatus = STATUS_STORE_Refused_OutOfResources;
-				OFStandard::deleteFile(ofname);
-			}
 
-			// sanity checking matching SOP Class and SOP Instance UIDs
-			if (out_response->DimseStatus == STATUS_Success) {
-				if (!DU_findSOPClassAndInstanceInDataSet(*in_dataset,
-				                                         sopClass,
-				                                         sizeof(sopClass),
-				                                         sopInstance,
-				                                         sizeof(sopInstance))) {
-					// FIXME: replace with OFLOG
-					DCMNET_ERROR("bad DICOM file: " << filename);
-					out_response->DimseStatus = STATUS_STORE_Error_CannotUnderstand;
-				} else if (strcmp(sopClass, in_request->AffectedSOPClassUID) != 0) {
-					out_response->DimseStatus = STATUS_STORE_Error_DataSetDoesNotMatchSOPClass;
-				}
-			}
+		const StoreCallbackData *storecbdata = OFstatic_cast(StoreCallbackData *, store_callback_data);
+		if (out_response->DimseStatus == STATUS_Success && storecbdata->m_context != nullptr)
+			storecbdata->m_context->m_receivedInstances.insert(in_request->AffectedSOPInstanceUID);
+	}
+}
+
+namespace {
+	// preamble and meta header of the file, data set bytes follow as received
+	OFCondition writeMetaHeader(DcmOutputStream &           stream,
+	                            T_ASC_Association *         assoc,
+	                            T_ASC_PresentationContextID pres_id,
+	                            const T_DIMSE_C_StoreRQ *   request,
+	                            std::string &               transfer_syntax) {
+		T_ASC_PresentationContext presentationContext;
+		OFCondition cond = ASC_findAcceptedPresentationContext(assoc->params, pres_id, &presentationContext);
+		if (cond.bad())
+			return cond;
+
+		DcmFileFormat fileformat;
+		DcmMetaInfo * metaInfo = fileformat.getMetaInfo();
+		metaInfo->putAndInsertString(DCM_MediaStorageSOPClassUID, request->AffectedSOPClassUID);
+		metaInfo->putAndInsertString(DCM_MediaStorageSOPInstanceUID, request->AffectedSOPInstanceUID);
+		if (const char *aet = assoc->params->DULparams.calledAPTitle)
+			metaInfo->putAndInsertString(DCM_SourceApplicationEntityTitle, aet);
+
+		transfer_syntax = presentationContext.acceptedTransferSyntax;
+		cond = fileformat.validateMetaInfo(DcmXfer(presentationContext.acceptedTransferSyntax).getXfer());
+		if (cond.bad())
+			return cond;
+
+		metaInfo->transferInit();
+		cond = metaInfo->write(stream, META_HEADER_DEFAULT_TRANSFERSYNTAX, EET_ExplicitLength, nullptr);
+		metaInfo->transferEnd();
+		return cond;
+	}
+
+	/*
+	 * Only the header up to SeriesInstanceUID is read from the file just written or from buffer
+	 * of an instance kept in memory, m_path is left empty.
+	 */
+	IndexedInstance describeInstance(const OFString &         filename,
+	                                 const std::string *      buffer,
+	                                 const T_DIMSE_C_StoreRQ *request,
+	                                 const ChecksumConsumer & consumer) {
+		DcmFileFormat header;
+		OFString      studyUid, seriesUid;
+		OFCondition   cond;
+		if (buffer != nullptr) {
+			DcmInputBufferStream stream;
+			stream.setBuffer(buffer->data(), static_cast<offile_off_t>(buffer->size()));
+			stream.setEos();
+			header.transferInit();
+			cond = header.readUntilTag(stream, EXS_Unknown, EGL_noChange, DCM_MaxReadLength, DCM_SeriesNumber);
+			header.transferEnd();
+		} else {
+			cond = header.loadFileUntilTag(filename, EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect,
+			                               DCM_SeriesNumber);
 		}
+
+		if (cond.good()) {
+			header.getDataset()->findAndGetOFString(DCM_StudyInstanceUID, studyUid);
+			header.getDataset()->findAndGetOFString(DCM_SeriesInstanceUID, seriesUid);
+		}
+
+		IndexedInstance instance;
+		instance.m_studyUid  = studyUid.c_str();
+		instance.m_seriesUid = seriesUid.c_str();
+		instance.m_sopUid    = request->AffectedSOPInstanceUID;
+		instance.m_size      = consumer.size();
+		instance.m_checksum  = consumer.checksum();
+		return instance;
+	}
+
+	// part is moved into shared store, output file becomes link to the stored object
+	bool storeInstance(ContentStore &   store,
+	                   const OFString & part_name,
+	                   const OFString & ofname,
+	                   const char *     filename,
+	                   IndexedInstance  instance,
+	                   std::error_code &ec) {
+		instance.m_path                    = filename;
+		const std::filesystem::path object = store.commit(part_name.c_str(), std::move(instance), ec);
+		return !object.empty() && linkInstanceFile(object, ofname.c_str(), ec);
 	}
 }
 
@@ -246,8 +324,8 @@ OFCondition storeSCP(T_ASC_Association *         assoc,
                      T_ASC_PresentationContextID pres_id,
                      const std::string &         output_directory,
                      T_DIMSE_BlockingMode        block_mode,
-                     int                         dimse_timeout) {
-	OFCondition        cond    = EC_Normal;
+                     int                         dimse_timeout,
+                     ReceiveContext *            context) {
 	T_DIMSE_C_StoreRQ *request = &message->msg.CStoreRQ;
 
 	char filename[2048];
@@ -263,33 +341,156 @@ OFCondition storeSCP(T_ASC_Association *         assoc,
 	StoreCallbackData storeCallbackData;
 	storeCallbackData.m_assoc    = assoc;
 	storeCallbackData.m_filename = ofname;
-	DcmFileFormat fileformat;
-	storeCallbackData.m_fileformat = &fileformat;
-
-	if (assoc && assoc->params) {
-		const char *aet = assoc->params->DULparams.calledAPTitle;
-		if (aet)
-			fileformat.getMetaInfo()->putAndInsertString(DCM_SourceApplicationEntityTitle, aet);
+	storeCallbackData.m_context  = context;
+
+	T_DIMSE_C_StoreRSP response{};
+	response.MessageIDBeingRespondedTo = request->MessageID;
+	OFStandard::strlcpy(response.AffectedSOPClassUID, request->AffectedSOPClassUID, sizeof(response.AffectedSOPClassUID));
+	OFStandard::strlcpy(response.AffectedSOPInstanceUID,
+	                    request->AffectedSOPInstanceUID,
+	                    sizeof(response.AffectedSOPInstanceUID));
+	response.opts = O_STORE_AFFECTEDSOPCLASSUID | O_STORE_AFFECTEDSOPINSTANCEUID;
+	if (request->opts & O_STORE_RQ_BLANK_PADDING)
+		response.opts |= O_STORE_RSP_BLANK_PADDING;
+	response.DataSetType = DIMSE_DATASET_NULL;
+	response.DimseStatus = STATUS_Success;
+
+	T_DIMSE_StoreProgress progress{};
+	DcmDataset *          statusDetail = nullptr;
+	progress.state                     = DIMSE_StoreBegin;
+	storeSCPCallback(&storeCallbackData, &progress, request, filename, &response, &statusDetail);
+
+	/*
+	 * Data set is written as received (bit preserving) into a partial file renamed once complete,
+	 * instances of archived studies are kept in memory until appended to the archive.
+	 */
+	ContentStore * store    = context != nullptr ? context->m_store : nullptr;
+	StudyArchive * archive  = context != nullptr ? context->m_archive : nullptr;
+	const OFString partName = store != nullptr
+		                          ? OFString(store->partPath(filename).string().c_str())
+		                          : ofname + ".part";
+
+	std::unique_ptr<ChecksumConsumer> consumer;
+	ChecksumBufferConsumer *          buffer = nullptr;
+	if (archive != nullptr) {
+		auto bufferConsumer = std::make_unique<ChecksumBufferConsumer>();
+		buffer              = bufferConsumer.get();
+		consumer            = std::move(bufferConsumer);
+	} else {
+#ifdef FNOSTUDYQR_WITH_URING
+		if (context != nullptr && context->m_uring != nullptr)
+			consumer = std::make_unique<UringFileConsumer>(*context->m_uring, partName.c_str(), context->m_sizeHint);
+		else
+			consumer = std::make_unique<ChecksumFileConsumer>(partName.c_str());
+#else
+		consumer = std::make_unique<ChecksumFileConsumer>(partName.c_str());
+#endif
+	}
+	if (context != nullptr && context->m_sha256)
+		consumer->computeSha256();
+	if (context != nullptr)
+		consumer->setRateLimiter(context->m_rateLimiter);
+	ConsumerOutputStream stream(*consumer);
+
+	std::string transferSyntax;
+	OFCondition cond = consumer->good()
+		                   ? writeMetaHeader(stream, assoc, pres_id, request, transferSyntax)
+		                   : consumer->status();
+	if (cond.good()) {
+		T_ASC_PresentationContextID dataPresID = pres_id;
+		cond = DIMSE_receiveDataSetInFile(assoc, block_mode, dimse_timeout, &dataPresID, &stream, nullptr, nullptr);
+		if (cond.good() && dataPresID != pres_id)
+			cond = DIMSE_INVALIDPRESENTATIONCONTEXTID;
+	} else {
+		// data set still has to be read off the association before responding
+		DCMNET_ERROR("Cannot write DICOM file: " << partName);
+		DcmDataset *discarded = nullptr;
+		cond                  = DIMSE_receiveDataSetInMemory(assoc, block_mode, dimse_timeout, &pres_id, &discarded,
+		                                                     nullptr, nullptr);
+		delete discarded;
+		response.DimseStatus = STATUS_STORE_Refused_OutOfResources;
 	}
 
-	cond = DIMSE_storeProvider(assoc,
-	                           pres_id,
-	                           request,
-	                           ofname.c_str(),
-	                           OFTrue /* write file with meta header */,
-	                           nullptr,
-	                           storeSCPCallback,
-	                           OFreinterpret_cast(void *, &storeCallbackData),
-	                           block_mode,
-	                           dimse_timeout);
-
+	const OFCondition closeCond = consumer->close();
 	if (cond.bad()) {
 		OFString temp_string;
 		DCMNET_ERROR("Store SCP Failed: " << DimseCondition::dump(temp_string, cond));
-		if (strcmp(filename, NULL_DEVICE_NAME) != 0)
-			OFStandard::deleteFile(ofname);
+		OFStandard::deleteFile(partName);
+		return cond;
 	}
 
+	std::error_code ec;
+	IndexedInstance instance;
+	if (response.DimseStatus == STATUS_Success) {
+		if (closeCond.good()) {
+			instance = describeInstance(partName, buffer != nullptr ? &buffer->data() : nullptr, request, *consumer);
+			instance.m_transferSyntax = transferSyntax;
+			if (context != nullptr)
+				context->m_sizeHint = instance.m_size;
+			if (archive != nullptr) {
+				if (!archive->append(filename, buffer->data(), instance))
+					ec = std::make_error_code(std::errc::io_error);
+			} else {
+				// series is known only once the header is written, its directory is created on first instance
+				if (context != nullptr && context->m_perSeries && !instance.m_seriesUid.empty()) {
+					const std::filesystem::path seriesDirectory = std::filesystem::path(output_directory) /
+					                                              instance.m_seriesUid;
+					if (context->m_seriesDirectories.insert(instance.m_seriesUid).second)
+						std::filesystem::create_directories(seriesDirectory, ec);
+					ofname                       = (seriesDirectory / filename).string().c_str();
+					storeCallbackData.m_filename = ofname;
+				}
+
+				if (ec)
+					context->m_seriesDirectories.erase(instance.m_seriesUid);
+				else if (store != nullptr)
+					storeInstance(*store, partName, ofname, filename, instance, ec);
+				else
+					std::filesystem::rename(partName.c_str(), ofname.c_str(), ec);
+			}
+		}
+		if (closeCond.bad() || ec) {
+			DCMNET_ERROR("Cannot write DICOM file: " << ofname);
+			response.DimseStatus = STATUS_STORE_Refused_OutOfResources;
+		}
+	}
+	if (response.DimseStatus != STATUS_Success)
+		OFStandard::deleteFile(partName);
+
+	progress.state = DIMSE_StoreEnd;
+	storeSCPCallback(&storeCallbackData, &progress, request, filename, &response, &statusDetail);
+
+	if (response.DimseStatus == STATUS_Success && context != nullptr) {
+		++context->m_storedInstances;
+		context->m_storedBytes += instance.m_size;
+	}
+
+	if (context != nullptr && context->m_capture != nullptr)
+		context->m_capture->store(context->m_captureSession, response.DimseStatus, request->AffectedSOPClassUID,
+		                          request->AffectedSOPInstanceUID, instance.m_seriesUid, instance.m_transferSyntax,
+		                          instance.m_size);
+
+	if (response.DimseStatus == STATUS_Success && context != nullptr && context->m_manifest != nullptr) {
+		const std::filesystem::path written = ofname.c_str();
+		IndexedInstance             listed  = instance;
+		listed.m_path                       = written.lexically_relative(output_directory).generic_string();
+		context->m_manifest->add(listed, consumer->sha256());
+	}
+
+	if (response.DimseStatus == STATUS_Success && context != nullptr && context->m_index != nullptr) {
+		const std::filesystem::path written = ofname.c_str();
+		instance.m_path                     = written.lexically_relative(context->m_index->directory()).generic_string();
+		context->m_index->add(std::move(instance));
+	}
+
+	cond = DIMSE_sendStoreResponse(assoc, pres_id, request, &response, statusDetail);
+	delete statusDetail;
+	if (cond.bad()) {
+		OFString temp_string;
+		DCMNET_ERROR("Sending C-STORE-RSP failed: " << DimseCondition::dump(temp_string, cond));
+		if (context != nullptr)
+			context->m_receivedInstances.erase(request->AffectedSOPInstanceUID);
+	}
 	return cond;
 }
 
@@ -317,40 +518,76 @@ OFCondition echoSCP(T_ASC_Association *assoc,
 	return cond;
 }
 
-int selectReadable(T_ASC_Association *        assoc,
-                   T_ASC_Network *            net,
-                   T_ASC_Association *        sub_assoc,
-                   const T_DIMSE_BlockingMode block_mode,
-                   int                        timeout) {
-	T_ASC_Association *assocList[2] = {nullptr, nullptr};
-	int                assocCount{0};
-	if (net != nullptr && sub_assoc == nullptr) {
-		if (ASC_associationWaiting(net, 0))
-			return 2;
+namespace {
+	DcmNativeSocketType associationSocket(T_ASC_Association *assoc) {
+		DcmTransportConnection *connection = DUL_getTransportConnection(assoc->DULassociation);
+		return connection ? connection->getSocket() : OFstatic_cast(DcmNativeSocketType, -1);
 	}
 
-	assocList[0] = assoc;
-	assocCount   = 1;
-	assocList[1] = sub_assoc;
-
-	if (sub_assoc != nullptr)
-		assocCount++;
-
-	if (sub_assoc == nullptr)
-		timeout = 1;
-	else {
-		if (block_mode == DIMSE_BLOCKING)
-			timeout = 10000;
+	bool isValidSocket(const DcmNativeSocketType socket) {
+#ifdef _WIN32
+		return socket != INVALID_SOCKET;
+#else
+		return socket >= 0;
+#endif
 	}
 
-	if (!ASC_selectReadableAssociation(assocList, assocCount, timeout))
-		return 0; // none readable
-
-	if (assocList[0] != nullptr)
-		return 1; // main association readable
+	// select() failed because of a signal, any other error is not going away by waiting again
+	bool isInterrupted() {
+#ifdef _WIN32
+		return WSAGetLastError() == WSAEINTR;
+#else
+		return errno == EINTR;
+#endif
+	}
+}
 
-	if (assocList[1] != nullptr)
-		return 2; // sub association readable
+MoveEvent waitForMoveEvent(T_ASC_Association *assoc,
+                           T_ASC_Network *    net,
+                           T_ASC_Association *sub_assoc,
+                           const int          timeout) {
+	// data already read from socket into DUL buffers is not reported by select()
+	if (sub_assoc != nullptr && ASC_dataWaiting(sub_assoc, 0))
+		return MoveEvent::SubAssocReadable;
+	if (assoc != nullptr && ASC_dataWaiting(assoc, 0))
+		return MoveEvent::MainReadable;
+
+	DcmNativeSocketType mainSocket   = assoc ? associationSocket(assoc) : OFstatic_cast(DcmNativeSocketType, -1);
+	DcmNativeSocketType subSocket    = sub_assoc ? associationSocket(sub_assoc) : OFstatic_cast(DcmNativeSocketType, -1);
+	DcmNativeSocketType listenSocket = net ? DUL_networkSocket(net->network) : OFstatic_cast(DcmNativeSocketType, -1);
+
+	fd_set         readSet;
+	struct timeval timeoutValue{};
+	timeoutValue.tv_sec = timeout;
+
+	// Linux leaves the remaining time in timeoutValue, elsewhere an interrupted wait restarts the timeout
+	int readyCount;
+	do {
+		FD_ZERO(&readSet);
+		DcmNativeSocketType maxSocket{0};
+		for (const DcmNativeSocketType socket : {mainSocket, subSocket, listenSocket}) {
+			if (!isValidSocket(socket))
+				continue;
+			FD_SET(socket, &readSet);
+			maxSocket = std::max(maxSocket, socket);
+		}
 
-	return 0; // should not be reached
+		readyCount = select(OFstatic_cast(int, maxSocket + 1),
+		                    &readSet,
+		                    nullptr,
+		                    nullptr,
+		                    timeout < 0 ? nullptr : &timeoutValue);
+	} while (readyCount < 0 && isInterrupted());
+
+	if (readyCount < 0)
+		return MoveEvent::Error;
+	if (readyCount == 0)
+		return MoveEvent::Timeout;
+
+	// serve store data first, PACS usually holds back C-MOVE-RSP until sub-operation finished
+	if (isValidSocket(subSocket) && FD_ISSET(subSocket, &readSet))
+		return MoveEvent::SubAssocReadable;
+	if (isValidSocket(listenSocket) && FD_ISSET(listenSocket, &readSet))
+		return MoveEvent::SubAssocRequest;
+	return MoveEvent::MainReadable;
 }
@@ -0,0 +1,212 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+
+#include "fmt/format.h"
+
+namespace {
+	constexpr std::uint64_t PRIME1{11400714785074694791ULL};
+	constexpr std::uint64_t PRIME2{14029467366897019727ULL};
+	constexpr std::uint64_t PRIME3{1609587929392839161ULL};
+	constexpr std::uint64_t PRIME4{9650029242287828579ULL};
+	constexpr std::uint64_t PRIME5{2870177450012600261ULL};
+
+	// input is little endian regardless of host
+	std::uint64_t read64(const unsigned char *p) {
+		std::uint64_t value{0};
+		for (int i = 7; i >= 0; --i)
+			value = (value << 8) | p[i];
+		return value;
+	}
+
+	std::uint32_t read32(const unsigned char *p) {
+		return static_cast<std::uint32_t>(p[0]) | static_cast<std::uint32_t>(p[1]) << 8 |
+		       static_cast<std::uint32_t>(p[2]) << 16 | static_cast<std::uint32_t>(p[3]) << 24;
+	}
+
+	std::uint64_t round(std::uint64_t accumulator, const std::uint64_t input) {
+		accumulator += input * PRIME2;
+		return std::rotl(accumulator, 31) * PRIME1;
+	}
+
+	std::uint64_t mergeRound(std::uint64_t hash, const std::uint64_t accumulator) {
+		hash ^= round(0, accumulator);
+		return hash * PRIME1 + PRIME4;
+	}
+}
+
+XxHash64::XxHash64(const std::uint64_t seed)
+	: m_seed(seed), m_accumulators{seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1} {}
+
+void XxHash64::update(const void *data, std::size_t length) {
+	auto *input = static_cast<const unsigned char *>(data);
+	m_totalLength += length;
+
+	if (m_bufferSize + length < sizeof(m_buffer)) {
+		std::memcpy(m_buffer + m_bufferSize, input, length);
+		m_bufferSize += length;
+		return;
+	}
+
+	if (m_bufferSize > 0) {
+		const std::size_t fill = sizeof(m_buffer) - m_bufferSize;
+		std::memcpy(m_buffer + m_bufferSize, input, fill);
+		for (int i = 0; i < 4; ++i)
+			m_accumulators[i] = round(m_accumulators[i], read64(m_buffer + 8 * i));
+		input += fill;
+		length -= fill;
+		m_bufferSize = 0;
+	}
+
+	for (; length >= 32; input += 32, length -= 32) {
+		for (int i = 0; i < 4; ++i)
+			m_accumulators[i] = round(m_accumulators[i], read64(input + 8 * i));
+	}
+
+	std::memcpy(m_buffer, input, length);
+	m_bufferSize = length;
+}
+
+std::uint64_t XxHash64::digest() const {
+	std::uint64_t hash;
+	if (m_totalLength >= 32) {
+		hash = std::rotl(m_accumulators[0], 1) + std::rotl(m_accumulators[1], 7) +
+		       std::rotl(m_accumulators[2], 12) + std::rotl(m_accumulators[3], 18);
+		for (const std::uint64_t accumulator : m_accumulators)
+			hash = mergeRound(hash, accumulator);
+	} else {
+		hash = m_seed + PRIME5;
+	}
+	hash += m_totalLength;
+
+	const unsigned char *p   = m_buffer;
+	const unsigned char *end = m_buffer + m_bufferSize;
+	for (; p + 8 <= end; p += 8)
+		hash = std::rotl(hash ^ round(0, read64(p)), 27) * PRIME1 + PRIME4;
+	if (p + 4 <= end) {
+		hash = std::rotl(hash ^ static_cast<std::uint64_t>(read32(p)) * PRIME1, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+		hash = std::rotl(hash ^ *p * PRIME5, 11) * PRIME1;
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+namespace {
+	constexpr std::uint32_t SHA256_K[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+}
+
+Sha256::Sha256()
+	: m_state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19} {}
+
+void Sha256::compress(const unsigned char *block) {
+	std::uint32_t w[64];
+	for (int i = 0; i < 16; ++i) {
+		w[i] = static_cast<std::uint32_t>(block[4 * i]) << 24 | static_cast<std::uint32_t>(block[4 * i + 1]) << 16 |
+		       static_cast<std::uint32_t>(block[4 * i + 2]) << 8 | static_cast<std::uint32_t>(block[4 * i + 3]);
+	}
+	for (int i = 16; i < 64; ++i) {
+		const std::uint32_t s0 = std::rotr(w[i - 15], 7) ^ std::rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		const std::uint32_t s1 = std::rotr(w[i - 2], 17) ^ std::rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i]                   = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	std::uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+	std::uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+	for (int i = 0; i < 64; ++i) {
+		const std::uint32_t t1 = h + (std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25)) + ((e & f) ^ (~e & g)) +
+		                         SHA256_K[i] + w[i];
+		const std::uint32_t t2 = (std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22)) +
+		                         ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	m_state[0] += a;
+	m_state[1] += b;
+	m_state[2] += c;
+	m_state[3] += d;
+	m_state[4] += e;
+	m_state[5] += f;
+	m_state[6] += g;
+	m_state[7] += h;
+}
+
+void Sha256::update(const void *data, std::size_t length) {
+	auto *input = static_cast<const unsigned char *>(data);
+	m_totalLength += length;
+
+	if (m_bufferSize > 0) {
+		const std::size_t fill = std::min(length, sizeof(m_buffer) - m_bufferSize);
+		std::memcpy(m_buffer + m_bufferSize, input, fill);
+		m_bufferSize += fill;
+		input += fill;
+		length -= fill;
+		if (m_bufferSize < sizeof(m_buffer))
+			return;
+		this->compress(m_buffer);
+		m_bufferSize = 0;
+	}
+
+	for (; length >= sizeof(m_buffer); input += sizeof(m_buffer), length -= sizeof(m_buffer))
+		this->compress(input);
+
+	std::memcpy(m_buffer, input, length);
+	m_bufferSize = length;
+}
+
+std::string Sha256::hexDigest() const {
+	// padding is applied to a copy, hashing may continue
+	Sha256              final  = *this;
+	const std::uint64_t bits   = m_totalLength * 8;
+	const unsigned char one    = 0x80;
+	const unsigned char zero[64]{};
+	final.update(&one, 1);
+	final.update(zero, (final.m_bufferSize <= 56 ? 56 : 120) - final.m_bufferSize);
+
+	unsigned char length[8];
+	for (int i = 0; i < 8; ++i)
+		length[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+	final.update(length, sizeof(length));
+
+	std::string digest;
+	for (const std::uint32_t word : final.m_state)
+		digest += fmt::format("{:08x}", word);
+	return digest;
+}
+
+std::string formatChecksum(const std::uint64_t checksum) {
+	return fmt::format("{:016x}", checksum);
+}
+
+bool parseChecksum(const std::string &value, std::uint64_t &checksum) {
+	return value.size() == 16 &&
+	       std::from_chars(value.data(), value.data() + value.size(), checksum, 16).ec == std::errc{};
+}
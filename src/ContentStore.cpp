@@ -0,0 +1,136 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "ContentStore.hpp"
+
+#include <random>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#include "fmt/format.h"
+
+#include "Checksum.hpp"
+
+namespace {
+	constexpr const char *OBJECTS_DIRECTORY{"objects"};
+	constexpr const char *PARTS_DIRECTORY{"tmp"};
+
+	// copy on write clone, only where the filesystem supports it (btrfs, XFS)
+	bool reflink(const std::filesystem::path &src, const std::filesystem::path &dst) {
+#if defined(__linux__) && defined(FICLONE)
+		const int in = ::open(src.c_str(), O_RDONLY);
+		if (in < 0)
+			return false;
+		const int out = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (out < 0) {
+			::close(in);
+			return false;
+		}
+		const bool cloned = ::ioctl(out, FICLONE, in) == 0;
+		::close(in);
+		::close(out);
+		if (!cloned) {
+			std::error_code ec;
+			std::filesystem::remove(dst, ec);
+		}
+		return cloned;
+#else
+		(void) src;
+		(void) dst;
+		return false;
+#endif
+	}
+}
+
+bool linkInstanceFile(const std::filesystem::path &src, const std::filesystem::path &dst, std::error_code &ec) {
+	std::filesystem::remove(dst, ec);
+	ec.clear();
+
+	std::filesystem::create_hard_link(src, dst, ec);
+	if (!ec)
+		return true;
+
+	// store on another filesystem than output directory
+	if (reflink(src, dst)) {
+		ec.clear();
+		return true;
+	}
+	ec.clear();
+	return std::filesystem::copy_file(src, dst, std::filesystem::copy_options::overwrite_existing, ec);
+}
+
+bool ContentStore::open(const std::filesystem::path &directory, std::string &error_msg) {
+	std::error_code ec;
+	std::filesystem::create_directories(directory / OBJECTS_DIRECTORY, ec);
+	if (!ec)
+		std::filesystem::create_directories(directory / PARTS_DIRECTORY, ec);
+	if (ec) {
+		error_msg = fmt::format("Unable to create content store {}: {}", directory.string(), ec.message());
+		return false;
+	}
+
+	m_session = std::random_device{}();
+	return m_index.open(directory, error_msg);
+}
+
+std::filesystem::path ContentStore::partPath(const std::string &filename) {
+	return this->directory() / PARTS_DIRECTORY / fmt::format("{}.{:x}.{}.part", filename, m_session, ++m_parts);
+}
+
+std::filesystem::path ContentStore::commit(const std::filesystem::path &part,
+                                           IndexedInstance              instance,
+                                           std::error_code &            ec) {
+	const std::string           hash     = formatChecksum(instance.m_checksum);
+	const std::filesystem::path relative = std::filesystem::path(OBJECTS_DIRECTORY) / hash.substr(0, 2) /
+	                                       fmt::format("{}-{}", hash, instance.m_path);
+	const std::filesystem::path object   = this->directory() / relative;
+
+	std::filesystem::create_directories(object.parent_path(), ec);
+	if (ec)
+		return {};
+
+	// same SOPInstanceUID and hash was stored by another run, content is identical
+	const bool stored = std::filesystem::file_size(object, ec) == instance.m_size && !ec;
+	if (stored) {
+		std::filesystem::remove(part, ec);
+		ec.clear();
+	} else {
+		std::filesystem::rename(part, object, ec);
+		if (ec)
+			return {};
+	}
+
+	instance.m_path = relative.generic_string();
+	m_index.add(std::move(instance));
+	return object;
+}
+
+std::vector<IndexedInstance> ContentStore::materialize(const std::string &          study_uid,
+                                                       const std::filesystem::path &study_directory,
+                                                       const OutputLayout &         layout) const {
+	std::vector<IndexedInstance>    linked;
+	std::set<std::filesystem::path> directories;
+	for (IndexedInstance instance : m_index.entries(study_uid)) {
+		const std::filesystem::path object    = this->directory() / instance.m_path;
+		const std::string           name      = object.filename().string();
+		const std::size_t           hashEnd   = name.find('-');
+		const std::filesystem::path directory = instanceDirectoryPath(study_directory, instance.m_seriesUid, layout);
+		const std::filesystem::path filename  = directory / name.substr(hashEnd + 1);
+
+		std::error_code ec;
+		if (directories.insert(directory).second)
+			std::filesystem::create_directories(directory, ec);
+		if (ec || hashEnd == std::string::npos || !linkInstanceFile(object, filename, ec))
+			continue;
+
+		instance.m_path = filename.lexically_relative(study_directory).generic_string();
+		linked.push_back(std::move(instance));
+	}
+	return linked;
+}
@@ -0,0 +1,165 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "DateSweep.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "fmt/format.h"
+
+namespace {
+	// PACS time matching is second precision, narrower windows are not split
+	constexpr int MIN_TIME_WINDOW{60};
+
+	std::string formatTime(const int second) {
+		return fmt::format("{:02}{:02}{:02}", second / 3600, second / 60 % 60, second % 60);
+	}
+}
+
+bool findResultCapped(const std::size_t results, const DIC_US status, const unsigned int find_limit) {
+	return status == STATUS_FIND_Refused_OutOfResources || (find_limit > 0 && results >= find_limit);
+}
+
+DateSweep::DateSweep(const QueryRetriever &prototype, std::string modalities, const SweepOptions options)
+	: m_prototype(prototype), m_modalities(std::move(modalities)), m_options(options) {}
+
+OFCondition DateSweep::run(const PatientRecord &query, const StudyCallback &on_study) {
+	DateRange range;
+	if (!parseDateRange(query.m_study_date, range)) {
+		OFLOG_ERROR(qrLogger, fmt::format("Cannot sweep StudyDate \"{}\", closed date range required", query.m_study_date));
+		return EC_IllegalParameter;
+	}
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_windows     = {Window{range}};
+		m_pending     = 1;
+		m_result      = EC_Normal;
+		m_setupResult = EC_Normal;
+		m_queries     = 0;
+		m_splits      = 0;
+		m_seen.clear();
+	}
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < std::max(1u, m_options.concurrency); ++i)
+		workers.emplace_back(&DateSweep::work, this, std::cref(query), std::cref(on_study));
+	for (auto &worker : workers)
+		worker.join();
+
+	OFLOG_INFO(qrLogger,
+	           fmt::format("Swept {} in {} queries, {} split(s), {} unique study/ies",
+		           query.m_study_date, m_queries, m_splits, m_seen.size()));
+
+	// every worker failed to negotiate an association
+	if (!m_windows.empty())
+		return m_setupResult;
+	return m_result;
+}
+
+void DateSweep::work(const PatientRecord &query, const StudyCallback &on_study) {
+	QueryRetriever retriever;
+	retriever.copySettings(m_prototype);
+	retriever.attachNetwork(m_prototype.network(), nullptr);
+
+	OFCondition cond = retriever.ensureAssociation();
+	if (cond.good())
+		cond = retriever.prepareFindIdentifiers(m_modalities);
+	if (cond.bad()) {
+		// windows are left to the other workers
+		OFLOG_WARN(qrLogger, fmt::format("Sweep worker unavailable: {}", cond.text()));
+		std::lock_guard lock(m_mutex);
+		m_setupResult = cond;
+		return;
+	}
+
+	while (true) {
+		Window window;
+		{
+			std::unique_lock lock(m_mutex);
+			m_condition.wait(lock, [this] { return !m_windows.empty() || m_pending == 0; });
+			if (m_windows.empty())
+				break;
+			window = m_windows.front();
+			m_windows.pop_front();
+		}
+
+		this->queryWindow(retriever, query, window, on_study);
+
+		{
+			std::lock_guard lock(m_mutex);
+			--m_pending;
+		}
+		m_condition.notify_all();
+	}
+	(void) retriever.releaseAssociation();
+}
+
+void DateSweep::queryWindow(QueryRetriever &      retriever,
+                            const PatientRecord & query,
+                            const Window &        window,
+                            const StudyCallback & on_study) {
+	constexpr int DAY_END{24 * 60 * 60 - 1};
+	const bool    wholeDay = window.m_firstSecond == 0 && window.m_lastSecond == DAY_END;
+
+	PatientRecord windowQuery = query;
+	windowQuery.m_study_date  = formatDateRange(window.m_range);
+	windowQuery.m_study_time  = wholeDay
+		                            ? ""
+		                            : fmt::format("{}-{}", formatTime(window.m_firstSecond),
+		                                          formatTime(window.m_lastSecond));
+
+	std::vector<StudyInfo> studies;
+	const OFCondition      cond   = retriever.findStudies(windowQuery, studies);
+	const DIC_US           status = retriever.lastFindStatus();
+	const bool capped = cond.good() && findResultCapped(studies.size(), status, m_options.findLimit);
+
+	std::vector<Window> split;
+	if (capped) {
+		if (window.m_range.m_first < window.m_range.m_last) {
+			const std::chrono::sys_days middle = window.m_range.m_first +
+			                                     (window.m_range.m_last - window.m_range.m_first) / 2;
+			split.push_back(Window{DateRange{window.m_range.m_first, middle}});
+			split.push_back(Window{DateRange{middle + std::chrono::days{1}, window.m_range.m_last}});
+		} else if (window.m_lastSecond - window.m_firstSecond + 1 > MIN_TIME_WINDOW) {
+			const int middle = window.m_firstSecond + (window.m_lastSecond - window.m_firstSecond) / 2;
+			split.push_back(Window{window.m_range, window.m_firstSecond, middle});
+			split.push_back(Window{window.m_range, middle + 1, window.m_lastSecond});
+		} else {
+			OFLOG_WARN(qrLogger,
+			           fmt::format("StudyDate {}, StudyTime {} still hits the result limit, results may be incomplete",
+				           windowQuery.m_study_date, windowQuery.m_study_time));
+		}
+	} else if (cond.good() && status != STATUS_Success) {
+		OFLOG_WARN(qrLogger,
+		           fmt::format("StudyDate {} {} finished with status 0x{:04x}",
+			           windowQuery.m_study_date, windowQuery.m_study_time, status));
+	}
+
+	std::lock_guard lock(m_mutex);
+	++m_queries;
+	if (cond.bad()) {
+		OFLOG_ERROR(qrLogger,
+		            fmt::format("Sweeping StudyDate {} {} failed: {}",
+			            windowQuery.m_study_date, windowQuery.m_study_time, cond.text()));
+		m_result = cond;
+	}
+
+	// partial results of split windows are kept, repeats are filtered here
+	for (const auto &study : studies) {
+		if (m_seen.insert(study.m_uid).second)
+			on_study(study);
+	}
+
+	if (!split.empty()) {
+		OFLOG_DEBUG(qrLogger,
+		            fmt::format("StudyDate {} {} capped at {} results, splitting",
+			            windowQuery.m_study_date, windowQuery.m_study_time, studies.size()));
+		++m_splits;
+		m_pending += split.size();
+		m_windows.insert(m_windows.end(), split.begin(), split.end());
+	}
+}
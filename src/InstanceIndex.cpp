@@ -0,0 +1,112 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "InstanceIndex.hpp"
+
+#include "fmt/format.h"
+
+#include "Checksum.hpp"
+#include "Utility.hpp"
+
+namespace {
+	bool parseLine(const std::string &line, IndexedInstance &instance) {
+		std::vector<std::string> fields = splitFields(line, '\t');
+		if (fields.size() < 6 || fields[2].empty())
+			return false;
+
+		if (!parseNumber(fields[4], instance.m_size) || !parseChecksum(fields[5], instance.m_checksum))
+			return false;
+
+		instance.m_studyUid  = std::move(fields[0]);
+		instance.m_seriesUid = std::move(fields[1]);
+		instance.m_sopUid    = std::move(fields[2]);
+		instance.m_path      = std::move(fields[3]);
+		if (fields.size() >= 7)
+			instance.m_transferSyntax = std::move(fields[6]);
+		return true;
+	}
+}
+
+bool InstanceIndex::open(const std::filesystem::path &directory, std::string &error_msg) {
+	std::lock_guard lock(m_mutex);
+	m_directory = directory;
+	m_instances.clear();
+	m_studies.clear();
+
+	const std::filesystem::path indexPath = directory / FILENAME;
+	std::ifstream               indexFile{indexPath};
+	std::string                 line;
+	while (std::getline(indexFile, line)) {
+		IndexedInstance instance;
+		if (!parseLine(line, instance))
+			continue;
+		m_studies[instance.m_studyUid].insert(instance.m_sopUid);
+		m_instances.insert_or_assign(instance.m_sopUid, std::move(instance));
+	}
+
+	m_file.open(indexPath, std::ios::app);
+	if (!m_file.is_open()) {
+		error_msg = fmt::format("Unable to open instance index {}", indexPath.string());
+		return false;
+	}
+	return true;
+}
+
+void InstanceIndex::add(IndexedInstance instance) {
+	std::lock_guard lock(m_mutex);
+	if (m_file.is_open()) {
+		m_file << fmt::format("{}\t{}\t{}\t{}\t{}\t{}\t{}\n",
+		                      instance.m_studyUid,
+		                      instance.m_seriesUid,
+		                      instance.m_sopUid,
+		                      instance.m_path,
+		                      instance.m_size,
+		                      formatChecksum(instance.m_checksum),
+		                      instance.m_transferSyntax);
+		m_file.flush();
+	}
+	m_studies[instance.m_studyUid].insert(instance.m_sopUid);
+	m_instances.insert_or_assign(instance.m_sopUid, std::move(instance));
+}
+
+bool InstanceIndex::present(const IndexedInstance &instance) const {
+	std::error_code ec;
+	const auto      size = std::filesystem::file_size(m_directory / instance.m_path, ec);
+	return !ec && size == instance.m_size;
+}
+
+bool InstanceIndex::contains(const std::string &sop_uid) const {
+	std::lock_guard lock(m_mutex);
+	const auto      it = m_instances.find(sop_uid);
+	return it != m_instances.end() && present(it->second);
+}
+
+std::set<std::string> InstanceIndex::instances(const std::string &study_uid) const {
+	std::set<std::string> result;
+	for (const auto &instance : this->entries(study_uid))
+		result.insert(instance.m_sopUid);
+	return result;
+}
+
+std::vector<IndexedInstance> InstanceIndex::entries(const std::string &study_uid) const {
+	std::lock_guard              lock(m_mutex);
+	std::vector<IndexedInstance> result;
+
+	const auto study = m_studies.find(study_uid);
+	if (study == m_studies.end())
+		return result;
+
+	for (const auto &sop : study->second) {
+		const IndexedInstance &instance = m_instances.at(sop);
+		// instance may have been received again as part of another study
+		if (instance.m_studyUid == study_uid && present(instance))
+			result.push_back(instance);
+	}
+	return result;
+}
+
+std::size_t InstanceIndex::size() const {
+	std::lock_guard lock(m_mutex);
+	return m_instances.size();
+}
@@ -0,0 +1,72 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "InstanceWriter.hpp"
+
+#include <limits>
+
+#include "RateLimiter.hpp"
+
+namespace {
+	// fewer write syscalls for instances received in small PDVs
+	constexpr std::size_t WRITE_BUFFER_SIZE{256 * 1024};
+}
+
+offile_off_t ChecksumConsumer::avail() const {
+	return m_status.good() ? std::numeric_limits<offile_off_t>::max() : 0;
+}
+
+offile_off_t ChecksumConsumer::write(const void *buf, const offile_off_t buflen) {
+	if (m_status.bad() || buflen <= 0)
+		return 0;
+
+	if (m_rateLimiter != nullptr)
+		m_rateLimiter->consume(static_cast<std::size_t>(buflen));
+
+	const std::size_t written = this->store(buf, static_cast<std::size_t>(buflen));
+	m_hash.update(buf, written);
+	if (m_sha256)
+		m_sha256->update(buf, written);
+	m_size += written;
+	if (written != static_cast<std::size_t>(buflen))
+		m_status = EC_WriteError;
+	return static_cast<offile_off_t>(written);
+}
+
+ChecksumFileConsumer::ChecksumFileConsumer(const std::string &path) {
+	m_file = std::fopen(path.c_str(), "wb");
+	if (m_file == nullptr) {
+		m_status = EC_InvalidStream;
+		return;
+	}
+	std::setvbuf(m_file, nullptr, _IOFBF, WRITE_BUFFER_SIZE);
+}
+
+ChecksumFileConsumer::~ChecksumFileConsumer() {
+	(void) this->close();
+}
+
+std::size_t ChecksumFileConsumer::store(const void *buf, const std::size_t length) {
+	return std::fwrite(buf, 1, length, m_file);
+}
+
+void ChecksumFileConsumer::flush() {
+	if (m_file != nullptr && std::fflush(m_file) != 0)
+		m_status = EC_WriteError;
+}
+
+OFCondition ChecksumFileConsumer::close() {
+	if (m_file == nullptr)
+		return m_status;
+
+	if (std::fclose(m_file) != 0 && m_status.good())
+		m_status = EC_WriteError;
+	m_file = nullptr;
+	return m_status;
+}
+
+std::size_t ChecksumBufferConsumer::store(const void *buf, const std::size_t length) {
+	m_data.append(static_cast<const char *>(buf), length);
+	return length;
+}
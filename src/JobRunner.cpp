@@ -0,0 +1,619 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "JobRunner.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <unordered_map>
+
+#include "fmt/chrono.h"
+#include "fmt/os.h"
+#include "fmt/ranges.h"
+
+#include "ContentStore.hpp"
+#include "DateSweep.hpp"
+#include "InstanceIndex.hpp"
+#include "MovePlan.hpp"
+#include "PeerPool.hpp"
+#include "PriorityScheduler.hpp"
+#include "QueryPlanner.hpp"
+#include "QuerySinks.hpp"
+#include "SizeModel.hpp"
+#include "StudyCatalog.hpp"
+#include "Utility.hpp"
+
+void JobReport::status(const std::string &msg, const fmt::color color, const std::string &status) {
+	if (m_colored)
+		fmt::print(m_out, "{} - {}\n", msg, fmt::format(fg(color), "{}", status));
+	else
+		fmt::print(m_out, "{} - {}\n", msg, status);
+}
+
+namespace {
+	void applyModality(const JobOptions &options, std::vector<PatientRecord> &record_list) {
+		for (auto &record : record_list) {
+			// add modality specified on cmd line
+			// reason: some records may have modality specified, some may not
+			if (options.addModalities == E_addModalities::ADD_MODALITIES_ALL) {
+				record.m_modality = options.queryModality;
+			} else {
+				// otherwise add only to records with no modality specified in text file
+				if (record.m_modality.empty())
+					record.m_modality = options.queryModality;
+			}
+		}
+	}
+
+	// record indices by priority, aged so low priority records are not all pushed to the end
+	std::vector<std::size_t> scheduleRecords(const std::vector<PatientRecord> &record_list) {
+		PriorityScheduler<std::size_t> scheduler;
+		for (std::size_t i = 0; i < record_list.size(); ++i)
+			scheduler.push(i, record_list[i].m_priority);
+
+		std::vector<std::size_t> order;
+		order.reserve(record_list.size());
+		while (!scheduler.empty())
+			order.push_back(scheduler.pop());
+		return order;
+	}
+
+	/*
+	 * Re-runs a query whose result hit the PACS limit as date sweep, studies found by the
+	 * sweep are passed to on_study. Queries without closed date range keep the capped result.
+	 */
+	OFCondition sweepCapped(const QueryRetriever &         prototype,
+	                        const JobOptions &             options,
+	                        const PatientRecord &          query,
+	                        const DateSweep::StudyCallback &on_study) {
+		DateRange range;
+		if (!parseDateRange(query.m_study_date, range)) {
+			OFLOG_WARN(qrLogger,
+			           fmt::format("PatientID {}, StudyDate {} hit the result limit, cannot sweep open date range",
+				           query.m_id, query.m_study_date));
+			return EC_Normal;
+		}
+
+		OFLOG_INFO(qrLogger,
+		           fmt::format("PatientID {}, StudyDate {} hit the result limit, sweeping", query.m_id, query.m_study_date));
+		PatientRecord sweepQuery = query;
+		sweepQuery.m_uid_list.clear();
+
+		DateSweep sweep(prototype, options.queryModality, SweepOptions{options.findLimit, options.sweepConcurrency});
+		return sweep.run(sweepQuery, on_study);
+	}
+
+	// studies of all patients within sweep range, one record per PatientID
+	OFCondition sweepRecords(PeerPool &peers, const JobOptions &options, std::vector<PatientRecord> &record_list) {
+		PatientRecord query;
+		query.m_study_date = options.sweepRange;
+
+		std::unordered_map<std::string, std::size_t> patients;
+		DateSweep sweep(peers.primary(), options.queryModality, SweepOptions{options.findLimit, options.sweepConcurrency});
+		return sweep.run(query,
+		                 [&](const StudyInfo &study) {
+			                 peers.noteStudy(study);
+			                 const auto [it, inserted] = patients.try_emplace(study.m_patientId, record_list.size());
+			                 if (inserted) {
+				                 PatientRecord record;
+				                 record.m_id         = study.m_patientId;
+				                 record.m_study_date = options.sweepRange;
+				                 record.m_modality   = options.queryModality;
+				                 record_list.push_back(std::move(record));
+			                 }
+			                 record_list[it->second].m_uid_list.insert(study.m_uid);
+		                 });
+	}
+
+	/*
+	 * One C-FIND per planned query, returned studies are assigned to the originating records
+	 * by StudyDate. Studies without (valid) StudyDate go to every record of the query.
+	 */
+	template<typename ReportFunction>
+	OFCondition findCoalesced(PeerPool &                  peers,
+	                          const JobOptions &          options,
+	                          std::vector<PatientRecord> &record_list,
+	                          ReportFunction &&           report_record) {
+		const std::vector<PlannedQuery> plan = planFindQueries(record_list);
+		OFLOG_INFO(qrLogger, fmt::format("Coalesced {} records into {} queries", record_list.size(), plan.size()));
+
+		PriorityScheduler<std::size_t> scheduler;
+		for (std::size_t i = 0; i < plan.size(); ++i)
+			scheduler.push(i, plan[i].m_query.m_priority);
+
+		OFCondition result = EC_Normal;
+		while (!scheduler.empty()) {
+			const PlannedQuery &   query = plan[scheduler.pop()];
+			std::vector<StudyInfo> studies;
+			OFCondition            cond = peers.findStudies(query.m_query, studies);
+			if (findResultCapped(studies.size(), peers.primary().lastFindStatus(), options.findLimit)) {
+				cond = sweepCapped(peers.primary(), options, query.m_query, [&studies, &peers](const StudyInfo &study) {
+					peers.noteStudy(study);
+					const bool known = std::ranges::any_of(studies,
+					                                       [&study](const StudyInfo &s) { return s.m_uid == study.m_uid; });
+					if (!known)
+						studies.push_back(study);
+				});
+			}
+
+			for (const std::size_t index : query.m_records) {
+				PatientRecord &record = record_list[index];
+				DateRange      range;
+				// single record queries were sent with the record's own date
+				const bool filter = query.m_records.size() > 1 && parseDateRange(record.m_study_date, range);
+
+				for (const auto &study : studies) {
+					std::chrono::sys_days day;
+					if (!filter || !parseDate(study.m_date, day) || range.contains(day))
+						record.m_uid_list.insert(study.m_uid);
+				}
+				report_record(record);
+			}
+			// later queries do not hide a failed one
+			if (cond.bad())
+				result = cond;
+		}
+		return result;
+	}
+
+	// one record per planned study, MovePlan keeps the plan's order within priorities
+	std::vector<PatientRecord> recordsFromPlan(const JobOptions &options) {
+		std::vector<PatientRecord> record_list;
+		record_list.reserve(options.plannedStudies.size());
+		for (const auto &planned : options.plannedStudies) {
+			PatientRecord record;
+			record.m_id         = planned.m_study.m_patientId;
+			record.m_study_date = planned.m_study.m_date;
+			record.m_priority   = planned.m_priority;
+			record.m_uid_list   = {planned.m_study.m_uid};
+			record_list.push_back(std::move(record));
+		}
+		return record_list;
+	}
+
+	// studies in move order with sizes estimated from earlier moves into the output directory
+	int writePlan(const PeerPool &                  peers,
+	              const JobOptions &                options,
+	              const std::vector<PatientRecord> &record_list,
+	              const std::vector<std::size_t> &  order,
+	              JobReport &                       report) {
+		MovePlan movePlan;
+		for (const std::size_t index : order)
+			movePlan.addRecord(record_list[index], index);
+
+		SizeModel sizes;
+		sizes.load(options.outputDirectory);
+
+		std::vector<PlannedStudy> studies;
+		studies.reserve(movePlan.moves().size());
+		for (const std::size_t moveIndex : movePlan.schedule()) {
+			const PlannedMove &  move   = movePlan.moves()[moveIndex];
+			const PatientRecord &record = record_list[move.m_records.front()];
+
+			PlannedStudy planned{peers.studyInfo(move.m_uid), move.m_priority};
+			planned.m_study.m_uid       = move.m_uid;
+			planned.m_study.m_patientId = move.m_patientId;
+			const std::string &modalities = planned.m_study.m_modalities.empty()
+				                                ? record.m_modality
+				                                : planned.m_study.m_modalities;
+			planned.m_estimatedBytes = sizes.estimate(modalities, planned.m_study.m_instances);
+			studies.push_back(std::move(planned));
+		}
+
+		const PlanSummary summary = summarizePlan(studies, sizes.throughput());
+		std::string       error_msg;
+		if (!writeTransferPlan(options.planFile, studies, summary, error_msg)) {
+			report.print("{}\n", error_msg);
+			return EXITCODE_CANNOT_WRITE_OUTPUT_FILE;
+		}
+
+		report.print("C-FIND ---------- PLAN\n");
+		report.print("{} study/ies, {} instance(s), estimated {:.1f} GiB\n", studies.size(), summary.m_instances,
+		             static_cast<double>(summary.m_estimatedBytes) / MIB / 1024);
+		if (summary.m_unknownSize > 0)
+			report.print("{} study/ies without NumberOfStudyRelatedInstances, not estimated\n", summary.m_unknownSize);
+		if (summary.m_throughput > 0)
+			report.print("Projected duration {} at {:.1f} MiB/s measured\n", formatPlanDuration(summary),
+			             summary.m_throughput / MIB);
+		else
+			report.print("Projected duration unknown, no moves into {} measured yet\n", options.outputDirectory);
+		report.print("Plan written to {}\n", options.planFile);
+		report.flush();
+		return 0;
+	}
+
+	// --tag/#tag keys without the default columns and repeated tags
+	std::vector<std::pair<std::string, DcmTagKey>> dumpColumns(const JobOptions &options) {
+		std::vector<std::pair<std::string, DcmTagKey>> columns;
+		for (const auto &[name, key] : options.queryTags) {
+			const bool repeated = std::ranges::any_of(columns, [&key](const auto &column) { return column.second == key; });
+			if (repeated || key == DCM_PatientID || key == DCM_StudyInstanceUID || key == DCM_SeriesDescription) {
+				OFLOG_WARN(qrLogger, fmt::format("Ignoring tag {}; already dumped", name));
+				continue;
+			}
+			columns.emplace_back(name, key);
+		}
+		return columns;
+	}
+
+	std::string dumpHeader(const std::vector<std::pair<std::string, DcmTagKey>> &columns) {
+		std::string header{"PatientID;StudyInstanceUID;SeriesDescription"};
+		for (const auto &[name, key] : columns) {
+			header += ";";
+			header += name;
+		}
+		return header;
+	}
+}
+
+int runJob(PeerPool &                  peers,
+           const JobOptions &          options,
+           std::vector<PatientRecord> &record_list,
+           JobReport &                 report) {
+	const bool planned = !options.plannedStudies.empty();
+	if (planned)
+		record_list = recordsFromPlan(options);
+	applyModality(options, record_list);
+	std::vector<std::size_t> order = scheduleRecords(record_list);
+
+	const auto    time = std::chrono::system_clock::now();
+	const auto    tt   = std::chrono::system_clock::to_time_t(time);
+	const std::tm tm   = *std::localtime(&tt);
+
+	if (options.retrieveTags) {
+		OFLOG_INFO(qrLogger, "QueryRetriever set up for dumping tags");
+	}
+
+	if (options.retrieveFiles) {
+		OFLOG_INFO(qrLogger, "QueryRetriever set up for storing files");
+	}
+
+	// third party destinations store elsewhere and archives carry their own index, nothing to index
+	const bool    archived = options.outputLayout.m_archive != ArchiveFormat::NONE;
+	const bool    indexed  = peers.primary().m_receiverAETitle.empty() && !archived;
+	InstanceIndex instanceIndex;
+	StudyCatalog  catalog;
+	std::string   indexError;
+	bool          indexOpened{false};
+	bool          catalogOpened{false};
+	if (indexed && (options.retrieveFiles || options.skipPresent)) {
+		indexOpened   = instanceIndex.open(options.outputDirectory, indexError);
+		catalogOpened = indexOpened && catalog.open(options.outputDirectory, indexError);
+		if (indexOpened && !catalogOpened)
+			report.print("{}\n", indexError);
+	}
+	const bool precheck = options.skipPresent && catalogOpened;
+
+	// records answered completely by earlier runs are set aside, find runs for the rest
+	std::vector<PatientRecord> presentRecords;
+	if (precheck && !record_list.empty()) {
+		std::vector<PatientRecord> queried;
+		for (auto &record : record_list) {
+			std::set<std::string> uids;
+			if (catalog.satisfied(record, instanceIndex, uids)) {
+				record.m_uid_list = std::move(uids);
+				presentRecords.push_back(std::move(record));
+			} else {
+				queried.push_back(std::move(record));
+			}
+		}
+		record_list = std::move(queried);
+		order       = scheduleRecords(record_list);
+		report.print("{} of {} record(s) present in {}, not queried\n", presentRecords.size(),
+		             presentRecords.size() + record_list.size(), options.outputDirectory);
+	}
+
+	report.print("C-FIND ---------- FIND STUDIES\n");
+	OFCondition cond = peers.prepareFindIdentifiers(options.queryModality);
+	if (cond.bad())
+		return EXITCODE_CANNOT_CREATE_QUERY_IDENTIFIERS;
+
+	std::vector<std::string> missingStudies;
+	bool                     findFailed{false};
+	auto reportFind = [&](const PatientRecord &record) {
+		const std::string msg = fmt::format("PatientID: {}, StudyDate: {}", record.m_id, record.m_study_date);
+
+		if (record.m_uid_list.empty()) {
+			report.status(msg, fmt::color::red, "FAIL, STUDY NOT FOUND");
+			missingStudies.push_back(fmt::format("{}, {} - NOT FOUND\n", record.m_id, record.m_study_date));
+		} else {
+			report.status(msg, fmt::color::green, fmt::format("SUCCESS, {} study/ies", record.m_uid_list.size()));
+			if (options.logMissingStudies) {
+				report.print("StudyInstanceUIDs: \n{}\n", record.m_uid_list);
+			}
+		}
+	};
+
+	if (planned) {
+		// sizes for admission control come from the plan instead of find results
+		for (const auto &study : options.plannedStudies)
+			peers.noteStudy(study.m_study);
+		report.print("Executing plan, {} study/ies, find skipped\n", options.plannedStudies.size());
+	} else if (!options.sweepRange.empty()) {
+		cond       = sweepRecords(peers, options, record_list);
+		findFailed = cond.bad();
+		order      = scheduleRecords(record_list);
+		for (const std::size_t index : order)
+			reportFind(record_list[index]);
+		if (record_list.empty())
+			report.status(fmt::format("StudyDate: {}", options.sweepRange), fmt::color::red, "FAIL, NO STUDIES FOUND");
+	} else if (options.coalesceQueries) {
+		cond       = findCoalesced(peers, options, record_list, reportFind);
+		findFailed = cond.bad();
+	} else {
+		for (const std::size_t index : order) {
+			PatientRecord &record = record_list[index];
+			cond                  = peers.performFindRequest(record);
+			if (findResultCapped(record.m_uid_list.size(), peers.primary().lastFindStatus(), options.findLimit)) {
+				cond = sweepCapped(peers.primary(), options, record, [&record, &peers](const StudyInfo &study) {
+					peers.noteStudy(study);
+					record.m_uid_list.insert(study.m_uid);
+				});
+			}
+			findFailed = findFailed || cond.bad();
+			reportFind(record);
+		}
+	}
+
+	for (auto &record : presentRecords) {
+		report.status(fmt::format("PatientID: {}, StudyDate: {}", record.m_id, record.m_study_date), fmt::color::green,
+		              fmt::format("PRESENT, {} study/ies", record.m_uid_list.size()));
+		record_list.push_back(std::move(record));
+	}
+	if (!presentRecords.empty())
+		order = scheduleRecords(record_list);
+	report.flush();
+
+	if (options.logMissingStudies && !planned) {
+		const std::filesystem::path missingStudiesFilename =
+			std::filesystem::path(options.missingStudiesDirectory) /
+			fmt::format("missing-studies-{:%Y-%m-%d-%H-%M-%S}.txt", tm);
+
+		fmt::ostream missingStudiesFile = fmt::output_file(missingStudiesFilename.string());
+		missingStudiesFile.print("{:%Y-%m-%d %H:%M:%S}\n", tm);
+		missingStudiesFile.print("PatientID, StudyDate\n");
+		for (const auto &line : missingStudies)
+			missingStudiesFile.print("{}", line);
+		missingStudiesFile.close();
+
+		report.print("Records of missing studies written to {}\n", missingStudiesFilename.string());
+	}
+
+	if (!options.planFile.empty())
+		return writePlan(peers, options, record_list, order, report);
+
+	if (options.retrieveTags) {
+		report.print("C-FIND ---------- DUMP TAGS\n");
+
+		if (options.queryTags.empty()) {
+			report.print("no additional tags to query for, writing only defaults: "
+			             "PatientID, StudyInstanceUID, SeriesDescription\n");
+		}
+
+		const auto        columns = dumpColumns(options);
+		const std::string header  = dumpHeader(columns);
+		const std::string dumpFilePath =
+			fmt::format("{}-{:%Y-%m-%d-%H-%M-%S}.{}",
+			            options.dumpFilepath,
+			            tm,
+			            options.dumpFormat == E_dumpFormat::DUMP_FORMAT_JSON ? "jsonl" : "csv");
+		if (options.dumpFormat == E_dumpFormat::DUMP_FORMAT_CSV) {
+			fmt::ostream fileStream = fmt::output_file(dumpFilePath,
+			                                           fmt::file::CREATE | fmt::file::WRONLY | fmt::file::APPEND);
+			fileStream.print("{}\n", header);
+			fileStream.close();
+		}
+
+		// values are overwritten by each response
+		std::vector<TagValuePair> queryTags;
+		std::vector<DcmTagKey>    queryTagKeys;
+		for (const auto &[name, key] : columns) {
+			queryTags.emplace_back(key, "");
+			queryTagKeys.push_back(key);
+		}
+
+		cond = peers.prepareDumpIdentifiers(queryTags);
+		if (cond.bad())
+			return EXITCODE_CANNOT_CREATE_QUERY_IDENTIFIERS;
+
+		// studies matched by several records are dumped once
+		std::set<std::string> dumpedStudies;
+		auto dumpRecords = [&](auto &sink) {
+			for (const std::size_t index : order) {
+				PatientRecord record = record_list[index];
+				std::erase_if(record.m_uid_list, [&](const std::string &uid) { return dumpedStudies.contains(uid); });
+				if (record.m_uid_list.empty()) {
+					OFLOG_DEBUG(qrLogger,
+					            fmt::format("not querying tags for \"{}\", no new study instance uids", record.m_id));
+					continue;
+				}
+
+				dumpedStudies.insert(record.m_uid_list.begin(), record.m_uid_list.end());
+				cond = peers.dumpTags(record, sink);
+			}
+		};
+
+		if (options.dumpFormat == E_dumpFormat::DUMP_FORMAT_JSON) {
+			JsonTagSink sink(dumpFilePath, queryTagKeys);
+			dumpRecords(sink);
+		} else {
+			CsvTagSink sink(dumpFilePath, queryTagKeys);
+			dumpRecords(sink);
+		}
+		report.print("Writing tags: {}\n", header);
+		report.print("Tags written to: {}\n", dumpFilePath);
+		report.flush();
+	}
+
+	if (options.retrieveFiles) {
+		report.print("C-MOVE ---------- MOVE STUDIES\n");
+
+		// archives carry their own index, instances cannot be linked or checked individually
+		if (archived && (options.incremental || !options.storeDirectory.empty())) {
+			report.print("Study archives cannot be combined with incremental moves or content store\n");
+			return EXITCODE_COMMANDLINE_SYNTAX_ERROR;
+		}
+
+		if (indexed) {
+			if (indexOpened) {
+				peers.setInstanceIndex(&instanceIndex, options.incremental);
+				if (options.incremental)
+					report.print("Incremental move, {} instance(s) indexed\n", instanceIndex.size());
+			} else {
+				report.print("{}\n", indexError);
+				if (options.incremental)
+					return EXITCODE_CANNOT_WRITE_OUTPUT_FILE;
+			}
+		}
+
+		ContentStore contentStore;
+		if (!options.storeDirectory.empty() && peers.primary().m_receiverAETitle.empty()) {
+			std::string error_msg;
+			if (!contentStore.open(options.storeDirectory, error_msg)) {
+				report.print("{}\n", error_msg);
+				peers.setInstanceIndex(nullptr, false);
+				return EXITCODE_CANNOT_WRITE_OUTPUT_FILE;
+			}
+			peers.setContentStore(&contentStore);
+			report.print("Content store {}, {} instance(s) stored\n", options.storeDirectory,
+			             contentStore.index().size());
+		}
+
+		// one global plan, studies matched by several records are moved once
+		MovePlan movePlan;
+		for (const std::size_t index : order) {
+			const PatientRecord &record = record_list[index];
+			if (record.m_uid_list.empty()) {
+				const std::string msg = fmt::format("PatientID: {}, StudyDate: {}", record.m_id, record.m_study_date);
+				report.status(msg, fmt::color::red, "FAIL, MISSING StudyInstanceUID");
+				continue;
+			}
+			movePlan.addRecord(record, index);
+		}
+
+		if (movePlan.duplicates() > 0) {
+			report.print("Skipping {} duplicate study reference(s), {} unique study/ies to move\n",
+			             movePlan.duplicates(),
+			             movePlan.moves().size());
+		}
+
+		if (!contentStore.directory().empty()) {
+			const auto stored = std::ranges::count_if(movePlan.moves(),
+			                                          [&contentStore](const PlannedMove &move) {
+				                                          return !contentStore.index().instances(move.m_uid).empty();
+			                                          });
+			report.print("{} study/ies with instances in content store, stored instances are linked\n", stored);
+		}
+
+		// all study directories at once, moves only touch the filesystem for received instances
+		bool directoriesPrepared{false};
+		if (peers.primary().m_receiverAETitle.empty()) {
+			std::vector<std::string> studyUids;
+			studyUids.reserve(movePlan.moves().size());
+			for (const auto &move : movePlan.moves())
+				studyUids.push_back(move.m_uid);
+
+			std::size_t existing{0};
+			std::string error_msg;
+			directoriesPrepared = prepareStudyDirectories(options.outputDirectory, studyUids, options.outputLayout,
+			                                              existing, error_msg);
+			if (!directoriesPrepared)
+				report.print("{}\n", error_msg);
+			else if (existing > 0)
+				report.status(fmt::format("{} study directory/ies exist", existing), fmt::color::yellow,
+				              options.incremental || !options.storeDirectory.empty() ? "UPDATING" : "OVERWRITING");
+		}
+		peers.setOutputDirectory(options.outputDirectory, options.outputLayout, directoriesPrepared);
+		peers.setSha256(options.sha256);
+		peers.setWriteBackend(options.writeBackend);
+
+		// sizes and throughput of local moves feed later plans and admission estimates
+		SizeModel sizes;
+		const bool learnSizes = peers.primary().m_receiverAETitle.empty() && !archived;
+		if (learnSizes)
+			sizes.load(options.outputDirectory);
+		std::uint64_t movedBytes{0};
+		const auto    movesStarted = std::chrono::steady_clock::now();
+
+		cond = EC_Normal;
+		std::vector<std::size_t> movedStudies(record_list.size(), 0);
+		for (const std::size_t moveIndex : movePlan.schedule()) {
+			const PlannedMove &move = movePlan.moves()[moveIndex];
+
+			const std::string msg = fmt::format("PatientID: {}, StudyUID: {}, records: {}",
+			                                    move.m_patientId,
+			                                    move.m_uid,
+			                                    move.m_records.size());
+			if (precheck && catalog.complete(move.m_uid, instanceIndex)) {
+				report.status(msg, fmt::color::green, "PRESENT");
+				for (const std::size_t index : move.m_records)
+					++movedStudies[index];
+				continue;
+			}
+
+			PatientRecord study = record_list[move.m_records.front()];
+			study.m_uid_list    = {move.m_uid};
+			study.m_priority    = move.m_priority;
+
+			// performMoveRequest is good for any final response, the move status tells whether the study arrived
+			const OFCondition moveCond   = peers.performMoveRequest(study);
+			const DIC_US      moveStatus = peers.lastMoveStatus();
+			movedBytes += peers.lastMoveBytes();
+			if (moveCond.good() && moveStatus == STATUS_Success) {
+				report.status(msg, fmt::color::green, "MOVED");
+				for (const std::size_t index : move.m_records)
+					++movedStudies[index];
+				const StudyInfo info = peers.studyInfo(move.m_uid);
+				sizes.record(info.m_modalities.empty() ? study.m_modality : info.m_modalities, peers.lastMoveStored(),
+				             peers.lastMoveBytes());
+				// instances the PACS reported or received, whichever is more, must be present to skip it later
+				if (catalogOpened) {
+					const std::size_t present = instanceIndex.entries(move.m_uid).size();
+					catalog.addStudy(move.m_uid, std::max(info.m_instances, static_cast<unsigned int>(present)));
+				}
+			} else if (moveCond.good() && DICOM_WARNING_STATUS(moveStatus)) {
+				report.status(msg, fmt::color::yellow, fmt::format("WARNING, {}", DU_cmoveStatusString(moveStatus)));
+			} else if (moveCond.good()) {
+				const std::string status = DU_cmoveStatusString(moveStatus);
+				report.status(msg, fmt::color::red, fmt::format("FAIL, {}", status));
+				cond = makeDcmnetCondition(DIMSEC_UNEXPECTEDRESPONSE, OF_error, fmt::format("C-MOVE {}", status).c_str());
+			} else {
+				report.status(msg, fmt::color::red, fmt::format("FAIL, {}", moveCond.text()));
+				cond = moveCond;
+			}
+			report.flush();
+		}
+
+		if (learnSizes) {
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - movesStarted;
+			sizes.recordTransfer(movedBytes, elapsed.count());
+			std::string error_msg;
+			if (!sizes.save(error_msg))
+				OFLOG_WARN(qrLogger, error_msg);
+		}
+
+		for (const std::size_t index : order) {
+			const PatientRecord &record = record_list[index];
+			if (record.m_uid_list.empty())
+				continue;
+
+			const std::string msg      = fmt::format("PatientID: {}, StudyDate: {}", record.m_id, record.m_study_date);
+			const bool        complete = movedStudies[index] == record.m_uid_list.size();
+			// records of failed finds may lack studies
+			if (complete && catalogOpened && !findFailed)
+				catalog.addRecord(record);
+			report.status(msg,
+			              complete ? fmt::color::green : fmt::color::red,
+			              fmt::format("{}, {}/{} study/ies", complete ? "MOVED" : "INCOMPLETE", movedStudies[index],
+			                          record.m_uid_list.size()));
+		}
+		report.flush();
+		peers.setInstanceIndex(nullptr, false);
+		peers.setContentStore(nullptr);
+	}
+
+	return cond.good() ? 0 : 2;
+}
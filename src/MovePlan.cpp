@@ -0,0 +1,42 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "MovePlan.hpp"
+
+#include <algorithm>
+
+#include "PriorityScheduler.hpp"
+
+void MovePlan::addRecord(const PatientRecord &record, const std::size_t record_index) {
+	for (const auto &uid : record.m_uid_list)
+		this->addStudy(uid, record, record_index);
+}
+
+bool MovePlan::addStudy(const std::string &uid, const PatientRecord &record, const std::size_t record_index) {
+	const auto [it, inserted] = m_index.try_emplace(uid, m_moves.size());
+	if (inserted) {
+		m_moves.push_back(PlannedMove{uid, record.m_id, record.m_priority, {record_index}});
+		return true;
+	}
+
+	PlannedMove &move = m_moves[it->second];
+	move.m_priority   = std::max(move.m_priority, record.m_priority);
+	if (std::ranges::find(move.m_records, record_index) == move.m_records.end()) {
+		move.m_records.push_back(record_index);
+		++m_duplicates;
+	}
+	return false;
+}
+
+std::vector<std::size_t> MovePlan::schedule() const {
+	PriorityScheduler<std::size_t> scheduler;
+	for (std::size_t i = 0; i < m_moves.size(); ++i)
+		scheduler.push(i, m_moves[i].m_priority);
+
+	std::vector<std::size_t> order;
+	order.reserve(m_moves.size());
+	while (!scheduler.empty())
+		order.push_back(scheduler.pop());
+	return order;
+}
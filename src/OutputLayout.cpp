@@ -0,0 +1,99 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "OutputLayout.hpp"
+
+#include <set>
+#include <system_error>
+
+#include "fmt/format.h"
+
+#include "Checksum.hpp"
+
+bool parseOutputLayout(const std::string_view value, OutputLayout &layout) {
+	if (value != "flat" && value != "sharded" && value != "series" && value != "sharded-series")
+		return false;
+
+	layout.m_sharded   = value.starts_with("sharded");
+	layout.m_perSeries = value.ends_with("series");
+	return true;
+}
+
+bool parseArchiveFormat(const std::string_view value, ArchiveFormat &format) {
+	if (value == "none")
+		format = ArchiveFormat::NONE;
+	else if (value == "tar")
+		format = ArchiveFormat::TAR;
+#ifdef FNOSTUDYQR_WITH_ZSTD
+	else if (value == "tar.zst")
+		format = ArchiveFormat::TAR_ZSTD;
+#endif
+	else
+		return false;
+	return true;
+}
+
+const char *archiveExtension(const ArchiveFormat format) {
+	return format == ArchiveFormat::TAR_ZSTD ? ".tar.zst" : ".tar";
+}
+
+std::filesystem::path studyDirectoryPath(const std::filesystem::path &output_directory,
+                                         const std::string &          study_uid,
+                                         const OutputLayout &         layout) {
+	if (!layout.m_sharded)
+		return output_directory / study_uid;
+
+	// UIDs share long root prefixes, their hash spreads studies evenly
+	XxHash64 hash;
+	hash.update(study_uid.data(), study_uid.size());
+	const std::string shard = formatChecksum(hash.digest());
+	return output_directory / shard.substr(0, 2) / shard.substr(2, 2) / study_uid;
+}
+
+std::filesystem::path instanceDirectoryPath(const std::filesystem::path &study_directory,
+                                            const std::string &          series_uid,
+                                            const OutputLayout &         layout) {
+	if (!layout.m_perSeries || series_uid.empty())
+		return study_directory;
+	return study_directory / series_uid;
+}
+
+bool prepareStudyDirectories(const std::filesystem::path &   output_directory,
+                             const std::vector<std::string> &study_uids,
+                             const OutputLayout &            layout,
+                             std::size_t &                   existing,
+                             std::string &                   error_msg) {
+	existing = 0;
+
+	std::set<std::filesystem::path> studies;
+	for (const auto &uid : study_uids)
+		studies.insert(studyDirectoryPath(output_directory, uid, layout));
+
+	std::set<std::filesystem::path> parents;
+	for (const auto &study : studies)
+		parents.insert(study.parent_path());
+
+	std::error_code ec;
+	for (const auto &parent : parents) {
+		std::filesystem::create_directories(parent, ec);
+		if (ec) {
+			error_msg = fmt::format("Cannot create directory {}: {}", parent.string(), ec.message());
+			return false;
+		}
+	}
+
+	if (layout.m_archive != ArchiveFormat::NONE)
+		return true;
+
+	// parent exists, one mkdir per study tells existing ones apart without extra stat
+	for (const auto &study : studies) {
+		if (!std::filesystem::create_directory(study, ec) && !ec)
+			++existing;
+		if (ec) {
+			error_msg = fmt::format("Cannot create study directory {}: {}", study.string(), ec.message());
+			return false;
+		}
+	}
+	return true;
+}
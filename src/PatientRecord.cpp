@@ -11,13 +11,21 @@
 #include "fmt/color.h"
 #include "fmt/format.h"
 
-auto splitString = [](std::string_view line, const char delimiter = ';',
+static std::string nameToDcmFormat(std::string_view fullname);
+
+static std::string dateToDcmFormat(std::string_view            date,
+                                   const studyDateRangeExtend &study_date_range);
+
+static std::string idToDcmFormat(std::string_view id);
+
+static auto splitString = [](std::string_view line, const char delimiter = ';',
                       const std::size_t parts = 3) {
 	std::vector<std::string> tokens(parts, "");
 
 	std::size_t start{0}, end;
-	int i{0};
-	while ((end = line.find(delimiter, start)) != std::string::npos) {
+	std::size_t i{0};
+	// extra delimiters end up in last token
+	while (i + 1 < parts && (end = line.find(delimiter, start)) != std::string::npos) {
 		tokens[i] = line.substr(start, end - start);
 		start = end + 1;
 		++i;
@@ -26,7 +34,7 @@ auto splitString = [](std::string_view line, const char delimiter = ';',
 	return tokens;
 };
 
-auto checkRecord = [](const PatientRecord &record) {
+static auto checkRecord = [](const PatientRecord &record) {
 	bool checkFailed{false};
 	std::string msg;
 
@@ -77,11 +85,12 @@ readPatientRecords(const std::string &textFilePath,
 	if (fileObject.is_open()) {
 		std::string line;
 		while (std::getline(fileObject, line)) {
-      if (line.empty())
+      // '#' lines carry job options in service mode
+      if (line.empty() || line.front() == '#')
         continue;
 
       auto tokens =
-          splitString(line, ';', 3); // tokens[name, id, study_date, modality]
+          splitString(line, ';', 4); // tokens[id, study_date, modality, priority]
 
 			PatientRecord record{};
 			// record.m_name       = nameToDcmFormat(tokens[0]);
@@ -92,6 +101,12 @@ readPatientRecords(const std::string &textFilePath,
 				record.m_modality = tokens[2];
 			}
 
+			if (!tokens[3].empty() && !parseRecordPriority(tokens[3], record.m_priority)) {
+        fmt::print("PatientID {}: unknown priority \"{}\" - {}\n", record.m_id,
+                   tokens[3],
+                   fmt::format(fg(fmt::color::yellow), "USING MEDIUM"));
+			}
+
 			// sanity check record for invalid characters
 			if (checkRecord(record))
 				continue;
@@ -163,6 +178,22 @@ std::string dateToDcmFormat(std::string_view date,
 	return fmt::format("{}{:02}{:02}", year, month, day);
 }
 
+bool parseRecordPriority(std::string_view value, RecordPriority &priority) {
+	std::string lower{value};
+	std::erase_if(lower, ::isspace);
+	std::ranges::transform(lower, lower.begin(), ::tolower);
+
+	if (lower == "high" || lower == "urgent")
+		priority = RecordPriority::HIGH;
+	else if (lower == "medium")
+		priority = RecordPriority::MEDIUM;
+	else if (lower == "low")
+		priority = RecordPriority::LOW;
+	else
+		return false;
+	return true;
+}
+
 std::string idToDcmFormat(std::string_view id) {
 	std::string mod_id{id};
 
@@ -0,0 +1,399 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "PeerPool.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <future>
+
+bool parsePeerAddress(const std::string_view value, PeerAddress &address) {
+	const std::size_t portPos = value.find(':');
+	if (portPos == std::string_view::npos || portPos == 0)
+		return false;
+
+	const std::size_t      aetPos = value.find(':', portPos + 1);
+	const std::string_view port   = value.substr(portPos + 1, aetPos == std::string_view::npos
+		                                                          ? std::string_view::npos
+		                                                          : aetPos - portPos - 1);
+	unsigned int portNumber{0};
+	if (std::from_chars(port.data(), port.data() + port.size(), portNumber).ec != std::errc{} ||
+	    portNumber == 0 || portNumber > 65535)
+		return false;
+
+	address.m_host = value.substr(0, portPos);
+	address.m_port = static_cast<unsigned short>(portNumber);
+	address.m_aeTitle.clear();
+	if (aetPos != std::string_view::npos) {
+		address.m_aeTitle = value.substr(aetPos + 1);
+		if (address.m_aeTitle.empty() || address.m_aeTitle.size() > 16)
+			return false;
+	}
+	return true;
+}
+
+PeerStatistics::Entry &PeerStatistics::entry(const std::size_t peer) {
+	if (m_entries.size() <= peer)
+		m_entries.resize(peer + 1);
+	return m_entries[peer];
+}
+
+void PeerStatistics::moveStarted(const std::size_t peer) {
+	std::lock_guard lock(m_mutex);
+	++entry(peer).m_activeMoves;
+}
+
+void PeerStatistics::moveFinished(const std::size_t  peer,
+                                  const bool         success,
+                                  const unsigned int instances,
+                                  const double       seconds) {
+	constexpr double SMOOTHING{0.3};
+
+	std::lock_guard lock(m_mutex);
+	Entry &         e = entry(peer);
+	if (e.m_activeMoves > 0)
+		--e.m_activeMoves;
+
+	if (!success) {
+		++e.m_consecutiveFailures;
+		return;
+	}
+	e.m_consecutiveFailures = 0;
+
+	// studies without instances say nothing about throughput
+	if (instances == 0 || seconds <= 0.0)
+		return;
+
+	const double sample = instances / seconds;
+	e.m_throughput      = e.m_measured ? SMOOTHING * sample + (1.0 - SMOOTHING) * e.m_throughput : sample;
+	e.m_measured        = true;
+}
+
+std::vector<std::size_t> PeerStatistics::rank(const std::vector<std::size_t> &candidates) {
+	std::lock_guard lock(m_mutex);
+
+	// unmeasured peers are assumed average so each gets tried eventually
+	double      measuredSum{0.0};
+	std::size_t measuredCount{0};
+	for (const std::size_t peer : candidates) {
+		if (entry(peer).m_measured) {
+			measuredSum += entry(peer).m_throughput;
+			++measuredCount;
+		}
+	}
+	const double average = measuredCount ? measuredSum / measuredCount : 1.0;
+
+	auto score = [&](const std::size_t peer) {
+		const Entry &e = entry(peer);
+		return (e.m_measured ? e.m_throughput : average) / (1.0 + e.m_activeMoves);
+	};
+
+	std::vector<std::size_t> ranked = candidates;
+	std::ranges::stable_sort(ranked,
+	                         [&](const std::size_t a, const std::size_t b) {
+		                         if (entry(a).m_consecutiveFailures != entry(b).m_consecutiveFailures)
+			                         return entry(a).m_consecutiveFailures < entry(b).m_consecutiveFailures;
+		                         return score(a) > score(b);
+	                         });
+	return ranked;
+}
+
+PeerPool::PeerPool(const QueryRetriever &           prototype,
+                   const std::vector<PeerAddress> &extra_peers,
+                   std::mutex *                     move_mutex,
+                   PeerStatistics &                 statistics)
+	: m_statistics(statistics) {
+	auto addPeer = [&](const PeerAddress *address) {
+		auto retriever = std::make_unique<QueryRetriever>();
+		retriever->copySettings(prototype);
+		if (address != nullptr) {
+			retriever->m_calledIP = address->m_host;
+			retriever->m_port     = address->m_port;
+			if (!address->m_aeTitle.empty())
+				retriever->m_calledAETitle = address->m_aeTitle;
+		}
+		retriever->attachNetwork(prototype.network(), move_mutex);
+		m_peers.push_back(std::move(retriever));
+	};
+
+	addPeer(nullptr);
+	for (const auto &address : extra_peers)
+		addPeer(&address);
+	m_available.assign(m_peers.size(), false);
+}
+
+OFCondition PeerPool::ensureAssociations() {
+	OFCondition result = EC_Normal;
+	bool        anyAvailable{false};
+	for (std::size_t i = 0; i < m_peers.size(); ++i) {
+		const OFCondition cond = m_peers[i]->ensureAssociation();
+		m_available[i]         = cond.good();
+		if (cond.good()) {
+			anyAvailable = true;
+		} else {
+			OFLOG_WARN(qrLogger,
+			           fmt::format("Peer {}:{} unavailable: {}", m_peers[i]->m_calledIP, m_peers[i]->m_port,
+				           cond.text()));
+			result = cond;
+		}
+	}
+	return anyAvailable ? EC_Normal : result;
+}
+
+void PeerPool::releaseAssociations() {
+	for (const auto &peer : m_peers)
+		(void) peer->releaseAssociation();
+}
+
+OFCondition PeerPool::prepareFindIdentifiers(const std::string &modalities) {
+	m_studySources.clear();
+	m_studyInfos.clear();
+	OFCondition cond = EC_Normal;
+	for (const auto &peer : m_peers) {
+		cond = peer->prepareFindIdentifiers(modalities);
+		if (cond.bad())
+			break;
+	}
+	return cond;
+}
+
+OFCondition PeerPool::prepareDumpIdentifiers(const std::vector<TagValuePair> &query_tags) {
+	OFCondition cond = EC_Normal;
+	for (const auto &peer : m_peers) {
+		cond = peer->prepareDumpIdentifiers(query_tags);
+		if (cond.bad())
+			break;
+	}
+	return cond;
+}
+
+void PeerPool::setOutputDirectory(const std::string & output_directory,
+                                  const OutputLayout &layout,
+                                  const bool          directories_prepared) {
+	for (const auto &peer : m_peers) {
+		peer->m_outputDirectory = output_directory;
+		peer->m_outputLayout    = layout;
+		peer->setDirectoriesPrepared(directories_prepared);
+	}
+}
+
+void PeerPool::setInstanceIndex(InstanceIndex *index, const bool incremental) {
+	for (const auto &peer : m_peers)
+		peer->setInstanceIndex(index, incremental);
+}
+
+void PeerPool::setContentStore(ContentStore *store) {
+	for (const auto &peer : m_peers)
+		peer->setContentStore(store);
+}
+
+void PeerPool::setSha256(const bool sha256) {
+	for (const auto &peer : m_peers)
+		peer->setSha256(sha256);
+}
+
+void PeerPool::setWriteBackend(const WriteBackend backend) {
+	for (const auto &peer : m_peers)
+		peer->setWriteBackend(backend);
+}
+
+void PeerPool::setRateLimiter(RateLimiter *limiter) {
+	m_rateLimiter = limiter;
+	for (const auto &peer : m_peers)
+		peer->setRateLimiter(limiter);
+}
+
+int PeerPool::moveExitCode() const {
+	int exitCode = EXITCODE_NO_ERROR;
+	for (const auto &peer : m_peers)
+		exitCode = std::max(exitCode, peer->moveExitCode());
+	return exitCode;
+}
+
+void PeerPool::setSessionCapture(SessionCapture *capture) {
+	for (const auto &peer : m_peers)
+		peer->setSessionCapture(capture);
+}
+
+OFCondition PeerPool::performFindRequest(PatientRecord &patient_record) {
+	std::vector<StudyInfo> studies;
+	const OFCondition      cond = this->findStudies(patient_record, studies);
+	for (const auto &study : studies)
+		patient_record.m_uid_list.insert(study.m_uid);
+	return cond;
+}
+
+OFCondition PeerPool::findStudies(const PatientRecord &patient_record, std::vector<StudyInfo> &studies) {
+	auto addSource = [this](const StudyInfo &study, const std::size_t peer) {
+		auto &peers = m_studySources[study.m_uid];
+		if (std::ranges::find(peers, peer) == peers.end())
+			peers.push_back(peer);
+		this->noteStudy(study);
+	};
+
+	if (m_peers.size() == 1) {
+		const std::size_t first = studies.size();
+		const OFCondition cond  = primary().findStudies(patient_record, studies);
+		for (std::size_t i = first; i < studies.size(); ++i)
+			addSource(studies[i], 0);
+		return cond;
+	}
+
+	// every peer fills its own list, associations are independent
+	std::vector<std::vector<StudyInfo>>   results(m_peers.size());
+	std::vector<std::future<OFCondition>> pending(m_peers.size());
+	for (std::size_t i = 0; i < m_peers.size(); ++i) {
+		if (!m_available[i])
+			continue;
+		pending[i] = std::async(std::launch::async,
+		                        [this, i, &patient_record, &results] {
+			                        return m_peers[i]->findStudies(patient_record, results[i]);
+		                        });
+	}
+
+	OFCondition result = DIMSE_NODATAAVAILABLE;
+	for (std::size_t i = 0; i < m_peers.size(); ++i) {
+		if (!pending[i].valid())
+			continue;
+
+		const OFCondition cond = pending[i].get();
+		if (cond.bad()) {
+			// association is renegotiated before next job
+			m_available[i] = false;
+			if (result.bad())
+				result = cond;
+			continue;
+		}
+		result = EC_Normal;
+
+		for (auto &study : results[i]) {
+			addSource(study, i);
+			const bool known = std::ranges::any_of(studies,
+			                                       [&study](const StudyInfo &s) { return s.m_uid == study.m_uid; });
+			if (!known)
+				studies.push_back(std::move(study));
+		}
+	}
+	return result;
+}
+
+std::vector<std::size_t> PeerPool::sources(const std::string &uid) const {
+	const auto it = m_studySources.find(uid);
+	if (it == m_studySources.end())
+		return {};
+	return it->second;
+}
+
+void PeerPool::noteStudy(const StudyInfo &study) {
+	const auto [it, inserted] = m_studyInfos.try_emplace(study.m_uid, study);
+	if (inserted)
+		return;
+
+	// peers may disagree, larger counts are kept
+	StudyInfo &known  = it->second;
+	known.m_series    = std::max(known.m_series, study.m_series);
+	known.m_instances = std::max(known.m_instances, study.m_instances);
+	if (known.m_modalities.empty())
+		known.m_modalities = study.m_modalities;
+}
+
+StudyInfo PeerPool::studyInfo(const std::string &uid) const {
+	const auto it = m_studyInfos.find(uid);
+	return it != m_studyInfos.end() ? it->second : StudyInfo{};
+}
+
+OFCondition PeerPool::performMoveRequest(const PatientRecord &patient_record) {
+	const bool admitted = m_admission != nullptr && m_admission->enabled() && primary().m_receiverAETitle.empty();
+	const bool shaped   = m_rateLimiter != nullptr && m_rateLimiter->enabled();
+	if (!admitted && !shaped && m_peers.size() == 1) {
+		const OFCondition cond = primary().performMoveRequest(patient_record);
+		m_lastMove             = primary().lastMove();
+		return cond;
+	}
+
+	// first failure is reported, later studies are still moved
+	OFCondition cond = EC_Normal;
+	for (const auto &uid : patient_record.m_uid_list) {
+		// third party destinations cannot be shaped, only dispatch follows the schedule
+		if (shaped && !m_rateLimiter->waitForDispatch())
+			return EC_IllegalCall;
+		if (!admitted) {
+			const OFCondition moved = this->moveOne(patient_record, uid);
+			if (cond.good())
+				cond = moved;
+			continue;
+		}
+
+		const StudyInfo     study      = this->studyInfo(uid);
+		const std::string & modalities = study.m_modalities.empty() ? patient_record.m_modality : study.m_modalities;
+		const std::uint64_t estimate   = m_admission->estimate(primary().m_outputDirectory, modalities,
+		                                                       study.m_instances);
+		if (!m_admission->admit(primary().m_outputDirectory, estimate))
+			return EC_IllegalCall;
+
+		const OFCondition moved = this->moveOne(patient_record, uid);
+		if (cond.good())
+			cond = moved;
+
+		m_admission->release(estimate);
+		if (moved.good())
+			m_admission->record(modalities, m_lastMove.m_stored, m_lastMove.m_bytes);
+	}
+	return cond;
+}
+
+OFCondition PeerPool::moveOne(const PatientRecord &patient_record, const std::string &uid) {
+	if (m_peers.size() > 1)
+		return this->moveStudy(patient_record, uid);
+
+	PatientRecord study = patient_record;
+	study.m_uid_list    = {uid};
+
+	const OFCondition cond = primary().performMoveRequest(study);
+	m_lastMove             = primary().lastMove();
+	return cond;
+}
+
+OFCondition PeerPool::moveStudy(const PatientRecord &patient_record, const std::string &uid) {
+	std::vector<std::size_t> candidates = sources(uid);
+	if (candidates.empty())
+		candidates.push_back(0);
+
+	PatientRecord study = patient_record;
+	study.m_uid_list    = {uid};
+
+	// fails with the last association or move error unless a peer moved the study
+	OFCondition cond = EC_IllegalCall;
+	m_lastMove       = MoveResult{STATUS_MOVE_Failed_UnableToProcess};
+	for (const std::size_t peer : m_statistics.rank(candidates)) {
+		QueryRetriever &retriever = *m_peers[peer];
+		if (!m_available[peer]) {
+			cond = retriever.ensureAssociation();
+			if (cond.bad())
+				continue;
+		}
+		m_available[peer] = true;
+
+		m_statistics.moveStarted(peer);
+		const auto start = std::chrono::steady_clock::now();
+		cond             = retriever.performMoveRequest(study);
+		m_lastMove       = retriever.lastMove();
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		const DIC_US status  = retriever.lastMoveStatus();
+		const bool   success = cond.good() && (status == STATUS_Success ||
+		                                       status == STATUS_MOVE_Warning_SubOperationsCompleteOneOrMoreFailures);
+		m_statistics.moveFinished(peer, success, retriever.lastMoveCompleted(), elapsed.count());
+		if (success)
+			return cond;
+
+		if (cond.bad())
+			m_available[peer] = false;
+		OFLOG_WARN(qrLogger,
+		           fmt::format("Moving study {} from {}:{} failed, trying next peer",
+			           uid, retriever.m_calledIP, retriever.m_port));
+	}
+	return cond;
+}
@@ -0,0 +1,122 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "QueryEngine.hpp"
+
+#include "StudyQueryRetriever.hpp"
+
+OFCondition sendFindRequest(T_ASC_Association *               assoc,
+                            const T_ASC_PresentationContextID pres_id,
+                            T_DIMSE_C_FindRQ *                request,
+                            DcmDataset *                      request_identifiers) {
+	T_DIMSE_Message req{};
+
+	if (request_identifiers == nullptr) return DIMSE_NULLKEY;
+
+	req.CommandField     = DIMSE_C_FIND_RQ;
+	request->DataSetType = DIMSE_DATASET_PRESENT;
+	req.msg.CFindRQ      = *request;
+
+	return DIMSE_sendMessageUsingMemoryData(assoc,
+	                                        pres_id,
+	                                        &req,
+	                                        nullptr,
+	                                        request_identifiers,
+	                                        nullptr,
+	                                        nullptr);
+}
+
+OFCondition receiveFindResponse(T_ASC_Association *          assoc,
+                                const T_DIMSE_BlockingMode   block_mode,
+                                const int                    timeout,
+                                const DIC_US                 msg_id,
+                                T_ASC_PresentationContextID *pres_id,
+                                T_DIMSE_C_FindRSP *          response,
+                                DcmDataset **                status_detail) {
+	T_DIMSE_Message rsp{};
+
+	// try to recieve C-FIND-RSP over the network
+	OFCondition cond = DIMSE_receiveCommand(assoc, block_mode, timeout, pres_id, &rsp, status_detail);
+	if (cond.bad())
+		return cond;
+
+	if (rsp.CommandField != DIMSE_C_FIND_RSP) {
+		std::string buf{
+			fmt::format("DIMSE: Unexpected Response Command Field: {:#04x}",
+			            static_cast<unsigned>(rsp.CommandField))
+		};
+		return makeDcmnetCondition(DIMSEC_UNEXPECTEDRESPONSE, OF_error, buf.c_str());
+	}
+
+	*response = rsp.msg.CFindRSP;
+	if (response->MessageIDBeingRespondedTo != msg_id) {
+		std::string buf{
+			fmt::format("DIMSE: Unexpected Response MsgID: {} (expected: {})",
+			            response->MessageIDBeingRespondedTo,
+			            msg_id)
+		};
+		return makeDcmnetCondition(DIMSEC_UNEXPECTEDRESPONSE, OF_error, buf.c_str());
+	}
+
+	const DIC_US status = response->DimseStatus;
+	switch (status) {
+		case STATUS_FIND_Pending_MatchesAreContinuing:
+		case STATUS_FIND_Pending_WarningUnsupportedOptionalKeys:
+			if (*status_detail != nullptr) {
+				DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Pending with statusDetail, ignoring detail");
+				delete *status_detail;
+				*status_detail = nullptr;
+			}
+
+			if (response->DataSetType == DIMSE_DATASET_NULL) {
+				DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Status Pending, but DataSetType==nullptr");
+				DCMNET_WARN(DIMSE_warn_str(assoc) << "Assuming response identifiers are present");
+			}
+			break;
+		case STATUS_FIND_Success:
+			if (response->DataSetType != DIMSE_DATASET_NULL) {
+				DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Status Success, but DataSetType!=nullptr");
+				DCMNET_WARN(DIMSE_warn_str(assoc) << "Assuming no response identifiers are present");
+			}
+			break;
+		default:
+			if (response->DataSetType != DIMSE_DATASET_NULL) {
+				DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Status " << DU_cfindStatusString(status) <<
+				            ", but DataSetType != nullptr");
+				DCMNET_WARN(DIMSE_warn_str(assoc) << "Assuming no response identifiers are present");
+			}
+			break;
+	}
+	return cond;
+}
+
+void logFindResponse(const int                  response_count,
+                     T_DIMSE_C_FindRSP &        response,
+                     const ResponseIdentifiers &identifiers) {
+	if (DCM_dcmnetLogger.isEnabledFor(OFLogger::DEBUG_LOG_LEVEL)) {
+		OFString temp_string;
+		DCMNET_INFO("Received Find Response " << response_count);
+		DCMNET_DEBUG(DIMSE_dumpMessage(temp_string, response, DIMSE_INCOMING));
+		if (qrLogger.isEnabledFor(OFLogger::DEBUG_LOG_LEVEL))
+			DCMNET_DEBUG("Response Identifiers:" << OFendl << identifiers.dump());
+	} else if (qrLogger.isEnabledFor(OFLogger::INFO_LOG_LEVEL)) {
+		OFLOG_INFO(qrLogger, "---------------------------");
+		OFLOG_INFO(qrLogger,
+		           "Find Response: " << response_count << " (" << DU_cfindStatusString(response.DimseStatus) << ")");
+		OFLOG_INFO(qrLogger, identifiers.dump());
+	} else {
+		DCMNET_INFO("Received Find Response " << response_count << " (" << DU_cfindStatusString(response.DimseStatus)
+		            << ")");
+	}
+}
+
+void sendFindCancel(T_ASC_Association *assoc, const T_ASC_PresentationContextID pres_id, const DIC_US msg_id) {
+	DCMNET_INFO("Sending Cancel Request (MsgID " << msg_id << ", PresID " << OFstatic_cast(unsigned int, pres_id)
+	            << ")");
+	const OFCondition cond = DIMSE_sendCancelRequest(assoc, pres_id, msg_id);
+	if (cond.bad()) {
+		OFString temp_string{};
+		DCMNET_ERROR("Cancel Request Failed: " << DimseCondition::dump(temp_string, cond));
+	}
+}
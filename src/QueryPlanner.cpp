@@ -0,0 +1,117 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "QueryPlanner.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <map>
+
+#include "fmt/format.h"
+
+bool parseDate(const std::string_view value, std::chrono::sys_days &day) {
+	if (value.size() != 8)
+		return false;
+
+	int year{0};
+	unsigned int month{0}, dayOfMonth{0};
+	if (std::from_chars(value.data(), value.data() + 4, year).ec != std::errc{} ||
+	    std::from_chars(value.data() + 4, value.data() + 6, month).ec != std::errc{} ||
+	    std::from_chars(value.data() + 6, value.data() + 8, dayOfMonth).ec != std::errc{})
+		return false;
+
+	const std::chrono::year_month_day date{std::chrono::year{year}, std::chrono::month{month},
+	                                       std::chrono::day{dayOfMonth}};
+	if (!date.ok())
+		return false;
+	day = std::chrono::sys_days{date};
+	return true;
+}
+
+bool parseDateRange(const std::string_view value, DateRange &range) {
+	const std::size_t dash = value.find('-');
+	if (dash == std::string_view::npos) {
+		if (!parseDate(value, range.m_first))
+			return false;
+		range.m_last = range.m_first;
+		return true;
+	}
+
+	// open ended ranges are left to the PACS
+	return parseDate(value.substr(0, dash), range.m_first) &&
+	       parseDate(value.substr(dash + 1), range.m_last) &&
+	       range.m_first <= range.m_last;
+}
+
+std::string formatDateRange(const DateRange &range) {
+	auto format = [](const std::chrono::sys_days day) {
+		const std::chrono::year_month_day date{day};
+		return fmt::format("{:04}{:02}{:02}",
+		                   static_cast<int>(date.year()),
+		                   static_cast<unsigned int>(date.month()),
+		                   static_cast<unsigned int>(date.day()));
+	};
+
+	if (range.m_first == range.m_last)
+		return format(range.m_first);
+	return fmt::format("{}-{}", format(range.m_first), format(range.m_last));
+}
+
+std::vector<PlannedQuery> planFindQueries(const std::vector<PatientRecord> &record_list) {
+	struct Candidate {
+		DateRange   m_range;
+		std::size_t m_record;
+	};
+
+	std::vector<PlannedQuery>                     plan;
+	std::map<std::string, std::vector<Candidate>> groups;
+
+	for (std::size_t i = 0; i < record_list.size(); ++i) {
+		const PatientRecord &record = record_list[i];
+		DateRange            range;
+		if (!parseDateRange(record.m_study_date, range)) {
+			PlannedQuery single;
+			single.m_query = record;
+			single.m_query.m_uid_list.clear();
+			single.m_records = {i};
+			plan.push_back(std::move(single));
+			continue;
+		}
+		groups[record.m_id].push_back({range, i});
+	}
+
+	for (auto &[id, candidates] : groups) {
+		std::ranges::sort(candidates, {}, [](const Candidate &c) { return c.m_range.m_first; });
+
+		std::size_t current = plan.size(); // none yet
+		for (const auto &candidate : candidates) {
+			const PatientRecord &record = record_list[candidate.m_record];
+
+			// adjacent: next range starts the day after current one ends
+			if (current < plan.size() && candidate.m_range.m_first <= plan[current].m_range.m_last + std::chrono::days{1}) {
+				PlannedQuery &query      = plan[current];
+				query.m_range.m_last     = std::max(query.m_range.m_last, candidate.m_range.m_last);
+				query.m_query.m_priority = std::max(query.m_query.m_priority, record.m_priority);
+				query.m_records.push_back(candidate.m_record);
+				continue;
+			}
+
+			PlannedQuery query;
+			query.m_query.m_id       = id;
+			query.m_query.m_modality = record.m_modality;
+			query.m_query.m_priority = record.m_priority;
+			query.m_range            = candidate.m_range;
+			query.m_records          = {candidate.m_record};
+			current                  = plan.size();
+			plan.push_back(std::move(query));
+		}
+	}
+
+	for (auto &query : plan) {
+		if (!query.m_query.m_study_date.empty())
+			continue;
+		query.m_query.m_study_date = formatDateRange(query.m_range);
+	}
+	return plan;
+}
@@ -0,0 +1,270 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "QuerySinks.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "fmt/ranges.h"
+
+#include "StudyQueryRetriever.hpp"
+
+namespace {
+	// rows are buffered and written once the buffer grows over this size
+	constexpr std::size_t SINK_BUFFER_LIMIT{64 * 1024};
+
+	// length of a well-formed UTF-8 sequence starting at pos, 0 if the bytes are not valid UTF-8
+	std::size_t utf8SequenceLength(const std::string_view value, const std::size_t pos) {
+		const auto    lead = static_cast<unsigned char>(value[pos]);
+		std::size_t   length;
+		unsigned char secondMin{0x80};
+		unsigned char secondMax{0xbf};
+		if (lead < 0x80)
+			return 1;
+		if (lead >= 0xc2 && lead <= 0xdf) {
+			length = 2;
+		} else if (lead >= 0xe0 && lead <= 0xef) {
+			length = 3;
+			if (lead == 0xe0) secondMin = 0xa0; // overlong
+			if (lead == 0xed) secondMax = 0x9f; // surrogates
+		} else if (lead >= 0xf0 && lead <= 0xf4) {
+			length = 4;
+			if (lead == 0xf0) secondMin = 0x90; // overlong
+			if (lead == 0xf4) secondMax = 0x8f; // over U+10FFFF
+		} else {
+			return 0;
+		}
+		if (pos + length > value.size())
+			return 0;
+		const auto second = static_cast<unsigned char>(value[pos + 1]);
+		if (second < secondMin || second > secondMax)
+			return 0;
+		for (std::size_t i = 2; i < length; ++i) {
+			if ((static_cast<unsigned char>(value[pos + i]) & 0xc0) != 0x80)
+				return 0;
+		}
+		return length;
+	}
+
+	// bytes that are not valid UTF-8 are escaped as Latin-1 code points, output is always valid JSON
+	void appendJsonString(std::string &out, const std::string_view value) {
+		out += '"';
+		for (std::size_t pos = 0; pos < value.size();) {
+			const char c = value[pos];
+			switch (c) {
+				case '"': out += "\\\"";
+					break;
+				case '\\': out += "\\\\";
+					break;
+				case '\n': out += "\\n";
+					break;
+				case '\r': out += "\\r";
+					break;
+				case '\t': out += "\\t";
+					break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						out += fmt::format("\\u{:04x}", static_cast<unsigned>(c));
+					} else if (const std::size_t length = utf8SequenceLength(value, pos); length > 0) {
+						out.append(value, pos, length);
+						pos += length;
+						continue;
+					} else {
+						out += fmt::format("\\u{:04x}", static_cast<unsigned char>(c));
+					}
+					break;
+			}
+			++pos;
+		}
+		out += '"';
+	}
+}
+
+void StudyUidSink::consume(const ResponseIdentifiers &identifiers) {
+	OFString studyuid;
+	if (identifiers.findAndGetOFString(DCM_StudyInstanceUID, studyuid).good()) {
+		if (!studyuid.empty()) {
+			m_uidList.insert(studyuid.c_str());
+		}
+	}
+}
+
+void UidSink::consume(const ResponseIdentifiers &identifiers) {
+	OFString uid;
+	if (identifiers.findAndGetOFString(m_key, uid).good() && !uid.empty())
+		m_uids.insert(uid.c_str());
+}
+
+void StudyInfoSink::consume(const ResponseIdentifiers &identifiers) {
+	OFString studyuid;
+	if (identifiers.findAndGetOFString(DCM_StudyInstanceUID, studyuid).bad() || studyuid.empty())
+		return;
+
+	StudyInfo study;
+	study.m_uid = studyuid.c_str();
+
+	OFString value;
+	if (identifiers.findAndGetOFString(DCM_PatientID, value).good())
+		study.m_patientId = value.c_str();
+	if (identifiers.findAndGetOFString(DCM_StudyDate, value).good())
+		study.m_date = value.c_str();
+	if (identifiers.findAndGetOFString(DCM_NumberOfStudyRelatedSeries, value).good())
+		study.m_series = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+	if (identifiers.findAndGetOFString(DCM_NumberOfStudyRelatedInstances, value).good())
+		study.m_instances = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+	if (identifiers.findAndGetOFString(DCM_ModalitiesInStudy, value).good())
+		study.m_modalities = value.c_str();
+
+	m_studies.push_back(std::move(study));
+}
+
+TagRowBuilder::TagRowBuilder(const std::vector<DcmTagKey> &query_tags) : m_queryTags(query_tags) {
+	for (const auto &key : m_queryTags) {
+		DcmTag tag{key};
+		m_columnNames.emplace_back(tag.getTagName());
+	}
+}
+
+bool TagRowBuilder::build(const ResponseIdentifiers &identifiers, std::vector<std::string> &row) const {
+	// messy af, ignore
+	OFString imagetype{};
+	identifiers.findAndGetOFString(DCM_ImageType, imagetype);
+	OFStandard::toLower(imagetype);
+	if (this->containsFilterWord(imagetype)) {
+		OFLOG_INFO(qrLogger, "Received dataset is derived/secondary data, not writing queried tags");
+		return false;
+	}
+
+	OFString seriesdesc{};
+	identifiers.findAndGetOFString(DCM_SeriesDescription, seriesdesc);
+	OFStandard::toLower(seriesdesc);
+	if (this->containsFilterWord(seriesdesc)) {
+		OFLOG_INFO(qrLogger, "Received dataset is topogram/report/processed data, not writing queried tags");
+		return false;
+	}
+
+	OFString id, studyuid;
+	identifiers.findAndGetOFString(DCM_PatientID, id);
+	identifiers.findAndGetOFString(DCM_StudyInstanceUID, studyuid);
+
+	row.clear();
+	row.emplace_back(id.c_str());
+	row.emplace_back(studyuid.c_str());
+	row.emplace_back(seriesdesc.c_str());
+
+	OFString value;
+	for (const auto &key : m_queryTags) {
+		if (identifiers.findAndGetOFString(key, value).bad()) {
+			OFLOG_INFO(qrLogger,
+			           fmt::format("PatientID={}: tag {} not found/no value in series {}",
+				           id,
+				           DcmTag{key}.getTagName(),
+				           seriesdesc));
+		}
+		row.emplace_back(value.empty() ? "EMPTY" : value.c_str());
+	}
+	return true;
+}
+
+bool TagRowBuilder::containsFilterWord(const OFString &string_val) const {
+	return std::ranges::any_of(m_filterWords,
+	                           [&string_val](const OFString &word) {
+		                           return string_val.find(word) != OFString_npos;
+	                           });
+}
+
+void TagTableSink::consume(const ResponseIdentifiers &identifiers) {
+	std::vector<std::string> row;
+	if (m_builder.build(identifiers, row))
+		m_rows.push_back(std::move(row));
+}
+
+CsvTagSink::CsvTagSink(const std::string &filepath, const std::vector<DcmTagKey> &query_tags)
+	: m_builder(query_tags),
+	  m_file(filepath, std::ios::out | std::ios::app) {
+	if (!m_file.is_open())
+		OFLOG_ERROR(qrLogger, fmt::format("Cannot open {} for writing", filepath));
+}
+
+CsvTagSink::~CsvTagSink() {
+	this->flush();
+}
+
+void CsvTagSink::consume(const ResponseIdentifiers &identifiers) {
+	if (!m_builder.build(identifiers, m_row))
+		return;
+
+	m_buffer += fmt::format("{}\n", fmt::join(m_row, ";"));
+	if (m_buffer.size() > SINK_BUFFER_LIMIT)
+		this->flush();
+}
+
+void CsvTagSink::flush() {
+	if (m_buffer.empty())
+		return;
+	m_file << m_buffer;
+	m_file.flush();
+	m_buffer.clear();
+}
+
+JsonTagSink::JsonTagSink(const std::string &filepath, const std::vector<DcmTagKey> &query_tags)
+	: m_builder(query_tags),
+	  m_file(filepath, std::ios::out | std::ios::app) {
+	if (!m_file.is_open())
+		OFLOG_ERROR(qrLogger, fmt::format("Cannot open {} for writing", filepath));
+}
+
+JsonTagSink::~JsonTagSink() {
+	this->flush();
+}
+
+void JsonTagSink::consume(const ResponseIdentifiers &identifiers) {
+	if (!m_builder.build(identifiers, m_row))
+		return;
+
+	// values are in the response's character set, JSON needs UTF-8; code extensions are further values
+	OFString charset;
+	identifiers.findAndGetOFStringArray(DCM_SpecificCharacterSet, charset);
+	if (!m_charsetSelected || charset != m_charset) {
+		m_charset         = charset;
+		m_charsetSelected = true;
+		// default repertoire and UTF-8 are written as they are
+		m_convert = !charset.empty() && charset != "ISO_IR 6" && charset != "ISO_IR 192";
+		if (m_convert && m_converter.selectCharacterSet(charset).bad()) {
+			m_convert = false;
+			OFLOG_WARN(qrLogger, fmt::format("Cannot convert character set \"{}\" to UTF-8, "
+			                                 "escaping non-ASCII values as Latin-1", charset));
+		}
+	}
+	if (m_convert) {
+		OFString converted;
+		for (auto &value : m_row) {
+			if (m_converter.convertString(value.c_str(), value.size(), converted).good())
+				value = converted.c_str();
+		}
+	}
+
+	const auto &names = m_builder.columnNames();
+	m_buffer += '{';
+	for (std::size_t i = 0; i < m_row.size(); ++i) {
+		if (i > 0)
+			m_buffer += ',';
+		appendJsonString(m_buffer, names[i]);
+		m_buffer += ':';
+		appendJsonString(m_buffer, m_row[i]);
+	}
+	m_buffer += "}\n";
+
+	if (m_buffer.size() > SINK_BUFFER_LIMIT)
+		this->flush();
+}
+
+void JsonTagSink::flush() {
+	if (m_buffer.empty())
+		return;
+	m_file << m_buffer;
+	m_file.flush();
+	m_buffer.clear();
+}
@@ -0,0 +1,160 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "RateLimiter.hpp"
+
+#include <algorithm>
+#include <ctime>
+
+#include "fmt/format.h"
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/oflog/oflog.h"
+
+#include "StudyQueryRetriever.hpp"
+#include "Utility.hpp"
+
+namespace {
+	constexpr std::uint64_t BYTES_PER_MBIT{1000 * 1000 / 8};
+	// receives running into a window without retrievals, keeps associations alive
+	constexpr std::uint64_t TRICKLE_RATE{BYTES_PER_MBIT};
+	// bucket holds this much of a second, smooths PDV sized bursts
+	constexpr double BURST_SECONDS{0.25};
+
+	// HH:MM as minute of day
+	bool parseTimeOfDay(const std::string_view value, unsigned int &minute) {
+		unsigned int hours{0};
+		unsigned int minutes{0};
+		if (value.size() != 5 || value[2] != ':' || !parseNumber(value.substr(0, 2), hours) ||
+		    !parseNumber(value.substr(3, 2), minutes))
+			return false;
+		minute = hours * 60 + minutes;
+		return hours <= 24 && minutes < 60 && minute <= 24 * 60;
+	}
+
+	unsigned int minuteOfDay() {
+		const std::time_t now = std::time(nullptr);
+		const std::tm     tm  = *std::localtime(&now);
+		return static_cast<unsigned int>(tm.tm_hour * 60 + tm.tm_min);
+	}
+}
+
+bool parseRateSchedule(const std::string_view value, std::vector<RateWindow> &schedule) {
+	std::vector<RateWindow> windows;
+	std::size_t             start{0};
+	while (start <= value.size()) {
+		const std::size_t      end   = std::min(value.find(',', start), value.size());
+		const std::string_view entry = value.substr(start, end - start);
+		start                        = end + 1;
+
+		// HH:MM-HH:MM=Mbit/s
+		const std::size_t dash  = entry.find('-');
+		const std::size_t equal = entry.find('=');
+		RateWindow        window;
+		unsigned int      mbits{0};
+		if (dash == std::string_view::npos || equal == std::string_view::npos || equal < dash ||
+		    !parseTimeOfDay(entry.substr(0, dash), window.m_start) ||
+		    !parseTimeOfDay(entry.substr(dash + 1, equal - dash - 1), window.m_end) ||
+		    !parseNumber(entry.substr(equal + 1), mbits) || window.m_start == window.m_end)
+			return false;
+
+		window.m_bytesPerSecond = mbits * BYTES_PER_MBIT;
+		windows.push_back(window);
+	}
+
+	schedule = std::move(windows);
+	return true;
+}
+
+std::uint64_t RateLimiter::currentRate(const Clock::time_point now) {
+	if (now - m_rateChecked < std::chrono::seconds(1) && m_rateChecked != Clock::time_point{})
+		return m_rate;
+
+	const unsigned int minute = minuteOfDay();
+	std::uint64_t      rate   = UNLIMITED;
+	for (const auto &window : m_schedule) {
+		const bool inside = window.m_start < window.m_end
+			                    ? minute >= window.m_start && minute < window.m_end
+			                    : minute >= window.m_start || minute < window.m_end;
+		if (inside)
+			rate = window.m_bytesPerSecond;
+	}
+
+	if (rate != m_rate) {
+		const std::string msg = rate == UNLIMITED
+			                        ? std::string("Retrieval rate unlimited")
+			                        : fmt::format("Retrieval rate limited to {} Mbit/s", rate / BYTES_PER_MBIT);
+		OFLOG_INFO(qrLogger, msg);
+		// new window starts with an empty bucket
+		m_tokens   = 0;
+		m_refilled = now;
+	}
+	m_rate        = rate;
+	m_rateChecked = now;
+	return rate;
+}
+
+void RateLimiter::refill(const Clock::time_point now, const std::uint64_t rate) {
+	const std::chrono::duration<double> elapsed = now - m_refilled;
+	m_refilled                                  = now;
+	m_tokens = std::min(static_cast<double>(rate) * BURST_SECONDS, m_tokens + elapsed.count() * rate);
+}
+
+void RateLimiter::consume(const std::size_t bytes) {
+	if (!this->enabled())
+		return;
+
+	std::unique_lock lock(m_mutex);
+	const auto       now  = Clock::now();
+	std::uint64_t    rate = this->currentRate(now);
+	if (rate == UNLIMITED || m_stopped)
+		return;
+	if (rate == 0)
+		rate = TRICKLE_RATE;
+
+	// deficit is slept off by the caller, concurrent receivers queue behind each other
+	this->refill(now, rate);
+	m_tokens -= static_cast<double>(bytes);
+	if (m_tokens >= 0)
+		return;
+
+	const std::chrono::duration<double> delay(-m_tokens / static_cast<double>(rate));
+	m_stopCondition.wait_for(lock, delay, [this] { return m_stopped; });
+}
+
+bool RateLimiter::waitForDispatch() {
+	if (!this->enabled())
+		return true;
+
+	std::unique_lock lock(m_mutex);
+	bool             paused{false};
+	while (!m_stopped) {
+		const auto          now  = Clock::now();
+		const std::uint64_t rate = this->currentRate(now);
+		if (rate == UNLIMITED)
+			break;
+		if (rate > 0) {
+			this->refill(now, rate);
+			if (m_tokens >= 0)
+				break;
+		}
+
+		if (!paused && rate == 0)
+			OFLOG_INFO(qrLogger, "Retrievals paused by rate schedule");
+		paused = paused || rate == 0;
+		m_stopCondition.wait_for(lock, std::chrono::seconds(1));
+	}
+
+	if (paused && !m_stopped)
+		OFLOG_INFO(qrLogger, "Retrievals resumed by rate schedule");
+	return !m_stopped;
+}
+
+void RateLimiter::stop() {
+	{
+		std::lock_guard lock(m_mutex);
+		m_stopped = true;
+	}
+	m_stopCondition.notify_all();
+}
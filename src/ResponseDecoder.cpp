@@ -0,0 +1,424 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "ResponseDecoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include "fmt/format.h"
+
+namespace {
+	constexpr Uint32 UNDEFINED_LENGTH{0xffffffff};
+
+	// how a value is converted to string, mirrors DcmElement::getOFString for value position 0
+	enum class ValueKind { MultiString, SingleString, US, SS, UL, SL, FL, FD, OB, OW, Other };
+
+	ValueKind kindFromEVR(const DcmEVR vr) {
+		switch (vr) {
+			case EVR_LT:
+			case EVR_ST:
+			case EVR_UT:
+			case EVR_UR:
+				return ValueKind::SingleString;
+			case EVR_AE:
+			case EVR_AS:
+			case EVR_CS:
+			case EVR_DA:
+			case EVR_DS:
+			case EVR_DT:
+			case EVR_IS:
+			case EVR_LO:
+			case EVR_PN:
+			case EVR_SH:
+			case EVR_TM:
+			case EVR_UC:
+			case EVR_UI:
+				return ValueKind::MultiString;
+			case EVR_US: return ValueKind::US;
+			case EVR_SS: return ValueKind::SS;
+			case EVR_UL: return ValueKind::UL;
+			case EVR_SL: return ValueKind::SL;
+			case EVR_FL: return ValueKind::FL;
+			case EVR_FD: return ValueKind::FD;
+			case EVR_OB:
+			case EVR_UN:
+			case EVR_UNKNOWN:
+				// tags missing in the dictionary (private ones) are read as UN by DcmDataset
+				return ValueKind::OB;
+			case EVR_OW: return ValueKind::OW;
+			default:
+				return ValueKind::Other;
+		}
+	}
+
+	ValueKind kindFromVRName(const char a, const char b) {
+		static constexpr std::pair<const char *, ValueKind> kinds[] = {
+			{"LT", ValueKind::SingleString}, {"ST", ValueKind::SingleString}, {"UT", ValueKind::SingleString},
+			{"UR", ValueKind::SingleString}, {"AE", ValueKind::MultiString}, {"AS", ValueKind::MultiString},
+			{"CS", ValueKind::MultiString}, {"DA", ValueKind::MultiString}, {"DS", ValueKind::MultiString},
+			{"DT", ValueKind::MultiString}, {"IS", ValueKind::MultiString}, {"LO", ValueKind::MultiString},
+			{"PN", ValueKind::MultiString}, {"SH", ValueKind::MultiString}, {"TM", ValueKind::MultiString},
+			{"UC", ValueKind::MultiString}, {"UI", ValueKind::MultiString}, {"US", ValueKind::US},
+			{"SS", ValueKind::SS}, {"UL", ValueKind::UL}, {"SL", ValueKind::SL}, {"FL", ValueKind::FL},
+			{"FD", ValueKind::FD}, {"OB", ValueKind::OB}, {"UN", ValueKind::OB}, {"OW", ValueKind::OW}
+		};
+		for (const auto &[vrName, kind] : kinds) {
+			if (vrName[0] == a && vrName[1] == b)
+				return kind;
+		}
+		return ValueKind::Other;
+	}
+
+	// explicit VRs with 2 reserved bytes and 32-bit length
+	bool hasExtendedLength(const char a, const char b) {
+		static constexpr const char *extended[] = {
+			"OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV"
+		};
+		return std::ranges::any_of(extended, [a, b](const char *vr) { return vr[0] == a && vr[1] == b; });
+	}
+
+	class ElementWalker {
+	public:
+		ElementWalker(const std::vector<Uint8> &buffer, const bool big_endian)
+			: m_data(buffer.data()),
+			  m_size(buffer.size()),
+			  m_bigEndian(big_endian) {}
+
+		// walk elements of a data set or item, entries are filled only for the top level
+		OFCondition walk(size_t &pos, const bool explicit_vr, std::vector<ResponseIdentifiers::Entry> *entries,
+		                 const bool until_item_delimiter) {
+			auto entry = entries ? entries->begin() : std::vector<ResponseIdentifiers::Entry>::iterator{};
+
+			while (pos < m_size) {
+				if (pos + 8 > m_size)
+					return corrupted("truncated element header");
+
+				const Uint16 group   = read16(pos);
+				const Uint16 element = read16(pos + 2);
+
+				if (group == 0xfffe) {
+					pos += 8;
+					if (element == 0xe00d && until_item_delimiter)
+						return EC_Normal;
+					return corrupted("unexpected item or delimiter");
+				}
+
+				ValueKind kind{ValueKind::Other};
+				bool      known{false};
+				Uint32    length;
+				bool      nestedImplicit{!explicit_vr};
+
+				if (explicit_vr) {
+					const char a = static_cast<char>(m_data[pos + 4]);
+					const char b = static_cast<char>(m_data[pos + 5]);
+					kind  = kindFromVRName(a, b);
+					known = true;
+					if (hasExtendedLength(a, b)) {
+						if (pos + 12 > m_size)
+							return corrupted("truncated element header");
+						length = read32(pos + 8);
+						pos += 12;
+						// undefined length UN contains implicit VR little endian
+						nestedImplicit = (a == 'U' && b == 'N');
+					} else {
+						length = read16(pos + 6);
+						pos += 8;
+					}
+				} else {
+					length = read32(pos + 4);
+					pos += 8;
+				}
+
+				if (length == UNDEFINED_LENGTH) {
+					const OFCondition cond = skipSequence(pos, !nestedImplicit);
+					if (cond.bad())
+						return cond;
+					continue;
+				}
+
+				if (pos + length > m_size)
+					return corrupted("element value exceeds data set");
+
+				if (entries != nullptr) {
+					const DcmTagKey key{group, element};
+					while (entry != entries->end() && entry->m_key < key)
+						++entry;
+					if (entry != entries->end() && entry->m_key == key) {
+						decode(*entry, known ? kind : kindFromEVR(entry->m_vr), pos, length);
+						entry->m_present = true;
+					}
+				}
+				pos += length;
+			}
+
+			if (until_item_delimiter)
+				return corrupted("missing item delimiter");
+			return EC_Normal;
+		}
+
+	private:
+		OFCondition skipSequence(size_t &pos, const bool explicit_vr) {
+			while (pos + 8 <= m_size) {
+				const Uint16 group   = read16(pos);
+				const Uint16 element = read16(pos + 2);
+				const Uint32 length  = read32(pos + 4);
+				pos += 8;
+
+				if (group != 0xfffe)
+					return corrupted("expected item in sequence");
+
+				if (element == 0xe0dd)
+					return EC_Normal;
+
+				if (element != 0xe000)
+					return corrupted("unexpected delimiter in sequence");
+
+				if (length == UNDEFINED_LENGTH) {
+					const OFCondition cond = walk(pos, explicit_vr, nullptr, true);
+					if (cond.bad())
+						return cond;
+				} else {
+					if (pos + length > m_size)
+						return corrupted("item exceeds data set");
+					pos += length;
+				}
+			}
+			return corrupted("missing sequence delimiter");
+		}
+
+		void decode(ResponseIdentifiers::Entry &entry, const ValueKind kind, const size_t pos,
+		            const Uint32 length) const {
+			const char *text = reinterpret_cast<const char *>(m_data + pos);
+			std::string_view value{text, length};
+			entry.m_values.clear();
+
+			switch (kind) {
+				case ValueKind::MultiString:
+					value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+					if (const size_t separator = value.find('\\'); separator != std::string_view::npos) {
+						std::string_view values = value;
+						while (!values.empty() && (values.back() == ' ' || values.back() == '\0'))
+							values.remove_suffix(1);
+						entry.m_values.assign(values.data(), values.size());
+						value = value.substr(0, separator);
+					}
+					[[fallthrough]];
+				case ValueKind::SingleString:
+					while (!value.empty() && (value.back() == ' ' || value.back() == '\0'))
+						value.remove_suffix(1);
+					entry.m_value.assign(value.data(), value.size());
+					break;
+				case ValueKind::US:
+					entry.m_value = length >= 2 ? fmt::format("{}", read16(pos)).c_str() : "";
+					break;
+				case ValueKind::SS:
+					entry.m_value = length >= 2 ? fmt::format("{}", static_cast<Sint16>(read16(pos))).c_str() : "";
+					break;
+				case ValueKind::UL:
+					entry.m_value = length >= 4 ? fmt::format("{}", read32(pos)).c_str() : "";
+					break;
+				case ValueKind::SL:
+					entry.m_value = length >= 4 ? fmt::format("{}", static_cast<Sint32>(read32(pos))).c_str() : "";
+					break;
+				case ValueKind::FL:
+					if (length >= 4) {
+						const Uint32 bits = read32(pos);
+						Float32      number;
+						std::memcpy(&number, &bits, sizeof(number));
+						entry.m_value = fmt::format("{}", number).c_str();
+					} else {
+						entry.m_value.clear();
+					}
+					break;
+				case ValueKind::FD:
+					if (length >= 8) {
+						const Uint64 bits = m_bigEndian
+							                    ? (Uint64{read32(pos)} << 32) | read32(pos + 4)
+							                    : (Uint64{read32(pos + 4)} << 32) | read32(pos);
+						Float64 number;
+						std::memcpy(&number, &bits, sizeof(number));
+						entry.m_value = fmt::format("{}", number).c_str();
+					} else {
+						entry.m_value.clear();
+					}
+					break;
+				case ValueKind::OB:
+					entry.m_value = length >= 1 ? fmt::format("{:02x}", m_data[pos]).c_str() : "";
+					break;
+				case ValueKind::OW:
+					entry.m_value = length >= 2 ? fmt::format("{:04x}", read16(pos)).c_str() : "";
+					break;
+				case ValueKind::Other:
+					entry.m_value.clear();
+					break;
+			}
+		}
+
+		Uint16 read16(const size_t pos) const {
+			return m_bigEndian
+				       ? static_cast<Uint16>(m_data[pos] << 8 | m_data[pos + 1])
+				       : static_cast<Uint16>(m_data[pos + 1] << 8 | m_data[pos]);
+		}
+
+		Uint32 read32(const size_t pos) const {
+			return m_bigEndian
+				       ? Uint32{read16(pos)} << 16 | read16(pos + 2)
+				       : Uint32{read16(pos + 2)} << 16 | read16(pos);
+		}
+
+		static OFCondition corrupted(const char *reason) {
+			return makeDcmnetCondition(DIMSEC_PARSEFAILED,
+			                           OF_error,
+			                           fmt::format("DIMSE: Cannot decode response identifiers: {}", reason).c_str());
+		}
+
+		const Uint8 *m_data;
+		size_t       m_size;
+		bool         m_bigEndian;
+	};
+}
+
+void ResponseIdentifiers::setRequestedTags(const std::vector<DcmTagKey> &tags) {
+	m_entries.clear();
+	for (const auto &key : tags) {
+		if (std::ranges::any_of(m_entries, [&key](const Entry &entry) { return entry.m_key == key; }))
+			continue;
+		m_entries.push_back({key, DcmTag{key}.getEVR()});
+	}
+	std::ranges::sort(m_entries, [](const Entry &lhs, const Entry &rhs) { return lhs.m_key < rhs.m_key; });
+}
+
+void ResponseIdentifiers::reset() {
+	for (auto &entry : m_entries) {
+		entry.m_value.clear();
+		entry.m_values.clear();
+		entry.m_present = false;
+	}
+}
+
+OFCondition ResponseIdentifiers::findAndGetOFString(const DcmTagKey &key, OFString &value) const {
+	const auto entry = std::lower_bound(m_entries.begin(),
+	                                    m_entries.end(),
+	                                    key,
+	                                    [](const Entry &lhs, const DcmTagKey &rhs) { return lhs.m_key < rhs; });
+	if (entry != m_entries.end() && entry->m_key == key && entry->m_present) {
+		value = entry->m_value;
+		return EC_Normal;
+	}
+	value.clear();
+	return EC_TagNotFound;
+}
+
+OFCondition ResponseIdentifiers::findAndGetOFStringArray(const DcmTagKey &key, OFString &value) const {
+	const OFCondition cond = findAndGetOFString(key, value);
+	if (cond.good()) {
+		const auto entry = std::lower_bound(m_entries.begin(),
+		                                    m_entries.end(),
+		                                    key,
+		                                    [](const Entry &lhs, const DcmTagKey &rhs) { return lhs.m_key < rhs; });
+		if (!entry->m_values.empty())
+			value = entry->m_values;
+	}
+	return cond;
+}
+
+std::string ResponseIdentifiers::dump() const {
+	std::string out;
+	for (const auto &entry : m_entries) {
+		if (entry.m_present)
+			out += fmt::format("({:04x},{:04x}) {}\n", entry.m_key.getGroup(), entry.m_key.getElement(),
+			                   entry.m_value.c_str());
+	}
+	return out;
+}
+
+void FindResponseDecoder::setRequestedTags(const std::vector<DcmTagKey> &tags) {
+	m_identifiers.setRequestedTags(tags);
+}
+
+OFCondition FindResponseDecoder::receive(T_ASC_Association *          assoc,
+                                         const T_DIMSE_BlockingMode   block_mode,
+                                         const int                    timeout,
+                                         T_ASC_PresentationContextID *pres_id) {
+	m_identifiers.reset();
+
+	// transfer syntax of presentation context the command was received on
+	T_ASC_PresentationContext presentationContext{};
+	E_TransferSyntax          xfer{EXS_Unknown};
+	if (ASC_findAcceptedPresentationContext(assoc->params, *pres_id, &presentationContext).good())
+		xfer = DcmXfer(presentationContext.acceptedTransferSyntax).getXfer();
+
+	if (xfer != EXS_LittleEndianImplicit && xfer != EXS_LittleEndianExplicit && xfer != EXS_BigEndianExplicit)
+		return receiveFallback(assoc, block_mode, timeout, pres_id);
+
+	OFCondition cond = readDataSetPDVs(assoc, block_mode, timeout, pres_id);
+	if (cond.bad())
+		return cond;
+
+	return decode(m_buffer, xfer);
+}
+
+OFCondition FindResponseDecoder::readDataSetPDVs(T_ASC_Association *          assoc,
+                                                 const T_DIMSE_BlockingMode   block_mode,
+                                                 const int                    timeout,
+                                                 T_ASC_PresentationContextID *pres_id) {
+	const DUL_BLOCKOPTIONS blockOption = (block_mode == DIMSE_BLOCKING) ? DUL_BLOCK : DUL_NOBLOCK;
+	const T_ASC_PresentationContextID commandPresID = *pres_id;
+
+	m_buffer.clear();
+	DUL_PDV pdv{};
+	do {
+		// next PDV of already received P-DATA-TF PDU, otherwise read next PDU
+		OFCondition cond = DUL_NextPDV(&assoc->DULassociation, &pdv);
+		if (cond.bad()) {
+			cond = DUL_ReadPDVs(&assoc->DULassociation, nullptr, blockOption, timeout);
+			if (cond.bad())
+				return cond;
+			cond = DUL_NextPDV(&assoc->DULassociation, &pdv);
+			if (cond.bad())
+				return cond;
+		}
+
+		if (pdv.pdvType != DUL_DATASETPDV)
+			return DIMSE_UNEXPECTEDPDVTYPE;
+
+		if (pdv.presentationContextID != commandPresID)
+			return DIMSE_INVALIDPRESENTATIONCONTEXTID;
+
+		const auto *fragment = static_cast<const Uint8 *>(pdv.data);
+		m_buffer.insert(m_buffer.end(), fragment, fragment + pdv.fragmentLength);
+	} while (!pdv.lastPDV);
+
+	*pres_id = pdv.presentationContextID;
+	return EC_Normal;
+}
+
+OFCondition FindResponseDecoder::receiveFallback(T_ASC_Association *          assoc,
+                                                 const T_DIMSE_BlockingMode   block_mode,
+                                                 const int                    timeout,
+                                                 T_ASC_PresentationContextID *pres_id) {
+	DcmDataset *dataset = nullptr;
+
+	const OFCondition cond = DIMSE_receiveDataSetInMemory(assoc, block_mode, timeout, pres_id, &dataset, nullptr,
+	                                                      nullptr);
+	if (cond.good()) {
+		for (auto &entry : m_identifiers.m_entries) {
+			entry.m_present = dataset->findAndGetOFString(entry.m_key, entry.m_value).good();
+			dataset->findAndGetOFStringArray(entry.m_key, entry.m_values);
+		}
+	}
+
+	delete dataset;
+	return cond;
+}
+
+OFCondition FindResponseDecoder::decode(const std::vector<Uint8> &buffer, const E_TransferSyntax xfer) {
+	m_identifiers.reset();
+
+	ElementWalker walker(buffer, xfer == EXS_BigEndianExplicit);
+	size_t        pos{0};
+	return walker.walk(pos, xfer != EXS_LittleEndianImplicit, &m_identifiers.m_entries, false);
+}
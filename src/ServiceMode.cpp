@@ -0,0 +1,385 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "ServiceMode.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+
+#include "fmt/chrono.h"
+#include "fmt/format.h"
+
+#include "QueryPlanner.hpp"
+#include "StudyQueryRetriever.hpp"
+#include "TransferPlan.hpp"
+
+namespace {
+	std::atomic<bool> stopRequested{false};
+
+	void handleStopSignal(int) {
+		stopRequested = true;
+	}
+
+	std::string timestamp() {
+		const auto    tt = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+		const std::tm tm = *std::localtime(&tt);
+		return fmt::format("{:%Y-%m-%d %H:%M:%S}", tm);
+	}
+}
+
+ServiceMode::ServiceMode(QueryRetriever &network_owner, JobOptions defaults, ServiceOptions options)
+	: m_networkOwner(network_owner),
+	  m_defaults(std::move(defaults)),
+	  m_options(std::move(options)),
+	  m_spool(m_options.spoolDirectory),
+	  m_processing(m_spool / "processing"),
+	  m_results(m_spool / "results"),
+	  m_done(m_spool / "done"),
+	  m_failed(m_spool / "failed"),
+	  m_admission(m_options.admission),
+	  m_rateLimiter(m_options.rateSchedule) {}
+
+ServiceMode::~ServiceMode() {
+	{
+		std::lock_guard lock(m_queueMutex);
+		m_stopping = true;
+	}
+	m_queueCondition.notify_all();
+	m_admission.stop();
+	m_rateLimiter.stop();
+	for (auto &worker : m_workers) {
+		if (worker.joinable())
+			worker.join();
+	}
+}
+
+int ServiceMode::run() {
+	if (!this->prepareSpool())
+		return EXITCODE_CANNOT_WRITE_OUTPUT_FILE;
+
+	std::string error_msg;
+	if (!m_options.captureFile.empty() && !m_capture.open(m_options.captureFile, error_msg)) {
+		OFLOG_ERROR(qrLogger, error_msg);
+		return EXITCODE_CANNOT_WRITE_OUTPUT_FILE;
+	}
+
+	OFString          temp_string;
+	const OFCondition cond = m_networkOwner.initializeNetwork();
+	if (cond.bad()) {
+		OFLOG_ERROR(qrLogger, "Cannot create network: " << DimseCondition::dump(temp_string, cond));
+		return EXITCODE_CANNOT_INITIALIZE_NETWORK;
+	}
+
+	std::signal(SIGINT, handleStopSignal);
+	std::signal(SIGTERM, handleStopSignal);
+
+	this->requeueUnfinished();
+
+	const unsigned int workerCount = std::max(1u, m_options.workers);
+	for (unsigned int i = 0; i < workerCount; ++i)
+		m_workers.emplace_back(&ServiceMode::workerLoop, this, i);
+
+	fmt::print("SERVICE ---------- watching {} with {} worker(s)\n", m_spool.string(), workerCount);
+
+	while (!stopRequested) {
+		this->claimJobs();
+
+		// sleep in short slices to react on signals
+		for (unsigned int slice = 0; slice < m_options.pollInterval * 10 && !stopRequested; ++slice)
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	fmt::print("SERVICE ---------- stopping, waiting for running jobs\n");
+	{
+		std::lock_guard lock(m_queueMutex);
+		m_stopping = true;
+	}
+	m_queueCondition.notify_all();
+	// paused moves would keep their jobs running until space frees up or the schedule allows
+	m_admission.stop();
+	m_rateLimiter.stop();
+	for (auto &worker : m_workers)
+		worker.join();
+	m_workers.clear();
+
+	// jobs claimed but not started stay in processing/ and are picked up on next start
+	(void) m_networkOwner.dropNetwork();
+	return EXITCODE_NO_ERROR;
+}
+
+bool ServiceMode::prepareSpool() {
+	std::error_code ec;
+	for (const auto &directory : {m_spool, m_processing, m_results, m_done, m_failed}) {
+		std::filesystem::create_directories(directory, ec);
+		if (ec) {
+			OFLOG_FATAL(qrLogger, fmt::format("Cannot create spool directory {}: {}", directory.string(), ec.message()));
+			return false;
+		}
+	}
+	return true;
+}
+
+void ServiceMode::requeueUnfinished() {
+	std::error_code ec;
+	for (const auto &entry : std::filesystem::directory_iterator(m_processing, ec)) {
+		if (!entry.is_regular_file())
+			continue;
+		OFLOG_INFO(qrLogger, fmt::format("Requeueing unfinished job {}", entry.path().filename().string()));
+		std::filesystem::rename(entry.path(), m_spool / entry.path().filename(), ec);
+	}
+}
+
+void ServiceMode::claimJobs() {
+	std::vector<std::filesystem::path> found;
+	std::error_code                    ec;
+	for (const auto &entry : std::filesystem::directory_iterator(m_spool, ec)) {
+		if (entry.is_regular_file() && entry.path().extension() == ".job")
+			found.push_back(entry.path());
+	}
+	std::ranges::sort(found);
+
+	for (const auto &path : found) {
+		// rename claims the job, other instances watching the same spool skip it
+		const std::filesystem::path claimed = m_processing / path.filename();
+		std::filesystem::rename(path, claimed, ec);
+		if (ec)
+			continue;
+
+		OFLOG_INFO(qrLogger, fmt::format("Claimed job {}", claimed.filename().string()));
+		const RecordPriority priority = readJobPriority(claimed);
+		{
+			std::lock_guard lock(m_queueMutex);
+			m_queue.push(claimed, priority);
+		}
+		m_queueCondition.notify_one();
+	}
+}
+
+RecordPriority ServiceMode::readJobPriority(const std::filesystem::path &job_path) {
+	RecordPriority priority{RecordPriority::MEDIUM};
+	std::ifstream  jobFile{job_path};
+	std::string    line;
+	while (std::getline(jobFile, line) && (line.empty() || line.front() == '#')) {
+		if (line.starts_with("#priority="))
+			parseRecordPriority(std::string_view(line).substr(10), priority);
+	}
+	return priority;
+}
+
+void ServiceMode::workerLoop(const unsigned int index) {
+	PeerPool peers(m_networkOwner, m_options.peers, &m_moveMutex, m_peerStatistics);
+	peers.setAdmissionControl(&m_admission);
+	peers.setRateLimiter(&m_rateLimiter);
+	if (m_capture.enabled())
+		peers.setSessionCapture(&m_capture);
+
+	while (true) {
+		std::filesystem::path job;
+		{
+			std::unique_lock lock(m_queueMutex);
+			m_queueCondition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+			if (m_stopping)
+				break;
+			job = m_queue.pop();
+		}
+
+		OFLOG_INFO(qrLogger, fmt::format("Worker {} processing job {}", index, job.filename().string()));
+		this->processJob(peers, job);
+	}
+
+	peers.releaseAssociations();
+}
+
+void ServiceMode::processJob(PeerPool &peers, const std::filesystem::path &job_path) {
+	const std::string           name       = job_path.stem().string();
+	const std::filesystem::path reportPath = m_results / fmt::format("{}.log", name);
+
+	std::FILE *reportFile = std::fopen(reportPath.string().c_str(), "w");
+	if (reportFile == nullptr) {
+		OFLOG_ERROR(qrLogger, fmt::format("Cannot open job report {}, writing to stdout", reportPath.string()));
+		reportFile = stdout;
+	} else {
+		// results are followed by clients while job runs
+		std::setvbuf(reportFile, nullptr, _IOLBF, BUFSIZ);
+	}
+	JobReport report(reportFile, false);
+	report.print("JOB {} ---------- STARTED {}\n", name, timestamp());
+
+	JobOptions options             = m_defaults;
+	options.dumpFilepath            = (m_results / fmt::format("{}-tags", name)).string();
+	options.missingStudiesDirectory = m_results.string();
+
+	std::vector<PatientRecord> recordList;
+	std::string                error_msg;
+	int                        exitCode = EXITCODE_NO_ERROR;
+
+	try {
+		if (!this->parseJob(job_path, options, recordList, error_msg)) {
+			exitCode = EXITCODE_TEXT_FILE_ERROR;
+		} else if (std::error_code ec; !std::filesystem::create_directories(options.outputDirectory, ec) && ec) {
+			error_msg = fmt::format("Cannot create output directory {}: {}", options.outputDirectory, ec.message());
+			exitCode  = EXITCODE_CANNOT_WRITE_OUTPUT_FILE;
+		} else if (const OFCondition cond = peers.ensureAssociations(); cond.bad()) {
+			error_msg = fmt::format("Failed to setup association: {}", cond.text());
+			exitCode  = EXITCODE_CANNOT_NEGOTIATE_NETWORK;
+		} else {
+			report.print("Found {} records to query\n", recordList.size());
+			exitCode = runJob(peers, options, recordList, report);
+		}
+	} catch (const std::exception &e) {
+		error_msg = e.what();
+		exitCode  = EXITCODE_TEXT_FILE_ERROR;
+	}
+
+	if (!error_msg.empty())
+		report.print("ERROR: {}\n", error_msg);
+	report.print("JOB {} ---------- FINISHED {} (exit code {})\n", name, timestamp(), exitCode);
+
+	if (reportFile != stdout)
+		std::fclose(reportFile);
+
+	std::error_code ec;
+	std::filesystem::rename(job_path, (exitCode == EXITCODE_NO_ERROR ? m_done : m_failed) / job_path.filename(), ec);
+}
+
+bool ServiceMode::parseJob(const std::filesystem::path &job_path,
+                           JobOptions &                 options,
+                           std::vector<PatientRecord> & record_list,
+                           std::string &                error_msg) const {
+	std::ifstream jobFile{job_path};
+	if (!jobFile.is_open()) {
+		error_msg = fmt::format("Unable to open job file {}", job_path.string());
+		return false;
+	}
+
+	bool        tagsOverridden{false};
+	std::string line;
+	while (std::getline(jobFile, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		// "# ..." is a comment, "#name[=value]" an option
+		if (line.size() < 2 || line.front() != '#' || line[1] == ' ' || line[1] == '#')
+			continue;
+
+		const std::size_t eqPos = line.find('=');
+		const std::string name  = line.substr(1, eqPos == std::string::npos ? std::string::npos : eqPos - 1);
+		const std::string value = eqPos == std::string::npos ? std::string{} : line.substr(eqPos + 1);
+
+		if (name == "add-modality-missing" || name == "add-modality-all") {
+			options.addModalities = (name == "add-modality-all") ? ADD_MODALITIES_ALL : ADD_MODALITIES_MISSING;
+			options.queryModality = value;
+		} else if (name == "tag") {
+			if (!tagsOverridden) {
+				options.queryTags.clear();
+				tagsOverridden = true;
+			}
+			DcmTag tag;
+			if (parseQueryTag(value.c_str(), tag, error_msg).bad())
+				return false;
+			options.queryTags.emplace_back(value, tag);
+		} else if (name == "extend-date") {
+			unsigned int months{0};
+			if (std::from_chars(value.data(), value.data() + value.size(), months).ec != std::errc{}) {
+				error_msg = fmt::format("Invalid #extend-date value \"{}\"", value);
+				return false;
+			}
+			options.extendStudyDate.rangeMatch = true;
+			options.extendStudyDate.byMonth    = months;
+		} else if (name == "priority") {
+			// already used for ordering of jobs
+			RecordPriority priority;
+			if (!parseRecordPriority(value, priority)) {
+				error_msg = fmt::format("Invalid #priority value \"{}\"", value);
+				return false;
+			}
+		} else if (name == "find-limit") {
+			if (std::from_chars(value.data(), value.data() + value.size(), options.findLimit).ec != std::errc{}) {
+				error_msg = fmt::format("Invalid #find-limit value \"{}\"", value);
+				return false;
+			}
+		} else if (name == "sweep-range") {
+			DateRange range;
+			if (!parseDateRange(value, range)) {
+				error_msg = fmt::format("Invalid #sweep-range value \"{}\"", value);
+				return false;
+			}
+			options.sweepRange = value;
+		} else if (name == "plan") {
+			options.planFile = (m_results / fmt::format("{}-plan.tsv", job_path.stem().string())).string();
+		} else if (name == "execute-plan" && !value.empty()) {
+			if (!readTransferPlan(value, options.plannedStudies, error_msg))
+				return false;
+		} else if (name == "coalesce") {
+			options.coalesceQueries = true;
+		} else if (name == "retrieve-tags") {
+			options.retrieveTags = true;
+		} else if (name == "retrieve-files") {
+			options.retrieveFiles = true;
+		} else if (name == "incremental") {
+			options.incremental = true;
+		} else if (name == "skip-present") {
+			options.skipPresent = true;
+		} else if (name == "sha256") {
+			options.sha256 = true;
+		} else if (name == "no-missing-file") {
+			options.logMissingStudies = false;
+		} else if (name == "dump-format" && (value == "csv" || value == "json")) {
+			options.dumpFormat = (value == "json") ? DUMP_FORMAT_JSON : DUMP_FORMAT_CSV;
+		} else if (name == "output-directory" && !value.empty()) {
+			options.outputDirectory = value;
+		} else if (name == "store" && !value.empty()) {
+			options.storeDirectory = value;
+		} else if (OutputLayout layout; name == "layout" && parseOutputLayout(value, layout)) {
+			options.outputLayout.m_sharded   = layout.m_sharded;
+			options.outputLayout.m_perSeries = layout.m_perSeries;
+		} else if (ArchiveFormat format; name == "archive" && parseArchiveFormat(value, format)) {
+			options.outputLayout.m_archive = format;
+		} else if (WriteBackend backend; name == "write-backend" && parseWriteBackend(value, backend)) {
+			options.writeBackend = backend;
+		} else {
+			error_msg = fmt::format("Unknown or invalid job option \"{}\"", line);
+			return false;
+		}
+	}
+
+	// archives carry their own index, same check as the command line
+	if (options.outputLayout.m_archive != ArchiveFormat::NONE &&
+	    (options.incremental || !options.storeDirectory.empty())) {
+		error_msg = "#archive cannot be combined with #incremental or #store";
+		return false;
+	}
+
+	std::ranges::replace(options.queryModality, '/', '\\');
+
+	record_list = readPatientRecords(job_path.string(), options.extendStudyDate);
+	// plans carry their studies
+	if (!options.plannedStudies.empty())
+		return true;
+
+	// sweeps build their records from the results
+	if (!options.sweepRange.empty()) {
+		if (options.queryModality.empty()) {
+			error_msg = "Sweep requires a modality (#add-modality-all)";
+			return false;
+		}
+		return true;
+	}
+
+	if (record_list.empty()) {
+		error_msg = "Record list is empty";
+		return false;
+	}
+
+	if (options.queryModality.empty() &&
+	    std::ranges::any_of(record_list, [](const PatientRecord &record) { return record.m_modality.empty(); })) {
+		error_msg = "Specified no modalities to query";
+		return false;
+	}
+	return true;
+}
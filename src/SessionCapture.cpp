@@ -0,0 +1,256 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "SessionCapture.hpp"
+
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+#include "fmt/format.h"
+
+#include "ResponseDecoder.hpp"
+#include "Utility.hpp"
+
+namespace {
+	// values may contain the field and line separators, e.g. LT/ST/UT text
+	std::string escapeValue(const std::string_view value) {
+		std::string escaped;
+		escaped.reserve(value.size());
+		for (const char c : value) {
+			switch (c) {
+				case '\\': escaped += "\\\\";
+					break;
+				case '\t': escaped += "\\t";
+					break;
+				case '\n': escaped += "\\n";
+					break;
+				case '\r': escaped += "\\r";
+					break;
+				default:
+					escaped += c;
+					break;
+			}
+		}
+		return escaped;
+	}
+
+	// other backslashes are kept, captures written before escaping hold raw multi-value delimiters
+	std::string unescapeValue(const std::string_view value) {
+		std::string unescaped;
+		unescaped.reserve(value.size());
+		for (std::size_t i = 0; i < value.size(); ++i) {
+			if (value[i] != '\\' || i + 1 == value.size()) {
+				unescaped += value[i];
+				continue;
+			}
+			switch (value[i + 1]) {
+				case '\\': unescaped += '\\';
+					break;
+				case 't': unescaped += '\t';
+					break;
+				case 'n': unescaped += '\n';
+					break;
+				case 'r': unescaped += '\r';
+					break;
+				default:
+					unescaped += '\\';
+					continue;
+			}
+			++i;
+		}
+		return unescaped;
+	}
+
+	// "gggg,eeee=value" fields starting at first
+	bool parseValues(const std::vector<std::string> &fields, const std::size_t first, CapturedValues &values) {
+		for (std::size_t i = first; i < fields.size(); ++i) {
+			const std::string &field = fields[i];
+			const std::size_t  equal = field.find('=');
+			Uint16             group{0};
+			Uint16             element{0};
+			if (equal != 9 || field[4] != ',' || !parseNumber(field.substr(0, 4), group, 16) ||
+			    !parseNumber(field.substr(5, 4), element, 16))
+				return false;
+			values.emplace_back(DcmTagKey(group, element), unescapeValue(std::string_view{field}.substr(equal + 1)));
+		}
+		return true;
+	}
+
+	std::string formatValues(const CapturedValues &values) {
+		std::string line;
+		for (const auto &[key, value] : values)
+			line += fmt::format("\t{:04x},{:04x}={}", key.getGroup(), key.getElement(), escapeValue(value));
+		return line;
+	}
+}
+
+CapturedValues captureValues(DcmDataset &dataset) {
+	CapturedValues values;
+	for (unsigned long i = 0; i < dataset.card(); ++i) {
+		DcmElement *element = dataset.getElement(i);
+		OFString    value;
+		if (element != nullptr && element->getOFStringArray(value).good() && !value.empty())
+			values.emplace_back(element->getTag(), value.c_str());
+	}
+	std::ranges::sort(values, [](const auto &a, const auto &b) { return a.first < b.first; });
+	return values;
+}
+
+std::string captureKey(const CapturedValues &values) {
+	std::string key = formatValues(values);
+	return key.empty() ? key : key.substr(1);
+}
+
+bool SessionCapture::open(const std::filesystem::path &path, std::string &error_msg) {
+	m_file.open(path, std::ios::trunc);
+	if (!m_file.is_open()) {
+		error_msg = fmt::format("Unable to open capture file {}", path.string());
+		return false;
+	}
+	m_start = std::chrono::steady_clock::now();
+	m_file << "# fnostudyqr capture 1\n";
+	return true;
+}
+
+std::uint64_t SessionCapture::now() const {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+void SessionCapture::write(const std::string &line) {
+	std::lock_guard lock(m_mutex);
+	m_file << line;
+	m_file.flush();
+}
+
+std::uint64_t SessionCapture::request(const char type, DcmDataset &identifiers) {
+	std::uint64_t session;
+	{
+		std::lock_guard lock(m_mutex);
+		session = ++m_sessions;
+	}
+	this->write(fmt::format("{}\t{}\t{}{}\n", type, session, this->now(), formatValues(captureValues(identifiers))));
+	return session;
+}
+
+std::uint64_t SessionCapture::findRequest(DcmDataset &identifiers) {
+	return this->request('F', identifiers);
+}
+
+void SessionCapture::findResponse(const std::uint64_t session, const DIC_US status,
+                                  const ResponseIdentifiers *identifiers) {
+	CapturedValues values;
+	if (identifiers != nullptr) {
+		for (const auto &entry : identifiers->entries()) {
+			if (entry.m_present && !entry.m_value.empty())
+				values.emplace_back(entry.m_key, entry.m_value.c_str());
+		}
+	}
+	this->write(fmt::format("f\t{}\t{}\t{:04x}{}\n", session, this->now(), status, formatValues(values)));
+}
+
+std::uint64_t SessionCapture::moveRequest(DcmDataset &identifiers) {
+	return this->request('M', identifiers);
+}
+
+void SessionCapture::moveResponse(const std::uint64_t session, const T_DIMSE_C_MoveRSP &response) {
+	this->write(fmt::format("m\t{}\t{}\t{:04x}\t{}\t{}\t{}\t{}\n", session, this->now(), response.DimseStatus,
+	                        response.NumberOfRemainingSubOperations, response.NumberOfCompletedSubOperations,
+	                        response.NumberOfFailedSubOperations, response.NumberOfWarningSubOperations));
+}
+
+void SessionCapture::store(const std::uint64_t session,
+                           const DIC_US        status,
+                           const std::string & sop_class_uid,
+                           const std::string & sop_instance_uid,
+                           const std::string & series_uid,
+                           const std::string & transfer_syntax,
+                           const std::uint64_t bytes) {
+	this->write(fmt::format("S\t{}\t{}\t{:04x}\t{}\t{}\t{}\t{}\t{}\n", session, this->now(), status, sop_class_uid,
+	                        sop_instance_uid, series_uid, transfer_syntax, bytes));
+}
+
+bool readCapture(const std::filesystem::path &path, Capture &capture, std::string &error_msg) {
+	std::ifstream file{path};
+	if (!file) {
+		error_msg = fmt::format("Cannot open capture {}", path.string());
+		return false;
+	}
+
+	// sessions being read, by id; requests always precede their responses
+	struct Open {
+		std::uint64_t m_start{0};
+		CapturedFind *m_find{nullptr};
+		CapturedMove *m_move{nullptr};
+	};
+	std::unordered_map<std::uint64_t, Open> sessions;
+
+	std::string line;
+	std::size_t lineNumber{0};
+	while (std::getline(file, line)) {
+		++lineNumber;
+		if (line.empty() || line.front() == '#')
+			continue;
+
+		const std::vector<std::string> fields = splitFields(line, '\t');
+		std::uint64_t                  session{0};
+		std::uint64_t                  time{0};
+		bool                           valid = fields.size() >= 3 && fields[0].size() == 1 &&
+		                                       parseNumber(fields[1], session) && parseNumber(fields[2], time);
+		const char type = valid ? fields[0].front() : '\0';
+
+		if (valid && (type == 'F' || type == 'M')) {
+			CapturedValues request;
+			valid = parseValues(fields, 3, request);
+			if (valid) {
+				// repeated requests keep the first session, later ones are read but dropped
+				Open              open{time};
+				const std::string key = captureKey(request);
+				if (type == 'F') {
+					auto [it, inserted] = capture.m_finds.try_emplace(key, CapturedFind{request, {}});
+					open.m_find         = inserted ? &it->second : nullptr;
+				} else {
+					auto [it, inserted] = capture.m_moves.try_emplace(key, CapturedMove{request, {}, {}});
+					open.m_move         = inserted ? &it->second : nullptr;
+				}
+				sessions[session] = open;
+			}
+		} else if (valid) {
+			const auto it = sessions.find(session);
+			if (it == sessions.end()) {
+				valid = false;
+			} else {
+				const std::uint64_t offset = time >= it->second.m_start ? time - it->second.m_start : 0;
+				DIC_US              status{0};
+				valid = fields.size() >= 4 && parseNumber(fields[3], status, 16);
+
+				if (valid && type == 'f') {
+					CapturedFindResponse response{offset, status, {}};
+					valid = parseValues(fields, 4, response.m_identifiers);
+					if (valid && it->second.m_find != nullptr)
+						it->second.m_find->m_responses.push_back(std::move(response));
+				} else if (valid && type == 'm' && fields.size() == 8) {
+					CapturedMoveResponse response{offset, status};
+					valid = parseNumber(fields[4], response.m_remaining) && parseNumber(fields[5], response.m_completed)
+					        && parseNumber(fields[6], response.m_failed) && parseNumber(fields[7], response.m_warning);
+					if (valid && it->second.m_move != nullptr)
+						it->second.m_move->m_responses.push_back(response);
+				} else if (valid && type == 'S' && fields.size() == 9) {
+					CapturedStore store{offset, status, fields[4], fields[5], fields[6], fields[7]};
+					valid = parseNumber(fields[8], store.m_bytes);
+					if (valid && it->second.m_move != nullptr)
+						it->second.m_move->m_stores.push_back(std::move(store));
+				} else {
+					valid = false;
+				}
+			}
+		}
+
+		if (!valid) {
+			error_msg = fmt::format("Capture {}, line {}: invalid event", path.string(), lineNumber);
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,125 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "SizeModel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#include "fmt/format.h"
+
+#include "Utility.hpp"
+
+namespace {
+	constexpr std::uint64_t DEFAULT_INSTANCE_SIZE{MIB};
+	constexpr const char *  TRANSFER_KEY{"#transfer"};
+
+	// typical uncompressed instance sizes until moves of the modality finished
+	constexpr std::array<std::pair<std::string_view, std::uint64_t>, 11> TYPICAL_INSTANCE_SIZES{{
+		{"CR", 10 * MIB},
+		{"CT", MIB / 2},
+		{"DX", 20 * MIB},
+		{"MG", 40 * MIB},
+		{"MR", MIB / 2},
+		{"NM", 2 * MIB},
+		{"PT", MIB / 4},
+		{"RF", 2 * MIB},
+		{"SR", MIB / 16},
+		{"US", 2 * MIB},
+		{"XA", 10 * MIB},
+	}};
+
+	template<typename Function>
+	void forEachModality(const std::string_view modalities, Function &&function) {
+		std::size_t start{0};
+		while (start <= modalities.size()) {
+			const std::size_t      end      = std::min(modalities.find('\\', start), modalities.size());
+			const std::string_view modality = modalities.substr(start, end - start);
+			if (!modality.empty())
+				function(modality);
+			start = end + 1;
+		}
+	}
+}
+
+void SizeModel::load(const std::filesystem::path &directory) {
+	m_directory = directory;
+	m_averages.clear();
+	m_transferredBytes = 0;
+	m_transferSeconds  = 0;
+
+	// <modality>\t<instances>\t<bytes>, #transfer\t<bytes>\t<seconds>
+	std::ifstream file{directory / FILENAME};
+	std::string   line;
+	while (std::getline(file, line)) {
+		std::istringstream fields{line};
+		std::string        key;
+		if (!std::getline(fields, key, '\t'))
+			continue;
+
+		if (key == TRANSFER_KEY) {
+			fields >> m_transferredBytes >> m_transferSeconds;
+			continue;
+		}
+
+		Average average;
+		if (fields >> average.m_instances >> average.m_bytes)
+			m_averages.insert_or_assign(key, average);
+	}
+}
+
+bool SizeModel::save(std::string &error_msg) const {
+	return writeFileAtomically(m_directory / FILENAME, [this](std::ostream &file) {
+		for (const auto &[modality, average] : m_averages)
+			file << fmt::format("{}\t{}\t{}\n", modality, average.m_instances, average.m_bytes);
+		file << fmt::format("{}\t{}\t{:.3f}\n", TRANSFER_KEY, m_transferredBytes, m_transferSeconds);
+	}, error_msg);
+}
+
+std::uint64_t SizeModel::instanceSize(const std::string_view modality) const {
+	if (const auto it = m_averages.find(modality); it != m_averages.end() && it->second.m_instances > 0)
+		return it->second.m_bytes / it->second.m_instances;
+
+	const auto typical = std::ranges::find(TYPICAL_INSTANCE_SIZES, modality,
+	                                       &std::pair<std::string_view, std::uint64_t>::first);
+	return typical != TYPICAL_INSTANCE_SIZES.end() ? typical->second : DEFAULT_INSTANCE_SIZE;
+}
+
+std::uint64_t SizeModel::estimate(const std::string_view modalities, const unsigned int instances) const {
+	if (instances == 0)
+		return 0;
+
+	std::uint64_t size{0};
+	forEachModality(modalities, [&](const std::string_view modality) {
+		size = std::max(size, this->instanceSize(modality));
+	});
+	return instances * (size > 0 ? size : DEFAULT_INSTANCE_SIZE);
+}
+
+void SizeModel::record(const std::string_view modalities, const unsigned int instances, const std::uint64_t bytes) {
+	if (instances == 0 || bytes == 0)
+		return;
+
+	forEachModality(modalities, [&](const std::string_view modality) {
+		auto it = m_averages.find(modality);
+		if (it == m_averages.end())
+			it = m_averages.emplace(std::string(modality), Average{}).first;
+		it->second.m_bytes += bytes;
+		it->second.m_instances += instances;
+	});
+}
+
+void SizeModel::recordTransfer(const std::uint64_t bytes, const double seconds) {
+	if (bytes == 0 || seconds <= 0)
+		return;
+	m_transferredBytes += bytes;
+	m_transferSeconds += seconds;
+}
+
+double SizeModel::throughput() const {
+	return m_transferSeconds > 0 ? static_cast<double>(m_transferredBytes) / m_transferSeconds : 0;
+}
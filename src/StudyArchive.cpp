@@ -0,0 +1,224 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "StudyArchive.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <ctime>
+
+#ifdef FNOSTUDYQR_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "fmt/format.h"
+
+#include "Checksum.hpp"
+
+namespace {
+	constexpr std::size_t BLOCK_SIZE{512};
+	constexpr std::size_t NAME_SIZE{100};
+	constexpr std::size_t PREFIX_SIZE{155};
+	// largest size in 11 octal digits of ustar header
+	constexpr std::uint64_t MAX_MEMBER_SIZE{077777777777ULL};
+	constexpr int           ZSTD_LEVEL{3};
+
+	using Block = std::array<char, BLOCK_SIZE>;
+
+	// ustar numeric fields are zero padded octal, NUL terminated
+	void putOctal(char *field, const std::size_t width, const std::uint64_t value) {
+		fmt::format_to_n(field, width - 1, "{:0{}o}", value, width - 1);
+	}
+
+	// names over 100 characters are split at a slash into prefix and name
+	bool tarHeader(const std::string &member, const std::uint64_t size, const std::time_t mtime, Block &header) {
+		header.fill('\0');
+		if (size > MAX_MEMBER_SIZE)
+			return false;
+
+		std::string_view name = member;
+		std::string_view prefix;
+		if (member.size() > NAME_SIZE) {
+			const std::size_t slash = member.rfind('/', PREFIX_SIZE);
+			if (slash == std::string::npos || member.size() - slash - 1 > NAME_SIZE)
+				return false;
+			prefix = name.substr(0, slash);
+			name   = name.substr(slash + 1);
+		}
+
+		char *h = header.data();
+		std::ranges::copy(name, h);
+		putOctal(h + 100, 8, 0644);
+		putOctal(h + 108, 8, 0);
+		putOctal(h + 116, 8, 0);
+		putOctal(h + 124, 12, size);
+		putOctal(h + 136, 12, static_cast<std::uint64_t>(mtime));
+		h[156] = '0';
+		std::memcpy(h + 257, "ustar", 6);
+		std::memcpy(h + 263, "00", 2);
+		std::ranges::copy(prefix, h + 345);
+
+		// checksum is computed with its own field set to spaces
+		std::memset(h + 148, ' ', 8);
+		unsigned int checksum{0};
+		for (const char c : header)
+			checksum += static_cast<unsigned char>(c);
+		fmt::format_to_n(h + 148, 7, "{:06o}", checksum);
+		h[154] = '\0';
+		return true;
+	}
+}
+
+StudyArchive::~StudyArchive() {
+	if (m_file != nullptr) {
+		this->close();
+		std::error_code ec;
+		std::filesystem::remove(m_partPath, ec);
+	}
+}
+
+bool StudyArchive::open(const std::filesystem::path &path,
+                        const std::string &          study_uid,
+                        const ArchiveFormat          format,
+                        const bool                   per_series,
+                        std::string &                error_msg) {
+	m_path      = path;
+	m_partPath  = path;
+	m_partPath += ".part";
+	m_studyUid  = study_uid;
+	m_perSeries = per_series;
+	m_offset    = 0;
+	m_entries.clear();
+
+	m_file = std::fopen(m_partPath.string().c_str(), "wb");
+	if (m_file == nullptr) {
+		error_msg = fmt::format("Cannot create study archive {}", m_partPath.string());
+		return false;
+	}
+
+#ifdef FNOSTUDYQR_WITH_ZSTD
+	if (format == ArchiveFormat::TAR_ZSTD) {
+		m_zstd = ZSTD_createCCtx();
+		ZSTD_CCtx_setParameter(m_zstd, ZSTD_c_compressionLevel, ZSTD_LEVEL);
+		m_compressed.resize(ZSTD_CStreamOutSize());
+	}
+#else
+	(void) format;
+#endif
+	return true;
+}
+
+bool StudyArchive::write(const void *data, const std::size_t length) {
+#ifdef FNOSTUDYQR_WITH_ZSTD
+	if (m_zstd != nullptr) {
+		ZSTD_inBuffer in{data, length, 0};
+		while (in.pos < in.size) {
+			ZSTD_outBuffer    out{m_compressed.data(), m_compressed.size(), 0};
+			const std::size_t result = ZSTD_compressStream2(m_zstd, &out, &in, ZSTD_e_continue);
+			if (ZSTD_isError(result) || std::fwrite(m_compressed.data(), 1, out.pos, m_file) != out.pos)
+				return false;
+		}
+		m_offset += length;
+		return true;
+	}
+#endif
+	if (std::fwrite(data, 1, length, m_file) != length)
+		return false;
+	m_offset += length;
+	return true;
+}
+
+bool StudyArchive::writeMember(const std::string &member, const std::string &data, std::uint64_t &data_offset) {
+	Block header;
+	if (!tarHeader(member, data.size(), std::time(nullptr), header) || !this->write(header.data(), header.size()))
+		return false;
+
+	data_offset = m_offset;
+	if (!this->write(data.data(), data.size()))
+		return false;
+
+	const Block padding{};
+	return this->write(padding.data(), (BLOCK_SIZE - data.size() % BLOCK_SIZE) % BLOCK_SIZE);
+}
+
+bool StudyArchive::append(const std::string &filename, const std::string &data, IndexedInstance instance) {
+	if (m_file == nullptr)
+		return false;
+
+	instance.m_path = (m_perSeries && !instance.m_seriesUid.empty())
+		                  ? fmt::format("{}/{}/{}", m_studyUid, instance.m_seriesUid, filename)
+		                  : fmt::format("{}/{}", m_studyUid, filename);
+
+	Entry entry{std::move(instance)};
+	if (!this->writeMember(entry.m_instance.m_path, data, entry.m_offset))
+		return false;
+	m_entries.push_back(std::move(entry));
+	return true;
+}
+
+bool StudyArchive::finish(std::string &error_msg) {
+	if (m_file == nullptr)
+		return false;
+
+	std::error_code ec;
+	if (m_entries.empty()) {
+		this->close();
+		std::filesystem::remove(m_partPath, ec);
+		return true;
+	}
+
+	std::string index;
+	for (const auto &[instance, offset] : m_entries) {
+		index += fmt::format("{}\t{}\t{}\t{}\t{}\t{}\t{}\n",
+		                     instance.m_path,
+		                     offset,
+		                     instance.m_size,
+		                     instance.m_studyUid,
+		                     instance.m_seriesUid,
+		                     instance.m_sopUid,
+		                     formatChecksum(instance.m_checksum));
+	}
+
+	// end of archive is marked by two zero blocks
+	std::uint64_t indexOffset{0};
+	const Block   trailer{};
+	bool          written = this->writeMember(fmt::format("{}/index.tsv", m_studyUid), index, indexOffset) &&
+	                        this->write(trailer.data(), trailer.size()) &&
+	                        this->write(trailer.data(), trailer.size());
+
+#ifdef FNOSTUDYQR_WITH_ZSTD
+	if (written && m_zstd != nullptr) {
+		ZSTD_inBuffer in{nullptr, 0, 0};
+		std::size_t   remaining{1};
+		while (written && remaining != 0) {
+			ZSTD_outBuffer out{m_compressed.data(), m_compressed.size(), 0};
+			remaining = ZSTD_compressStream2(m_zstd, &out, &in, ZSTD_e_end);
+			written   = !ZSTD_isError(remaining) && std::fwrite(m_compressed.data(), 1, out.pos, m_file) == out.pos;
+		}
+	}
+#endif
+
+	written = std::fflush(m_file) == 0 && written;
+	this->close();
+	if (written)
+		std::filesystem::rename(m_partPath, m_path, ec);
+	if (!written || ec) {
+		error_msg = fmt::format("Cannot write study archive {}", m_path.string());
+		std::filesystem::remove(m_partPath, ec);
+		return false;
+	}
+	return true;
+}
+
+void StudyArchive::close() {
+	if (m_file != nullptr)
+		std::fclose(m_file);
+	m_file = nullptr;
+
+#ifdef FNOSTUDYQR_WITH_ZSTD
+	ZSTD_freeCCtx(m_zstd);
+#endif
+	m_zstd = nullptr;
+}
@@ -0,0 +1,114 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "StudyCatalog.hpp"
+
+#include <chrono>
+#include <ctime>
+#include <vector>
+
+#include "fmt/chrono.h"
+#include "fmt/format.h"
+#include "fmt/ranges.h"
+
+#include "Utility.hpp"
+
+namespace {
+	// S\t<StudyInstanceUID>\t<instances>
+	constexpr const char *STUDY_KEY{"S"};
+	// R\t<PatientID>\t<StudyDate>\t<Modality>\t<StudyInstanceUID>,...\t<YYYYMMDD written>
+	constexpr const char *RECORD_KEY{"R"};
+
+	std::string recordKey(const std::string &id, const std::string &study_date, const std::string &modality) {
+		return fmt::format("{}\t{}\t{}", id, study_date, modality);
+	}
+
+	std::string today() {
+		const std::time_t tt = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+		const std::tm     tm = *std::localtime(&tt);
+		return fmt::format("{:%Y%m%d}", tm);
+	}
+
+	// last day of a StudyDate value or range, empty if the range is open ("", "20240101-")
+	std::string_view lastStudyDate(const std::string_view study_date) {
+		const std::size_t dash = study_date.find('-');
+		return dash == std::string_view::npos ? study_date : study_date.substr(dash + 1);
+	}
+}
+
+bool StudyCatalog::open(const std::filesystem::path &directory, std::string &error_msg) {
+	m_directory = directory;
+	m_studies.clear();
+	m_records.clear();
+
+	const std::filesystem::path catalogPath = directory / FILENAME;
+	std::ifstream               catalogFile{catalogPath};
+	std::string                 line;
+	while (std::getline(catalogFile, line)) {
+		std::vector<std::string> fields = splitFields(line, '\t');
+		unsigned int             instances{0};
+		if (fields.size() == 3 && fields[0] == STUDY_KEY && !fields[1].empty() && parseNumber(fields[2], instances)) {
+			m_studies.insert_or_assign(std::move(fields[1]), instances);
+		} else if ((fields.size() == 5 || fields.size() == 6) && fields[0] == RECORD_KEY && !fields[4].empty()) {
+			// records written before the date was kept are queried again once
+			CatalogRecord record{{}, fields.size() == 6 ? std::move(fields[5]) : std::string{}};
+			for (auto &uid : splitFields(fields[4], ','))
+				record.m_uids.insert(std::move(uid));
+			m_records.insert_or_assign(recordKey(fields[1], fields[2], fields[3]), std::move(record));
+		}
+	}
+
+	m_file.open(catalogPath, std::ios::app);
+	if (!m_file.is_open()) {
+		error_msg = fmt::format("Unable to open study catalog {}", catalogPath.string());
+		return false;
+	}
+	return true;
+}
+
+void StudyCatalog::addStudy(const std::string &uid, const unsigned int instances) {
+	if (m_file.is_open()) {
+		m_file << fmt::format("{}\t{}\t{}\n", STUDY_KEY, uid, instances);
+		m_file.flush();
+	}
+	m_studies.insert_or_assign(uid, instances);
+}
+
+void StudyCatalog::addRecord(const PatientRecord &record) {
+	if (record.m_uid_list.empty())
+		return;
+
+	const std::string written = today();
+	if (m_file.is_open()) {
+		m_file << fmt::format("{}\t{}\t{}\t{}\t{}\t{}\n", RECORD_KEY, record.m_id, record.m_study_date,
+		                      record.m_modality, fmt::join(record.m_uid_list, ","), written);
+		m_file.flush();
+	}
+	m_records.insert_or_assign(recordKey(record.m_id, record.m_study_date, record.m_modality),
+	                           CatalogRecord{record.m_uid_list, written});
+}
+
+bool StudyCatalog::complete(const std::string &uid, const InstanceIndex &index) const {
+	const auto it = m_studies.find(uid);
+	return it != m_studies.end() && index.entries(uid).size() >= it->second;
+}
+
+bool StudyCatalog::satisfied(const PatientRecord &record, const InstanceIndex &index,
+                             std::set<std::string> &uids) const {
+	const auto it = m_records.find(recordKey(record.m_id, record.m_study_date, record.m_modality));
+	if (it == m_records.end())
+		return false;
+
+	// studies of days not over when the record was written may have arrived at the PACS since
+	const std::string_view lastDate = lastStudyDate(record.m_study_date);
+	if (lastDate.empty() || it->second.m_written.empty() || lastDate >= it->second.m_written)
+		return false;
+
+	for (const auto &uid : it->second.m_uids) {
+		if (!this->complete(uid, index))
+			return false;
+	}
+	uids = it->second.m_uids;
+	return true;
+}
@@ -0,0 +1,182 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "StudyManifest.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "fmt/color.h"
+#include "fmt/format.h"
+
+#include "Checksum.hpp"
+#include "Utility.hpp"
+
+namespace {
+	constexpr const char *HEADER{"# SOPInstanceUID\tpath\tsize\tXXH64\tSHA-256\tTransferSyntaxUID"};
+	constexpr std::size_t READ_BUFFER_SIZE{MIB};
+
+	bool parseLine(const std::string &line, ManifestEntry &entry) {
+		std::vector<std::string> fields = splitFields(line, '\t');
+		if (fields.size() != 6 || fields[0].empty() || fields[1].empty())
+			return false;
+
+		if (!parseNumber(fields[2], entry.m_size) || !parseChecksum(fields[3], entry.m_checksum))
+			return false;
+
+		entry.m_sopUid         = std::move(fields[0]);
+		entry.m_path           = std::move(fields[1]);
+		entry.m_sha256         = std::move(fields[4]);
+		entry.m_transferSyntax = std::move(fields[5]);
+		return true;
+	}
+
+	struct VerifyItem {
+		std::filesystem::path m_path;
+		ManifestEntry         m_entry;
+	};
+
+	// empty if file matches, otherwise what differs
+	std::string verifyFile(const VerifyItem &item, std::vector<char> &buffer) {
+		std::FILE *file = std::fopen(item.m_path.string().c_str(), "rb");
+		if (file == nullptr)
+			return "MISSING";
+
+		XxHash64      hash;
+		Sha256        sha256;
+		std::uint64_t size{0};
+		std::size_t   read;
+		while ((read = std::fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+			hash.update(buffer.data(), read);
+			if (!item.m_entry.m_sha256.empty())
+				sha256.update(buffer.data(), read);
+			size += read;
+		}
+		const bool readError = std::ferror(file) != 0;
+		std::fclose(file);
+
+		if (readError)
+			return "READ ERROR";
+		if (size != item.m_entry.m_size)
+			return fmt::format("SIZE {} != {}", size, item.m_entry.m_size);
+		if (hash.digest() != item.m_entry.m_checksum)
+			return "XXH64 MISMATCH";
+		if (!item.m_entry.m_sha256.empty() && sha256.hexDigest() != item.m_entry.m_sha256)
+			return "SHA-256 MISMATCH";
+		return {};
+	}
+}
+
+void StudyManifest::load(const std::filesystem::path &study_directory) {
+	m_directory = study_directory;
+	m_entries.clear();
+
+	std::vector<ManifestEntry> entries;
+	if (readManifest(study_directory / FILENAME, entries)) {
+		for (auto &entry : entries)
+			m_entries.insert_or_assign(entry.m_sopUid, std::move(entry));
+	}
+}
+
+void StudyManifest::add(ManifestEntry entry) {
+	m_entries.insert_or_assign(entry.m_sopUid, std::move(entry));
+}
+
+void StudyManifest::add(const IndexedInstance &instance, std::string sha256) {
+	this->add(ManifestEntry{instance.m_sopUid,
+	                        instance.m_path,
+	                        instance.m_size,
+	                        instance.m_checksum,
+	                        std::move(sha256),
+	                        instance.m_transferSyntax});
+}
+
+bool StudyManifest::write(std::string &error_msg) const {
+	return writeFileAtomically(m_directory / FILENAME, [this](std::ostream &file) {
+		file << HEADER << '\n';
+		for (const auto &[sop, entry] : m_entries) {
+			file << fmt::format("{}\t{}\t{}\t{}\t{}\t{}\n",
+			                    entry.m_sopUid,
+			                    entry.m_path,
+			                    entry.m_size,
+			                    formatChecksum(entry.m_checksum),
+			                    entry.m_sha256,
+			                    entry.m_transferSyntax);
+		}
+	}, error_msg);
+}
+
+bool readManifest(const std::filesystem::path &manifest_path, std::vector<ManifestEntry> &entries) {
+	std::ifstream file{manifest_path};
+	if (!file.is_open())
+		return false;
+
+	std::string line;
+	while (std::getline(file, line)) {
+		ManifestEntry entry;
+		if (!line.starts_with('#') && parseLine(line, entry))
+			entries.push_back(std::move(entry));
+	}
+	return true;
+}
+
+VerifySummary verifyManifests(const std::filesystem::path &root, const unsigned int threads) {
+	VerifySummary           summary;
+	std::vector<VerifyItem> items;
+
+	std::error_code ec;
+	for (auto it = std::filesystem::recursive_directory_iterator(root, ec);
+	     !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+		if (it->path().filename() != StudyManifest::FILENAME)
+			continue;
+
+		std::vector<ManifestEntry> entries;
+		if (!readManifest(it->path(), entries)) {
+			++summary.m_unreadable;
+			fmt::print("{} - {}\n", it->path().string(), fmt::format(fg(fmt::color::red), "UNREADABLE"));
+			continue;
+		}
+		++summary.m_manifests;
+		for (auto &entry : entries) {
+			std::filesystem::path path = it->path().parent_path() / entry.m_path;
+			items.push_back(VerifyItem{std::move(path), std::move(entry)});
+		}
+	}
+	if (ec) {
+		summary.m_error = fmt::format("Cannot read directory {}: {}", root.string(), ec.message());
+		fmt::print("{}\n", fmt::format(fg(fmt::color::red), "{}", summary.m_error));
+	}
+
+	// items are handed out one by one, large and small files balance across threads
+	std::atomic<std::size_t> next{0};
+	std::mutex               mutex;
+	auto                     work = [&] {
+		std::vector<char> buffer(READ_BUFFER_SIZE);
+		for (std::size_t i = next++; i < items.size(); i = next++) {
+			const std::string failure = verifyFile(items[i], buffer);
+
+			std::lock_guard lock(mutex);
+			if (failure.empty()) {
+				++summary.m_verified;
+				continue;
+			}
+			if (failure == "MISSING")
+				++summary.m_missing;
+			else
+				++summary.m_mismatched;
+			fmt::print("{} - {}\n", items[i].m_path.string(), fmt::format(fg(fmt::color::red), "{}", failure));
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < std::max(1u, threads); ++i)
+		workers.emplace_back(work);
+	for (auto &worker : workers)
+		worker.join();
+	return summary;
+}
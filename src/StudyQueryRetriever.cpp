@@ -4,7 +4,13 @@
 #include <filesystem>
 
 #include "StudyQueryRetriever.hpp"
+#include "ContentStore.hpp"
+#include "InstanceIndex.hpp"
+#include "StudyArchive.hpp"
+#include "StudyManifest.hpp"
 
+#include <algorithm>
+#include <iterator>
 #include <utility>
 
 #include <fmt/os.h>
@@ -26,11 +32,58 @@ OFCondition QueryRetriever::initializeNetwork() {
 }
 
 OFCondition QueryRetriever::dropNetwork() {
-	if (this->m_net)
+	if (this->m_net && this->m_ownsNetwork)
 		return ASC_dropNetwork(&this->m_net);
 	return EC_Normal;
 }
 
+void QueryRetriever::attachNetwork(T_ASC_Network *net, std::mutex *move_mutex) {
+	this->dropNetwork();
+	this->m_net         = net;
+	this->m_ownsNetwork = false;
+	this->m_moveMutex   = move_mutex;
+}
+
+void QueryRetriever::copySettings(const QueryRetriever &other) {
+	this->m_port            = other.m_port;
+	this->m_retrievePort    = other.m_retrievePort;
+	this->m_callerIP        = other.m_callerIP;
+	this->m_calledIP        = other.m_calledIP;
+	this->m_callerAETitle   = other.m_callerAETitle;
+	this->m_calledAETitle   = other.m_calledAETitle;
+	this->m_receiverAETitle = other.m_receiverAETitle;
+	this->m_outputDirectory = other.m_outputDirectory;
+	this->m_outputLayout    = other.m_outputLayout;
+}
+
+OFCondition QueryRetriever::ensureAssociation() {
+	// nothing is expected on idle association, readable means release request, abort or closed socket
+	if (this->m_assoc != nullptr && ASC_dataWaiting(this->m_assoc, 0)) {
+		OFLOG_INFO(qrLogger, "Association closed by peer, negotiating new one");
+		(void) ASC_dropAssociation(this->m_assoc);
+		(void) ASC_destroyAssociation(&this->m_assoc);
+	}
+
+	if (this->m_assoc == nullptr)
+		return this->setupAssociation();
+	return EC_Normal;
+}
+
+OFCondition QueryRetriever::releaseAssociation() {
+	if (this->m_assoc == nullptr)
+		return EC_Normal;
+
+	OFLOG_INFO(qrLogger, "Releasing association");
+	OFCondition cond = ASC_releaseAssociation(this->m_assoc);
+	if (cond.bad()) {
+		OFString temp_string;
+		OFLOG_ERROR(qrLogger, "Association release failed: " << DimseCondition::dump(temp_string, cond));
+		(void) ASC_abortAssociation(this->m_assoc);
+	}
+	(void) ASC_destroyAssociation(&this->m_assoc);
+	return cond;
+}
+
 OFCondition QueryRetriever::setupAssociation() {
 	OFString temp_string;
 
@@ -192,75 +245,146 @@ OFCondition QueryRetriever::addPresentationContext(const E_TransferSyntax
 	return ASC_addPresentationContext(this->m_params, presID, abstractSyntax, transferSyntaxes, numTransferSyntaxes);
 }
 
-OFCondition QueryRetriever::performFindRequest(PatientRecord &    patient_record,
-                                               const std::string &modalities,
-                                               QueryCallback *    callback) const {
-	T_DIMSE_C_FindRQ  request{};
-	T_DIMSE_C_FindRSP response{};
-	DcmFileFormat     fileformat;
-	OFString          temp_string;
-	OFCondition       cond = EC_Normal;
+OFCondition QueryIdentifierTemplate::addKey(const DcmTagKey &key, const char *value) {
+	// putAndInsertString would replace (and delete) an element already registered in m_elements
+	for (const auto &[elementKey, element] : m_elements) {
+		if (elementKey == key)
+			return element->putString(value);
+	}
 
-	DcmDataset *requestedDataset = fileformat.getDataset();
+	OFCondition cond = m_dataset.putAndInsertString(key, value);
+	if (cond.bad())
+		return cond;
 
-	requestedDataset->putAndInsertString(DCM_QueryRetrieveLevel, "STUDY");
-	requestedDataset->putAndInsertString(DCM_PatientID, patient_record.m_id.c_str());
-	requestedDataset->putAndInsertString(DCM_StudyDate, patient_record.m_study_date.c_str());
-	requestedDataset->putAndInsertString(DCM_StudyInstanceUID, "");
-	requestedDataset->putAndInsertString(DCM_NumberOfStudyRelatedInstances, "");
-	requestedDataset->putAndInsertString(DCM_ModalitiesInStudy, modalities.c_str());
+	DcmElement *element = nullptr;
+	cond = m_dataset.findAndGetElement(key, element);
+	if (cond.good())
+		m_elements.emplace_back(key, element);
+	return cond;
+}
+
+OFCondition QueryIdentifierTemplate::setValue(const DcmTagKey &key, const char *value) {
+	for (const auto &[elementKey, element] : m_elements) {
+		if (elementKey == key)
+			return element->putString(value);
+	}
+	return EC_TagNotFound;
+}
+
+std::vector<DcmTagKey> QueryIdentifierTemplate::keys() const {
+	std::vector<DcmTagKey> keys;
+	keys.reserve(m_elements.size());
+	for (const auto &[key, element] : m_elements)
+		keys.push_back(key);
+	return keys;
+}
+
+void QueryIdentifierTemplate::clear() {
+	m_dataset.clear();
+	m_elements.clear();
+}
+
+OFCondition QueryRetriever::prepareFindIdentifiers(const std::string &modalities) {
+	m_findIdentifiers.clear();
+
+	OFCondition cond = m_findIdentifiers.addKey(DCM_QueryRetrieveLevel, "STUDY");
+	if (cond.good()) cond = m_findIdentifiers.addKey(DCM_PatientID);
+	if (cond.good()) cond = m_findIdentifiers.addKey(DCM_StudyDate);
+	if (cond.good()) cond = m_findIdentifiers.addKey(DCM_StudyTime);
+	if (cond.good()) cond = m_findIdentifiers.addKey(DCM_StudyInstanceUID);
+	if (cond.good()) cond = m_findIdentifiers.addKey(DCM_NumberOfStudyRelatedSeries);
+	if (cond.good()) cond = m_findIdentifiers.addKey(DCM_NumberOfStudyRelatedInstances);
+	if (cond.good()) cond = m_findIdentifiers.addKey(DCM_ModalitiesInStudy, modalities.c_str());
+
+	if (cond.bad()) {
+		OFString temp_string;
+		OFLOG_FATAL(qrLogger, "Cannot build C-FIND identifiers: " << DimseCondition::dump(temp_string, cond));
+		m_findIdentifiers.clear();
+	}
+
+	m_findDecoder.setRequestedTags(m_findIdentifiers.keys());
+	return cond;
+}
+
+OFCondition QueryRetriever::prepareDumpIdentifiers(const std::vector<TagValuePair> &query_tags) {
+	m_dumpIdentifiers.clear();
 
+	OFCondition cond = m_dumpIdentifiers.addKey(DCM_QueryRetrieveLevel, "SERIES");
+	if (cond.good()) cond = m_dumpIdentifiers.addKey(DCM_PatientID);
+	if (cond.good()) cond = m_dumpIdentifiers.addKey(DCM_StudyInstanceUID);
+	if (cond.good()) cond = m_dumpIdentifiers.addKey(DCM_SeriesDescription);
+
+	// filter out service/dose reports, secondary/derived images
+	if (cond.good()) cond = m_dumpIdentifiers.addKey(DCM_Modality);
+	if (cond.good()) cond = m_dumpIdentifiers.addKey(DCM_ImageType);
+
+	// character set of returned values, JSON output is converted to UTF-8
+	if (cond.good()) cond = m_dumpIdentifiers.addKey(DCM_SpecificCharacterSet);
+
+	// additional tags are return keys, their values are filled in by responses
+	for (const auto &pair : query_tags) {
+		if (cond.bad())
+			break;
+		cond = m_dumpIdentifiers.addKey(pair.first);
+	}
+
+	if (cond.bad()) {
+		OFString temp_string;
+		OFLOG_FATAL(qrLogger, "Cannot build C-FIND identifiers: " << DimseCondition::dump(temp_string, cond));
+		m_dumpIdentifiers.clear();
+	}
+
+	m_dumpDecoder.setRequestedTags(m_dumpIdentifiers.keys());
+	return cond;
+}
+
+T_ASC_PresentationContextID QueryRetriever::prepareFindRequest(T_DIMSE_C_FindRQ &     request,
+                                                               const T_DIMSE_Priority priority) const {
 	const T_ASC_PresentationContextID presID = ASC_findAcceptedPresentationContextID(
 		 this->m_assoc,
 		 this->m_abstractSyntax.findSyntax
 		);
-	if (presID == 0) {
-		OFLOG_FATAL(qrLogger, "No presentation context");
-		return DIMSE_NOVALIDPRESENTATIONCONTEXTID;
-	}
+	if (presID == 0)
+		return presID;
 
 	OFStandard::strlcpy(request.AffectedSOPClassUID,
 		m_abstractSyntax.findSyntax,
 		sizeof(request.AffectedSOPClassUID));
 
-	// std::strncpy(request.AffectedSOPClassUID,
-	//              this->m_abstractSyntax.findSyntax,
-	//              sizeof(request.AffectedSOPClassUID) - 1);
-	// request.AffectedSOPClassUID[sizeof(request.AffectedSOPClassUID) - 1] = '\0';
-
 	request.DataSetType = DIMSE_DATASET_PRESENT;
-	request.Priority    = DIMSE_PRIORITY_MEDIUM;
+	request.Priority    = priority;
+	request.MessageID   = this->m_assoc->nextMsgID++;
+	return presID;
+}
 
-	constexpr int responseCount{0};
-	int repeatCount{1};
+OFCondition QueryRetriever::patchFindIdentifiers(const PatientRecord &patient_record) {
+	if (m_findIdentifiers.empty()) {
+		OFLOG_FATAL(qrLogger, "C-FIND identifiers not prepared");
+		return EC_IllegalCall;
+	}
 
-	QueryDefaultCallback defaultCallback(this->m_cancelAfterNResponses);
-	if (callback == nullptr) callback = &defaultCallback;
-	callback->setAssociation(this->m_assoc);
-	callback->setPresentationContextID(presID);
+	m_findIdentifiers.setValue(DCM_PatientID, patient_record.m_id.c_str());
+	m_findIdentifiers.setValue(DCM_StudyDate, patient_record.m_study_date.c_str());
+	m_findIdentifiers.setValue(DCM_StudyTime, patient_record.m_study_time.c_str());
+	return EC_Normal;
+}
 
-	while (cond.good() && repeatCount--) {
-		DcmDataset *statusDetail = nullptr;
-		request.MessageID        = this->m_assoc->nextMsgID++;
-
-		OFLOG_INFO(qrLogger, fmt::format("Sending FIND Request (MsgID {})\n", request.MessageID));
-		cond = DIMSE_queryUser(this->m_assoc,
-		                       presID,
-		                       &request,
-		                       requestedDataset,
-		                       responseCount,
-		                       progressCallback,
-		                       callback,
-		                       this->m_blockMode,
-		                       this->m_dimseTimeout,
-		                       &response,
-		                       &statusDetail,
-		                       patient_record.m_uid_list);
+OFCondition QueryRetriever::performFindRequest(PatientRecord &patient_record) {
+	const OFCondition cond = patchFindIdentifiers(patient_record);
+	if (cond.bad())
+		return cond;
 
-		if (cond.bad())
-			OFLOG_ERROR(qrLogger, DimseCondition::dump(temp_string, cond).c_str());
-	}
-	return cond;
+	StudyUidSink sink(patient_record.m_uid_list);
+	return find(m_findIdentifiers, m_findDecoder, toDimsePriority(patient_record.m_priority), sink);
+}
+
+OFCondition QueryRetriever::findStudies(const PatientRecord &patient_record, std::vector<StudyInfo> &studies) {
+	const OFCondition cond = patchFindIdentifiers(patient_record);
+	if (cond.bad())
+		return cond;
+
+	StudyInfoSink sink(studies);
+	return find(m_findIdentifiers, m_findDecoder, toDimsePriority(patient_record.m_priority), sink);
 }
 
 OFCondition QueryRetriever::performMoveRequest(const PatientRecord &patient_record) {
@@ -269,7 +393,7 @@ OFCondition QueryRetriever::performMoveRequest(const PatientRecord &patient_reco
 	T_ASC_PresentationContextID presID;
 	T_DIMSE_C_MoveRQ            request{};
 	T_DIMSE_C_MoveRSP           response{};
-	DIC_US                      msgID = this->m_assoc->nextMsgID;
+	DIC_US                      msgID = this->m_assoc->nextMsgID++;
 	std::string                 sopClass;
 	MoveCallbackInfo            moveCallbackInfo{};
 	OFString                    temp_string;
@@ -300,7 +424,7 @@ OFCondition QueryRetriever::performMoveRequest(const PatientRecord &patient_reco
 	else
 		std::strncpy(request.MoveDestination, this->m_receiverAETitle.c_str(), sizeof(request.MoveDestination));
 
-	request.Priority    = DIMSE_PRIORITY_MEDIUM;
+	request.Priority    = toDimsePriority(patient_record.m_priority);
 	request.DataSetType = DIMSE_DATASET_PRESENT;
 
 	if (qrLogger.isEnabledFor(OFLogger::DEBUG_LOG_LEVEL)) {
@@ -317,36 +441,173 @@ OFCondition QueryRetriever::performMoveRequest(const PatientRecord &patient_reco
 		requestedDataset->putAndInsertString(DCM_StudyInstanceUID, uid.c_str());
 		OFLOG_INFO(qrLogger, "Request Identifiers: " << OFendl << DcmObject::PrintHelper(*fileformat.getDataset()));
 
-		const std::string studyDirectory = fmt::format("{}/{}", this->m_outputDirectory, uid);
-
+		const std::string studyDirectory =
+			studyDirectoryPath(this->m_outputDirectory, uid, this->m_outputLayout).string();
+
+		// sub-associations of concurrent moves would arrive on the same receive port
+		std::unique_lock<std::mutex> moveLock;
+		if (this->m_moveMutex != nullptr && this->m_receiverAETitle.empty())
+			moveLock = std::unique_lock(*this->m_moveMutex);
+
+		ReceiveContext receiveContext;
+		StudyArchive   studyArchive;
+		StudyManifest  studyManifest;
+#ifdef FNOSTUDYQR_WITH_URING
+		UringWriter    uringWriter;
+#endif
+		bool           deltaMove{false};
 		if (m_receiverAETitle.empty()) {
-			if (std::filesystem::exists(studyDirectory))
-				fmt::print("Study directory {} exits - {}\n",
-						   studyDirectory,
-						   fmt::format(fg(fmt::color::yellow), "OVERWRITING"));
+			receiveContext.m_index       = this->m_instanceIndex;
+			receiveContext.m_store       = this->m_contentStore;
+			receiveContext.m_perSeries   = this->m_outputLayout.m_perSeries;
+			receiveContext.m_sha256      = this->m_sha256;
+			receiveContext.m_rateLimiter = this->m_rateLimiter;
+			// studies with indexed instances only get the ones not received yet
+			if (this->m_incremental && this->m_instanceIndex != nullptr) {
+				receiveContext.m_receivedInstances = this->m_instanceIndex->instances(uid);
+				deltaMove                          = !receiveContext.m_receivedInstances.empty();
+			}
+
+			const ArchiveFormat archiveFormat = this->m_outputLayout.m_archive;
+			if (!this->m_directoriesPrepared && archiveFormat != ArchiveFormat::NONE) {
+				std::filesystem::create_directories(std::filesystem::path(studyDirectory).parent_path());
+			} else if (!this->m_directoriesPrepared) {
+				if (!deltaMove && std::filesystem::exists(studyDirectory))
+					fmt::print("Study directory {} exits - {}\n",
+							   studyDirectory,
+							   fmt::format(fg(fmt::color::yellow), "OVERWRITING"));
+
+				if (std::filesystem::create_directories(studyDirectory)) {
+					OFLOG_INFO(qrLogger, fmt::format("Created study directory {}", studyDirectory));
+				}
+			}
+
+			// manifest is rewritten as a whole, instances of earlier runs stay listed
+			if (archiveFormat == ArchiveFormat::NONE) {
+				studyManifest.load(studyDirectory);
+				receiveContext.m_manifest = &studyManifest;
+			}
+
+#ifdef FNOSTUDYQR_WITH_URING
+			// ring is set up once per study, stdio is used if it cannot be
+			if (archiveFormat == ArchiveFormat::NONE && this->m_writeBackend != WriteBackend::STDIO) {
+				std::string error_msg;
+				if (uringWriter.open(this->m_writeBackend == WriteBackend::IO_URING_DIRECT, error_msg))
+					receiveContext.m_uring = &uringWriter;
+				else
+					OFLOG_WARN(qrLogger, error_msg);
+			}
+#endif
 
-			if (std::filesystem::create_directories(studyDirectory)) {
-				OFLOG_INFO(qrLogger, fmt::format("Created study directory {}", studyDirectory));
+			// instances stored by earlier runs are linked, only the rest is moved
+			if (this->m_contentStore != nullptr) {
+				std::vector<IndexedInstance> linked = this->m_contentStore->materialize(uid, studyDirectory,
+				                                                                        this->m_outputLayout);
+				if (!linked.empty()) {
+					OFLOG_INFO(qrLogger,
+					           fmt::format("Study {}: {} instance(s) linked from content store", uid, linked.size()));
+					deltaMove = true;
+				}
+				for (auto &instance : linked) {
+					receiveContext.m_receivedInstances.insert(instance.m_sopUid);
+					studyManifest.add(instance, {});
+					if (this->m_instanceIndex != nullptr) {
+						const std::filesystem::path path = std::filesystem::path(studyDirectory) / instance.m_path;
+						instance.m_path = path.lexically_relative(this->m_instanceIndex->directory()).generic_string();
+						this->m_instanceIndex->add(std::move(instance));
+					}
+				}
+			}
+
+			if (archiveFormat != ArchiveFormat::NONE) {
+				std::string error_msg;
+				if (!studyArchive.open(studyDirectory + archiveExtension(archiveFormat), uid, archiveFormat,
+				                       this->m_outputLayout.m_perSeries, error_msg)) {
+					OFLOG_ERROR(qrLogger, error_msg);
+					this->m_moveExitCode = EXITCODE_CMOVE_ERROR;
+					this->m_lastMove     = MoveResult{STATUS_MOVE_Failed_UnableToProcess};
+					continue;
+				}
+				receiveContext.m_archive = &studyArchive;
 			}
 		}
 
-		cond = DIMSE_moveUser_(this->m_assoc,
-		                       presID,
-		                       &request,
-		                       requestedDataset,
-		                       moveCallback,
-		                       &moveCallbackInfo,
-		                       this->m_blockMode,
-		                       this->m_dimseTimeout,
-		                       this->m_net,
-		                       subOpCallback,
-		                       nullptr,
-		                       &response,
-		                       this->m_cancelAfterNResponses,
-		                       &statusDetail,
-		                       &responseIDs,
-		                       this->m_ignorePendingDatasets,
-		                       studyDirectory);
+		if (deltaMove) {
+			const std::size_t indexed = receiveContext.m_receivedInstances.size();
+			OFLOG_INFO(qrLogger, fmt::format("Study {}: {} instance(s) indexed, moving the rest", uid, indexed));
+			std::size_t stillMissing{0};
+			cond = this->fillMissingInstances(patient_record, uid, studyDirectory, receiveContext, stillMissing);
+
+			response.DimseStatus = (stillMissing == 0)
+				                       ? STATUS_Success
+				                       : STATUS_MOVE_Warning_SubOperationsCompleteOneOrMoreFailures;
+			response.NumberOfCompletedSubOperations =
+				static_cast<DIC_US>(receiveContext.m_receivedInstances.size() - indexed);
+		} else {
+			const std::uint64_t session = this->m_capture != nullptr
+				                              ? this->m_capture->moveRequest(*requestedDataset)
+				                              : 0;
+			moveCallbackInfo.capture        = this->m_capture;
+			moveCallbackInfo.session        = session;
+			receiveContext.m_capture        = this->m_capture;
+			receiveContext.m_captureSession = session;
+
+			cond = DIMSE_moveUser_(this->m_assoc,
+			                       presID,
+			                       &request,
+			                       requestedDataset,
+			                       moveCallback,
+			                       &moveCallbackInfo,
+			                       this->m_blockMode,
+			                       this->m_dimseTimeout,
+			                       this->m_net,
+			                       subOpCallback,
+			                       &receiveContext,
+			                       &response,
+			                       this->m_cancelAfterNResponses,
+			                       &statusDetail,
+			                       &responseIDs,
+			                       this->m_ignorePendingDatasets,
+			                       studyDirectory);
+			if (this->m_capture != nullptr && cond.good())
+				this->m_capture->moveResponse(session, response);
+		}
+
+		this->m_lastMove.m_status    = (cond == EC_Normal) ? response.DimseStatus : STATUS_MOVE_Failed_UnableToProcess;
+		this->m_lastMove.m_completed = (cond == EC_Normal) ? response.NumberOfCompletedSubOperations : 0;
+
+		// stores received by third party destination cannot be checked
+		if (cond == EC_Normal && response.DimseStatus == STATUS_MOVE_Warning_SubOperationsCompleteOneOrMoreFailures &&
+		    m_receiverAETitle.empty() && !deltaMove) {
+			std::size_t       stillMissing{0};
+			const OFCondition fillCond = this->fillMissingInstances(patient_record, uid, studyDirectory, receiveContext,
+			                                                        stillMissing);
+			if (fillCond.good() && stillMissing == 0) {
+				response.DimseStatus         = STATUS_Success;
+				this->m_lastMove.m_status    = STATUS_Success;
+				this->m_lastMove.m_completed = static_cast<DIC_US>(receiveContext.m_receivedInstances.size());
+			}
+		}
+		this->m_lastMove.m_stored = receiveContext.m_storedInstances;
+		this->m_lastMove.m_bytes  = receiveContext.m_storedBytes;
+
+		if (receiveContext.m_manifest != nullptr && !receiveContext.m_receivedInstances.empty()) {
+			std::string error_msg;
+			if (!studyManifest.write(error_msg))
+				OFLOG_ERROR(qrLogger, error_msg);
+		}
+
+		// index is written once the study is complete, archive is renamed into place only then
+		if (receiveContext.m_archive != nullptr) {
+			std::string error_msg;
+			if (studyArchive.finish(error_msg)) {
+				OFLOG_INFO(qrLogger, fmt::format("Study {}: {} instance(s) archived", uid, studyArchive.members()));
+			} else {
+				OFLOG_ERROR(qrLogger, error_msg);
+				response.DimseStatus      = STATUS_MOVE_Failed_UnableToProcess;
+				this->m_lastMove.m_status = STATUS_MOVE_Failed_UnableToProcess;
+			}
+		}
 
 		if (cond == EC_Normal) {
 			if ((response.DimseStatus == STATUS_Success) ||
@@ -358,12 +619,12 @@ OFCondition QueryRetriever::performMoveRequest(const PatientRecord &patient_reco
 				                                    uid);
 				fmt::print("{} - {}", msg, fmt::format(fg(fmt::color::green), "SUCCESS\n"));
 			} else if (response.DimseStatus == STATUS_MOVE_Warning_SubOperationsCompleteOneOrMoreFailures) {
-				if (cmove_status_code == EXITCODE_NO_ERROR)
-					cmove_status_code = EXITCODE_CMOVE_WARNING;
+				if (this->m_moveExitCode == EXITCODE_NO_ERROR)
+					this->m_moveExitCode = EXITCODE_CMOVE_WARNING;
 				OFLOG_WARN(qrLogger,
 				           "Move response with warning status (" << DU_cmoveStatusString(response.DimseStatus) << ")");
 			} else {
-				cmove_status_code = EXITCODE_CMOVE_ERROR;
+				this->m_moveExitCode = EXITCODE_CMOVE_ERROR;
 				OFLOG_WARN(qrLogger,
 				           "Move response with error status (" << DU_cmoveStatusString(response.DimseStatus) << ")");
 			}
@@ -378,6 +639,7 @@ OFCondition QueryRetriever::performMoveRequest(const PatientRecord &patient_reco
 				           "Received Final Move Response (" << DU_cmoveStatusString(response.DimseStatus) << ")");
 			}
 		} else {
+			this->m_moveExitCode = EXITCODE_CMOVE_ERROR;
 			OFLOG_ERROR(qrLogger, "Move Request Failed: " << DimseCondition::dump(temp_string, cond));
 		}
 
@@ -389,392 +651,171 @@ OFCondition QueryRetriever::performMoveRequest(const PatientRecord &patient_reco
 	return cond;
 }
 
-QueryCallback::QueryCallback() : m_assoc(nullptr),
-                                 m_presID(0) {}
-
-void QueryCallback::setAssociation(T_ASC_Association *assoc) {
-	this->m_assoc = assoc;
-}
-
-void QueryCallback::setPresentationContextID(const T_ASC_PresentationContextID pres_id) {
-	this->m_presID = pres_id;
-}
-
-QueryDefaultCallback::QueryDefaultCallback(int cancelAfterNResponses) : m_cancelAfterNResponses(cancelAfterNResponses) {
-}
-
-void QueryDefaultCallback::callback(T_DIMSE_C_FindRQ *     request,
-                                    int                    response_count,
-                                    T_DIMSE_C_FindRSP *    response,
-                                    DcmDataset *           response_identifiers,
-                                    std::set<std::string> &uid_list) {
-	if (DCM_dcmnetLogger.isEnabledFor(OFLogger::DEBUG_LOG_LEVEL)) {
-		OFString temp_string;
-		DCMNET_INFO("Received Find Response " << response_count);
-		DCMNET_DEBUG(DIMSE_dumpMessage(temp_string, *response, DIMSE_INCOMING));
-		if (qrLogger.isEnabledFor(OFLogger::DEBUG_LOG_LEVEL))
-			DCMNET_DEBUG("Response Identifiers:" << OFendl << DcmObject::PrintHelper(*response_identifiers));
-	} else if (qrLogger.isEnabledFor(OFLogger::INFO_LOG_LEVEL)) {
-		OFLOG_INFO(qrLogger, "---------------------------");
-		OFLOG_INFO(qrLogger,
-		           "Find Response: " << response_count << " (" << DU_cfindStatusString(response->DimseStatus) << ")");
-		OFLOG_INFO(qrLogger, DcmObject::PrintHelper(*response_identifiers));
-	} else {
-		DCMNET_INFO("Received Find Response " << response_count << " (" << DU_cfindStatusString(response->DimseStatus)
-		            << ")");
-	}
+OFCondition QueryRetriever::fillMissingInstances(const PatientRecord &patient_record,
+                                                const std::string &  study_uid,
+                                                const std::string &  study_directory,
+                                                ReceiveContext &     context,
+                                                std::size_t &        still_missing) {
+	// SOPInstanceUID list matching, kept short as some PACS limit the identifier length
+	constexpr std::size_t INSTANCES_PER_MOVE{100};
+
+	const T_DIMSE_Priority priority = toDimsePriority(patient_record.m_priority);
+	still_missing                   = 0;
+
+	// study root queries are hierarchical, instances are listed series by series
+	QueryIdentifierTemplate identifiers;
+	FindResponseDecoder     decoder;
+	std::set<std::string>   seriesUids;
+
+	OFCondition cond = identifiers.addKey(DCM_QueryRetrieveLevel, "SERIES");
+	if (cond.good()) cond = identifiers.addKey(DCM_StudyInstanceUID, study_uid.c_str());
+	if (cond.good()) cond = identifiers.addKey(DCM_SeriesInstanceUID);
+	if (cond.bad())
+		return cond;
 
-	OFString studyuid;
-	if (response_identifiers->findAndGetOFString(DCM_StudyInstanceUID, studyuid).good()) {
-		if (!studyuid.empty()) {
-			uid_list.insert(studyuid.c_str());
-		}
-	}
+	decoder.setRequestedTags(identifiers.keys());
+	UidSink seriesSink(DCM_SeriesInstanceUID, seriesUids);
+	cond = find(identifiers, decoder, priority, seriesSink);
+	if (cond.bad())
+		return cond;
 
-	if (this->m_cancelAfterNResponses == response_count) {
-		DCMNET_INFO("Sending Cancel Request (MsgID " << request->MessageID << ", PresID " << OFstatic_cast(unsigned int,
-			            this->m_presID) << ")");
-		OFCondition cond = DIMSE_sendCancelRequest(this->m_assoc, this->m_presID, request->MessageID);
-		if (cond.bad()) {
-			OFString temp_string{};
-			DCMNET_ERROR("Cancel Request Failed: " << DimseCondition::dump(temp_string, cond));
-		}
-	}
-}
+	identifiers.clear();
+	cond = identifiers.addKey(DCM_QueryRetrieveLevel, "IMAGE");
+	if (cond.good()) cond = identifiers.addKey(DCM_StudyInstanceUID, study_uid.c_str());
+	if (cond.good()) cond = identifiers.addKey(DCM_SeriesInstanceUID);
+	if (cond.good()) cond = identifiers.addKey(DCM_SOPInstanceUID);
+	if (cond.bad())
+		return cond;
+	decoder.setRequestedTags(identifiers.keys());
+
+	std::vector<std::pair<std::string, std::vector<std::string>>> missing; // series, SOPInstanceUIDs
+	std::size_t                                                   missingCount{0};
+	for (const auto &series : seriesUids) {
+		std::set<std::string> instances;
+		UidSink               instanceSink(DCM_SOPInstanceUID, instances);
+		identifiers.setValue(DCM_SeriesInstanceUID, series.c_str());
+		cond = find(identifiers, decoder, priority, instanceSink);
+		if (cond.bad())
+			return cond;
 
-void QueryDefaultCallback::callback(T_DIMSE_C_FindRQ *         request,
-                                    int                        response_count,
-                                    T_DIMSE_C_FindRSP *        response,
-                                    DcmDataset *               response_identifiers,
-                                    const std::string &        dump_filepath,
-                                    std::vector<TagValuePair> &query_tags) {
-	if (DCM_dcmnetLogger.isEnabledFor(OFLogger::DEBUG_LOG_LEVEL)) {
-		OFString temp_string;
-		DCMNET_INFO("Received Find Response " << response_count);
-		DCMNET_DEBUG(DIMSE_dumpMessage(temp_string, *response, DIMSE_INCOMING));
-		if (qrLogger.isEnabledFor(OFLogger::DEBUG_LOG_LEVEL)) {
-			DCMNET_DEBUG("Response Identifiers:" << OFendl << DcmObject::PrintHelper(*response_identifiers));
+		std::vector<std::string> seriesMissing;
+		std::ranges::set_difference(instances, context.m_receivedInstances, std::back_inserter(seriesMissing));
+		if (!seriesMissing.empty()) {
+			missingCount += seriesMissing.size();
+			missing.emplace_back(series, std::move(seriesMissing));
 		}
-	} else if (qrLogger.isEnabledFor(OFLogger::INFO_LOG_LEVEL)) {
-		OFLOG_INFO(qrLogger, "--------------------------");
-		OFLOG_INFO(qrLogger,
-		           "Find Response: " << response_count << " (" << DU_cfindStatusString(response->DimseStatus) << ")");
-		OFLOG_INFO(qrLogger, DcmObject::PrintHelper(*response_identifiers));
-	} else {
-		DCMNET_INFO("Received Find Respinse " << response_count << " (" << DU_cfindStatusString(response->DimseStatus)
-		            << ")");
 	}
 
-	fmt::ostream fileStream = fmt::output_file(dump_filepath.c_str(), fmt::file::WRONLY | fmt::file::APPEND);
-
-	// messy af, ignore
-	OFString imagetype{};
-	response_identifiers->findAndGetOFString(DCM_ImageType, imagetype);
-	OFStandard::toLower(imagetype);
-	if (this->containsFilterWord(imagetype)) {
-		OFLOG_INFO(qrLogger, "Received dataset is derived/secondary data, not writing queried tags");
-		return;
+	if (missingCount == 0) {
+		OFLOG_INFO(qrLogger, fmt::format("Study {}: no instances missing", study_uid));
+		return EC_Normal;
 	}
+	OFLOG_INFO(qrLogger,
+	           fmt::format("Study {}: {} instance(s) missing, requesting them individually", study_uid, missingCount));
 
-	OFString seriesdesc{};
-	response_identifiers->findAndGetOFString(DCM_SeriesDescription, seriesdesc);
-	OFStandard::toLower(seriesdesc);
-	if (this->containsFilterWord(seriesdesc)) {
-		OFLOG_INFO(qrLogger, "Received dataset is topogram/report/processed data, not writing queried tags");
-		return;
-	}
-
-	OFString id, studyuid;
-	response_identifiers->findAndGetOFString(DCM_PatientID, id);
-	response_identifiers->findAndGetOFString(DCM_StudyInstanceUID, studyuid);
-
-	std::string values = fmt::format("{};{};{}", id, studyuid, seriesdesc);
-
-	// it == {DcmTag, OFstring}
-	auto iter = query_tags.begin();
-	while (iter != query_tags.end()) {
-		if (iter != query_tags.end()) {
-			values += ";";
-		}
-
-		if (response_identifiers->findAndGetOFString(iter->first, iter->second).bad()) {
-			OFLOG_INFO(qrLogger,
-			           fmt::format("PatientID={}: tag {} not found/no value in series {}",
-				           id,
-				           DcmTag{iter->first}.getTagName(),
-				           seriesdesc));
-		}
+	const T_ASC_PresentationContextID presID = ASC_findAcceptedPresentationContextID(
+		this->m_assoc, this->m_abstractSyntax.moveSyntax);
+	if (presID == 0)
+		return DIMSE_NOVALIDPRESENTATIONCONTEXTID;
 
-		if (iter->second.empty()) {
-			values += "EMPTY";
-		} else {
-			values += iter->second.c_str();
-		}
+	T_DIMSE_C_MoveRQ request{};
+	std::strncpy(request.AffectedSOPClassUID, this->m_abstractSyntax.moveSyntax, sizeof(request.AffectedSOPClassUID));
+	ASC_getAPTitles(this->m_assoc->params, request.MoveDestination, sizeof(request.MoveDestination), nullptr, 0,
+	                nullptr, 0);
+	request.Priority    = priority;
+	request.DataSetType = DIMSE_DATASET_PRESENT;
 
-		++iter;
-	}
+	MoveCallbackInfo moveCallbackInfo{};
+	moveCallbackInfo.assoc  = this->m_assoc;
+	moveCallbackInfo.presID = presID;
 
-	fileStream.print("{}\n", values);
-	fileStream.close();
+	for (const auto &[series, sopUids] : missing) {
+		for (std::size_t first = 0; first < sopUids.size(); first += INSTANCES_PER_MOVE) {
+			const std::size_t last = std::min(first + INSTANCES_PER_MOVE, sopUids.size());
+			std::string       uidList;
+			for (std::size_t i = first; i < last; ++i) {
+				if (!uidList.empty())
+					uidList += '\\';
+				uidList += sopUids[i];
+			}
 
-	if (this->m_cancelAfterNResponses == response_count) {
-		DCMNET_INFO("Sending Cancel Request (MsgID " << request->MessageID << ", PresID " << OFstatic_cast(unsigned int,
-			            this->m_presID) << ")");
-		OFCondition cond = DIMSE_sendCancelRequest(this->m_assoc, this->m_presID, request->MessageID);
-		if (cond.bad()) {
-			OFString temp_string{};
-			DCMNET_ERROR("Cancel Request Failed: " << DimseCondition::dump(temp_string, cond));
+			DcmDataset requestedDataset;
+			requestedDataset.putAndInsertString(DCM_QueryRetrieveLevel, "IMAGE");
+			requestedDataset.putAndInsertString(DCM_StudyInstanceUID, study_uid.c_str());
+			requestedDataset.putAndInsertString(DCM_SeriesInstanceUID, series.c_str());
+			requestedDataset.putAndInsertString(DCM_SOPInstanceUID, uidList.c_str());
+
+			T_DIMSE_C_MoveRSP response{};
+			DcmDataset *      responseIDs  = nullptr;
+			DcmDataset *      statusDetail = nullptr;
+			request.MessageID              = this->m_assoc->nextMsgID++;
+
+			const std::uint64_t session = this->m_capture != nullptr
+				                              ? this->m_capture->moveRequest(requestedDataset)
+				                              : 0;
+			moveCallbackInfo.capture = this->m_capture;
+			moveCallbackInfo.session = session;
+			context.m_capture        = this->m_capture;
+			context.m_captureSession = session;
+
+			cond = DIMSE_moveUser_(this->m_assoc,
+			                       presID,
+			                       &request,
+			                       &requestedDataset,
+			                       moveCallback,
+			                       &moveCallbackInfo,
+			                       this->m_blockMode,
+			                       this->m_dimseTimeout,
+			                       this->m_net,
+			                       subOpCallback,
+			                       &context,
+			                       &response,
+			                       this->m_cancelAfterNResponses,
+			                       &statusDetail,
+			                       &responseIDs,
+			                       this->m_ignorePendingDatasets,
+			                       study_directory);
+			if (this->m_capture != nullptr && cond.good())
+				this->m_capture->moveResponse(session, response);
+			delete responseIDs;
+			delete statusDetail;
+			if (cond.bad()) {
+				OFString temp_string;
+				OFLOG_ERROR(qrLogger, "Instance Move Request Failed: " << DimseCondition::dump(temp_string, cond));
+				return cond;
+			}
 		}
 	}
-}
-
-bool QueryDefaultCallback::containsFilterWord(const OFString &string_val) const {
-	return std::ranges::any_of(m_filterWords,
-	                           [&string_val](const OFString &word) {
-		                           return string_val.find(word) != OFString_npos;
-	                           });
-}
-
 
-static void progressCallback(void *                 callback_data,
-                             T_DIMSE_C_FindRQ *     request,
-                             int                    response_count,
-                             T_DIMSE_C_FindRSP *    response,
-                             DcmDataset *           response_identifiers,
-                             std::set<std::string> &uid_list) {
-	QueryCallback *callback = OFreinterpret_cast(QueryCallback*, callback_data);
-	if (callback)
-		callback->callback(request, response_count, response, response_identifiers, uid_list);
-}
-
-static void progressCallback(void *                     callback_data,
-                             T_DIMSE_C_FindRQ *         request,
-                             int                        response_count,
-                             T_DIMSE_C_FindRSP *        response,
-                             DcmDataset *               response_identifiers,
-                             const std::string &        dump_filepath,
-                             std::vector<TagValuePair> &query_tags) {
-	QueryCallback *callback = OFreinterpret_cast(QueryCallback*, callback_data);
-	if (callback)
-		callback->callback(request, response_count, response, response_identifiers, dump_filepath, query_tags);
-}
+	for (const auto &[series, sopUids] : missing)
+		still_missing += std::ranges::count_if(sopUids, [&context](const std::string &sop) {
+			return !context.m_receivedInstances.contains(sop);
+		});
 
-OFCondition DIMSE_queryUser(T_ASC_Association *         assoc,
-                            T_ASC_PresentationContextID pres_id,
-                            T_DIMSE_C_FindRQ *          request,
-                            DcmDataset *                request_identifiers,
-                            int                         response_count,
-                            DIMSE_QueryUserCallback     callback, void *callback_data,
-                            T_DIMSE_BlockingMode        block_mode,
-                            int                         timeout,
-                            T_DIMSE_C_FindRSP *         response,
-                            DcmDataset **               status_detail,
-                            std::set<std::string> &     uid_list) {
-	T_DIMSE_Message req{}, rsp{};
-	DIC_US          msgID;
-	DcmDataset *    rspIDs = nullptr;
-	DIC_US          status = STATUS_FIND_Pending_MatchesAreContinuing;
-
-	if (request_identifiers == nullptr) return DIMSE_NULLKEY;
-
-	req.CommandField     = DIMSE_C_FIND_RQ;
-	request->DataSetType = DIMSE_DATASET_PRESENT;
-	req.msg.CFindRQ      = *request;
-
-	msgID = request->MessageID;
-
-	OFCondition cond = DIMSE_sendMessageUsingMemoryData(assoc,
-	                                                    pres_id,
-	                                                    &req,
-	                                                    nullptr,
-	                                                    request_identifiers,
-	                                                    nullptr,
-	                                                    nullptr);
-
-	if (cond.bad()) return cond;
-
-	while (cond == EC_Normal && DICOM_PENDING_STATUS(status)) {
-		if (rspIDs != nullptr) {
-			delete rspIDs;
-			rspIDs = nullptr;
-		}
-
-		// try to recieve C-FIND-RSP over the network
-		cond = DIMSE_receiveCommand(assoc, block_mode, timeout, &pres_id, &rsp, status_detail);
-		if (cond.bad())
-			return cond;
-
-		if (rsp.CommandField != DIMSE_C_FIND_RSP) {
-			std::string buf{
-				fmt::format("DIMSE: Unexpected Response Command Field: {:#04x}",
-				            static_cast<unsigned>(rsp.CommandField))
-			};
-			return makeDcmnetCondition(DIMSEC_UNEXPECTEDRESPONSE, OF_error, buf.c_str());
-		}
-
-		*response = rsp.msg.CFindRSP;
-		if (response->MessageIDBeingRespondedTo != msgID) {
-			std::string buf{
-				fmt::format("DIMSE: Unexpected Response MsgID: {} (expected: {})",
-				            response->MessageIDBeingRespondedTo,
-				            msgID)
-			};
-			return makeDcmnetCondition(DIMSEC_UNEXPECTEDRESPONSE, OF_error, buf.c_str());
-		}
-
-		status = response->DimseStatus;
-		response_count++;
-
-		switch (status) {
-			case STATUS_FIND_Pending_MatchesAreContinuing:
-			case STATUS_FIND_Pending_WarningUnsupportedOptionalKeys:
-				if (*status_detail != nullptr) {
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Pending with statusDetail, ignoring detail");
-					delete*status_detail;
-					*status_detail = nullptr;
-				}
-
-				if (response->DataSetType == DIMSE_DATASET_NULL) {
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Status Pending, but DataSetType==nullptr");
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "Assuming response identifiers are present");
-				}
-
-				cond = DIMSE_receiveDataSetInMemory(assoc, block_mode, timeout, &pres_id, &rspIDs, nullptr, nullptr);
-				if (cond != EC_Normal)
-					return cond;
-
-				if (callback)
-					callback(callback_data, request, response_count, response, rspIDs, uid_list);
-
-				break;
-			case STATUS_FIND_Success:
-				if (response->DataSetType != DIMSE_DATASET_NULL) {
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Status Success, but DataSetType!=nullptr");
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "Assuming no response identifiers are present");
-				}
-				break;
-			default:
-				if (response->DataSetType != DIMSE_DATASET_NULL) {
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Status " << DU_cfindStatusString(status) <<
-					            ", but DataSetType != nullptr");
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "Assuming no response identifiers are present");
-				}
-				break;
-		} // switch end
-	}     // while end
-
-	return cond;
+	if (still_missing > 0)
+		OFLOG_WARN(qrLogger, fmt::format("Study {}: {} instance(s) still missing", study_uid, still_missing));
+	else
+		OFLOG_INFO(qrLogger, fmt::format("Study {}: filled {} missing instance(s)", study_uid, missingCount));
+	return EC_Normal;
 }
 
-OFCondition DIMSE_queryUser(T_ASC_Association *         assoc,
-                            T_ASC_PresentationContextID pres_id,
-                            T_DIMSE_C_FindRQ *          request,
-                            DcmDataset *                request_identifiers,
-                            int                         response_count,
-                            DIMSE_DumpUserCallback      callback, void *callback_data,
-                            T_DIMSE_BlockingMode        block_mode,
-                            int                         timeout,
-                            T_DIMSE_C_FindRSP *         response,
-                            DcmDataset **               status_detail,
-                            const std::string &         dump_filepath,
-                            std::vector<TagValuePair> & query_tags) {
-	T_DIMSE_Message req{}, rsp{};
-	DIC_US          msgID;
-	DcmDataset *    rspIDs = nullptr;
-	DIC_US          status = STATUS_FIND_Pending_MatchesAreContinuing;
-
-	if (request_identifiers == nullptr) return DIMSE_NULLKEY;
-
-	req.CommandField     = DIMSE_C_FIND_RQ;
-	request->DataSetType = DIMSE_DATASET_PRESENT;
-	req.msg.CFindRQ      = *request;
-
-	msgID = request->MessageID;
-
-	OFCondition cond = DIMSE_sendMessageUsingMemoryData(assoc,
-	                                                    pres_id,
-	                                                    &req,
-	                                                    nullptr,
-	                                                    request_identifiers,
-	                                                    nullptr,
-	                                                    nullptr);
-
-	if (cond.bad()) return cond;
-
-	while (cond == EC_Normal && DICOM_PENDING_STATUS(status)) {
-		if (rspIDs != nullptr) {
-			delete rspIDs;
-			rspIDs = nullptr;
-		}
-
-		// try to recieve C-FIND-RSP over the network
-		cond = DIMSE_receiveCommand(assoc, block_mode, timeout, &pres_id, &rsp, status_detail);
-		if (cond.bad())
-			return cond;
-
-		if (rsp.CommandField != DIMSE_C_FIND_RSP) {
-			std::string buf{
-				fmt::format("DIMSE: Unexpected Response Command Field: {:#04x}",
-				            static_cast<unsigned>(rsp.CommandField))
-			};
-			return makeDcmnetCondition(DIMSEC_UNEXPECTEDRESPONSE, OF_error, buf.c_str());
-		}
-
-		*response = rsp.msg.CFindRSP;
-		if (response->MessageIDBeingRespondedTo != msgID) {
-			std::string buf{
-				fmt::format("DIMSE: Unexpected Response MsgID: {} (expected: {})",
-				            response->MessageIDBeingRespondedTo,
-				            msgID)
-			};
-			return makeDcmnetCondition(DIMSEC_UNEXPECTEDRESPONSE, OF_error, buf.c_str());
-		}
-
-		status = response->DimseStatus;
-		response_count++;
-
-		switch (status) {
-			case STATUS_FIND_Pending_MatchesAreContinuing:
-			case STATUS_FIND_Pending_WarningUnsupportedOptionalKeys:
-				if (*status_detail != nullptr) {
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Pending with statusDetail, ignoring detail");
-					delete*status_detail;
-					*status_detail = nullptr;
-				}
-
-				if (response->DataSetType == DIMSE_DATASET_NULL) {
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Status Pending, but DataSetType==nullptr");
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "Assuming response identifiers are present");
-				}
-
-				cond = DIMSE_receiveDataSetInMemory(assoc, block_mode, timeout, &pres_id, &rspIDs, nullptr, nullptr);
-				if (cond != EC_Normal)
-					return cond;
-
-				if (callback)
-					callback(callback_data, request, response_count, response, rspIDs, dump_filepath, query_tags);
-
-				break;
-			case STATUS_FIND_Success:
-				if (response->DataSetType != DIMSE_DATASET_NULL) {
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Status Success, but DataSetType!=nullptr");
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "Assuming no response identifiers are present");
-				}
-				break;
-			default:
-				if (response->DataSetType != DIMSE_DATASET_NULL) {
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "findUser: Status " << DU_cfindStatusString(status) <<
-					            ", but DataSetType != nullptr");
-					DCMNET_WARN(DIMSE_warn_str(assoc) << "Assuming no response identifiers are present");
-				}
-				break;
-		} // switch end
-	}     // while end
-
-	return cond;
+namespace {
+	enum class MoveState {
+		AwaitingResponses,      // C-MOVE-RSP pending, sub-associations accepted
+		DrainingSubAssociation, // final C-MOVE-RSP received, waiting for release of sub-association
+		Done
+	};
+
+	// C-MOVE failed while a C-STORE sub-association was open
+	void abortSubAssociation(T_ASC_Association **sub_assoc) {
+		if (*sub_assoc == nullptr)
+			return;
+		ASC_abortAssociation(*sub_assoc);
+		ASC_dropSCPAssociation(*sub_assoc);
+		ASC_destroyAssociation(sub_assoc);
+	}
 }
 
-
 OFCondition DIMSE_moveUser_(T_ASC_Association *          assoc,
                             T_ASC_PresentationContextID  pres_id,
                             T_DIMSE_C_MoveRQ *           request,
@@ -796,8 +837,7 @@ OFCondition DIMSE_moveUser_(T_ASC_Association *          assoc,
 	DIC_US             msgID;
 	int                responseCount{0};
 	T_ASC_Association *subAssoc = nullptr;
-	DIC_US             status   = STATUS_MOVE_Pending_SubOperationsAreContinuing;
-	OFBool             firstLoop{OFTrue};
+	MoveState          state    = MoveState::AwaitingResponses;
 
 	if (request_identifiers == nullptr)
 		return DIMSE_NULLKEY;
@@ -817,33 +857,39 @@ OFCondition DIMSE_moveUser_(T_ASC_Association *          assoc,
 	if (cond != EC_Normal)
 		return cond;
 
-	// receive responses
-	OFTimer timer;
-	while (cond == EC_Normal && status == STATUS_MOVE_Pending_SubOperationsAreContinuing) {
-		// int readable = selectReadable(assoc, net, subAssoc, block_mode, dimse_timeout);
-
-		switch (selectReadable(assoc, net, subAssoc, block_mode, dimse_timeout)) {
-			case 0:
-				// none are readable, timeout
-				if ((block_mode == DIMSE_BLOCKING) || firstLoop)
-					firstLoop = OFFalse;
-				else if ((block_mode == DIMSE_NONBLOCKING) && (timer.getDiff() > dimse_timeout)) {
-					DCMNET_DEBUG(fmt::format("Timeout of {} seconds elapsed while waiting for C-MOVE Responses",
-						             dimse_timeout));
-					return DIMSE_NODATAAVAILABLE;
-				}
-				continue; // continue with main loop
-			case 1:
-				// main association readable
-				firstLoop = OFFalse;
-				break;
-			case 2:
-				// net/subAssoc readable
+	// blocking mode waits until peer sends something or closes the connection
+	const int waitTimeout = (block_mode == DIMSE_NONBLOCKING) ? dimse_timeout : -1;
+
+	// receive responses and serve sub-operations until final response arrived and sub-association was released
+	while (state != MoveState::Done) {
+		T_ASC_Association *watchedAssoc = (state == MoveState::AwaitingResponses) ? assoc : nullptr;
+		T_ASC_Network *    watchedNet   = (subAssoc == nullptr && state == MoveState::AwaitingResponses) ? net : nullptr;
+
+		switch (waitForMoveEvent(watchedAssoc, watchedNet, subAssoc, waitTimeout)) {
+			case MoveEvent::Timeout:
+				DCMNET_DEBUG(fmt::format("Timeout of {} seconds elapsed while waiting for C-MOVE Responses",
+					             dimse_timeout));
+				abortSubAssociation(&subAssoc);
+				return DIMSE_NODATAAVAILABLE;
+			case MoveEvent::Error: {
+				const std::string buf{
+					fmt::format("DIMSE: Cannot wait for C-MOVE Responses: {}",
+					            OFStandard::getLastNetworkErrorCode().message())
+				};
+				DCMNET_ERROR(buf);
+				abortSubAssociation(&subAssoc);
+				return makeDcmnetCondition(DIMSEC_RECEIVEFAILED, OF_error, buf.c_str());
+			}
+			case MoveEvent::SubAssocRequest:
+			case MoveEvent::SubAssocReadable:
 				if (sub_op_callback) {
 					sub_op_callback(sub_op_callback_data, net, &subAssoc, output_directory, block_mode, dimse_timeout);
 				}
-				firstLoop = OFFalse;
-				continue; // continue with main loop
+				if (state == MoveState::DrainingSubAssociation && subAssoc == nullptr)
+					state = MoveState::Done;
+				continue;
+			case MoveEvent::MainReadable:
+				break;
 		}
 
 		cond = DIMSE_receiveCommand(assoc, block_mode, dimse_timeout, &pres_id, &rsp, status_detail);
@@ -870,7 +916,7 @@ OFCondition DIMSE_moveUser_(T_ASC_Association *          assoc,
 			fmt::print("{}", buf);
 			return makeDcmnetCondition(DIMSEC_UNEXPECTEDRESPONSE, OF_error, buf.c_str());
 		}
-		status = response->DimseStatus;
+		const DIC_US status = response->DimseStatus;
 		responseCount++;
 
 		switch (status) {
@@ -923,159 +969,58 @@ OFCondition DIMSE_moveUser_(T_ASC_Association *          assoc,
 				break;
 		}
 
-		timer.reset();
-		while (subAssoc != nullptr) {
-			if (sub_op_callback)
-				sub_op_callback(sub_op_callback_data, net, &subAssoc, output_directory, block_mode, dimse_timeout);
-		}
+		// final response, stores still in flight are received before returning
+		if (status != STATUS_MOVE_Pending_SubOperationsAreContinuing)
+			state = (subAssoc != nullptr) ? MoveState::DrainingSubAssociation : MoveState::Done;
 	}
 	return cond;
 }
 
-OFCondition QueryRetriever::dumpTags(const PatientRecord &      patient_record,
-                                     const std::string &        dump_filepath,
-                                     std::vector<TagValuePair> &query_tags,
-                                     QueryCallback *            callback) const {
-	OFCondition       cond = EC_Normal;
-	T_DIMSE_C_FindRQ  request{};
-	T_DIMSE_C_FindRSP response{};
-	OFString          temp_string{};
-
-	const T_ASC_PresentationContextID presID = ASC_findAcceptedPresentationContextID(
-		 m_assoc,
-		 m_abstractSyntax.findSyntax);
-
-	if (presID == 0) {
-		OFLOG_FATAL(qrLogger, "No presentation context");
-		return DIMSE_NOVALIDPRESENTATIONCONTEXTID;
+T_DIMSE_Priority toDimsePriority(const RecordPriority priority) {
+	switch (priority) {
+		case RecordPriority::HIGH: return DIMSE_PRIORITY_HIGH;
+		case RecordPriority::LOW: return DIMSE_PRIORITY_LOW;
+		default: return DIMSE_PRIORITY_MEDIUM;
 	}
-
-	OFStandard::strlcpy(request.AffectedSOPClassUID,
-	                    m_abstractSyntax.findSyntax,
-	                    sizeof(request.AffectedSOPClassUID));
-
-	request.DataSetType = DIMSE_DATASET_NULL;
-	request.Priority = DIMSE_PRIORITY_HIGH;
-
-	constexpr int responseCount{0};
-	int repeatCount{1};
-
-	QueryDefaultCallback defaultCallback(m_cancelAfterNResponses);
-	if (callback == nullptr) callback = &defaultCallback;
-	callback->setAssociation(m_assoc);
-	callback->setPresentationContextID(presID);
-
-	DcmFileFormat fileformat;
-	DcmDataset *requestedDataset = fileformat.getDataset();
-	requestedDataset->putAndInsertString(DCM_QueryRetrieveLevel, "SERIES");
-	requestedDataset->putAndInsertString(DCM_PatientID, patient_record.m_id.c_str());
-	requestedDataset->putAndInsertString(DCM_SeriesDescription, "");
-
-	// filter out service/dose reports, secondary/derived images
-	requestedDataset->putAndInsertString(DCM_Modality, patient_record.m_modality.c_str());
-	requestedDataset->putAndInsertString(DCM_ImageType, "");
-
-	// receive C-FIND response with requested tags (override_tags) for each study
-	for (const auto &uid : patient_record.m_uid_list) {
-		requestedDataset->putAndInsertString(DCM_StudyInstanceUID, uid.c_str());
-
-		for (const auto &pair : query_tags) {
-			requestedDataset->putAndInsertString(pair.first, pair.second.c_str());
-		}
-
-		while (cond.good() && repeatCount--) {
-			DcmDataset *statusDetail = nullptr;
-			request.MessageID        = m_assoc->nextMsgID++;
-
-			OFLOG_INFO(qrLogger, fmt::format("Sending FIND Request (MsgID {})\n", request.MessageID));
-			cond = DIMSE_queryUser(m_assoc,
-			                       presID,
-			                       &request,
-			                       requestedDataset,
-			                       responseCount,
-			                       progressCallback,
-			                       callback,
-			                       m_blockMode,
-			                       m_dimseTimeout,
-			                       &response,
-			                       &statusDetail,
-			                       dump_filepath,
-			                       query_tags);
-		}
-	}
-
-
-	// DcmPathProcessor proc;
-	// for (const auto &[key, val] : tags) {
-	// 	cond = proc.applyPathWithValue(requestedDataset, key.c_str());
-	// 	if (cond.bad()) {
-	// 		DCMNET_ERROR("bad override tag: " << key);
-	// 		return cond;
-	// 	}
-	// }
-
-
-
-	return cond;
 }
 
-DcmTag prepareQueryTag(OFConsoleApplication &app, const char *tag_string) {
+OFCondition parseQueryTag(const char *tag_string, DcmTag &tag, std::string &error_msg) {
 	unsigned int g = 0xffff;
 	unsigned int e = 0xffff;
 
-	int n = 0;
-	OFString dicname, valstr;
-	OFString msg;
-
-	// char msg2[200];
+	OFString dicname;
 
-	n = sscanf(tag_string, "%x,%x=", &g, &e);
+	const int     n       = sscanf(tag_string, "%x,%x=", &g, &e);
 	const OFString toParse = tag_string;
-	const size_t eqPos = toParse.find("=");
+	const size_t  eqPos   = toParse.find("=");
 
 	if (n < 2) {
-		if (eqPos != OFString_npos) {
-			dicname = toParse.substr(0, eqPos);
-			valstr = toParse.substr(eqPos + 1, toParse.length());
-		} else {
-			dicname = tag_string;
-			DcmTagKey key{0xffff, 0xffff};
-			const DcmDataDictionary &globalDataDict = dcmDataDict.rdlock();
-			const DcmDictEntry *dicent = globalDataDict.findEntry(dicname.c_str());
-			dcmDataDict.rdunlock();
-
-			if (dicent != nullptr) {
-				key = dicent->getKey();
-				g = key.getGroup();
-				e = key.getElement();
-			} else {
-				msg = "bad key format or dictionary name not found in dictionary: " + dicname;
-				app.printError(msg.c_str());
-			}
-		}
-	} else {
-		if (eqPos != OFString_npos) {
-			valstr = toParse.substr(eqPos + 1, toParse.length());
+		dicname = toParse.substr(0, eqPos);
+
+		const DcmDataDictionary &globalDataDict = dcmDataDict.rdlock();
+		const DcmDictEntry *     dicent         = globalDataDict.findEntry(dicname.c_str());
+		dcmDataDict.rdunlock();
+
+		if (dicent == nullptr) {
+			error_msg = fmt::format("bad key format or dictionary name not found in dictionary: {}", dicname.c_str());
+			return EC_TagNotFound;
 		}
+		g = dicent->getKey().getGroup();
+		e = dicent->getKey().getElement();
 	}
-	DcmTag tag{OFstatic_cast(Uint16, g), OFstatic_cast(Uint16, e)};
+
+	tag = DcmTag{OFstatic_cast(Uint16, g), OFstatic_cast(Uint16, e)};
 	if (tag.error() != EC_Normal) {
-		const std::string error_msg = fmt::format("unknown tag: ({:04x},{:04x})", g, e);
-		app.printError(error_msg.c_str());
+		error_msg = fmt::format("unknown tag: ({:04x},{:04x})", g, e);
+		return tag.error();
 	}
+	return EC_Normal;
+}
 
-	// DcmElement *elem = DcmItem::newDicomElement(tag);
-	// if (elem == nullptr) {
-	// 	const std::string error_msg = fmt::format("cannot create element for tag: ({:04x},{:04x})", g, e);
-	// 	app.printError(error_msg.c_str());
-	// }
-	//
-	// if (!valstr.empty()) {
-	// 	if (elem->putString(valstr.c_str()).bad()) {
-	// 		const std::string error_msg = fmt::format("cannot put tag value: ({:04x},{:04x})=\"{}\"", g, e, valstr.c_str());
-	// 		app.printError(error_msg.c_str());
-	// 	}
-	// }
-
+DcmTag prepareQueryTag(OFConsoleApplication &app, const char *tag_string) {
+	DcmTag      tag;
+	std::string error_msg;
+	if (parseQueryTag(tag_string, tag, error_msg).bad())
+		app.printError(error_msg.c_str());
 	return tag;
-}
\ No newline at end of file
+}
@@ -0,0 +1,132 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "TransferPlan.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+
+#include "fmt/chrono.h"
+#include "fmt/format.h"
+
+#include "Utility.hpp"
+
+namespace {
+	constexpr const char *  COLUMNS{"# PatientID\tStudyDate\tStudyInstanceUID\tModalitiesInStudy\t"
+	                                "NumberOfStudyRelatedSeries\tNumberOfStudyRelatedInstances\tEstimatedBytes\tPriority"};
+	constexpr std::size_t   COLUMN_COUNT{8};
+
+	const char *priorityName(const RecordPriority priority) {
+		switch (priority) {
+			case RecordPriority::HIGH:
+				return "high";
+			case RecordPriority::LOW:
+				return "low";
+			default:
+				return "medium";
+		}
+	}
+
+	bool parseLine(const std::string &line, PlannedStudy &planned) {
+		std::vector<std::string> fields = splitFields(line, '\t');
+		if (fields.size() != COLUMN_COUNT || fields[2].empty())
+			return false;
+
+		if (!parseNumber(fields[4], planned.m_study.m_series) || !parseNumber(fields[5], planned.m_study.m_instances) ||
+		    !parseNumber(fields[6], planned.m_estimatedBytes) || !parseRecordPriority(fields[7], planned.m_priority))
+			return false;
+
+		planned.m_study.m_patientId  = std::move(fields[0]);
+		planned.m_study.m_date       = std::move(fields[1]);
+		planned.m_study.m_uid        = std::move(fields[2]);
+		planned.m_study.m_modalities = std::move(fields[3]);
+		return true;
+	}
+}
+
+PlanSummary summarizePlan(const std::vector<PlannedStudy> &studies, const double throughput) {
+	PlanSummary summary;
+	summary.m_throughput = throughput;
+	for (const auto &planned : studies) {
+		summary.m_instances += planned.m_study.m_instances;
+		summary.m_estimatedBytes += planned.m_estimatedBytes;
+		if (planned.m_study.m_instances == 0)
+			++summary.m_unknownSize;
+	}
+	return summary;
+}
+
+std::string formatPlanDuration(const PlanSummary &summary) {
+	if (summary.m_throughput <= 0)
+		return "unknown";
+
+	const auto minutes = static_cast<std::uint64_t>(
+		std::ceil(static_cast<double>(summary.m_estimatedBytes) / summary.m_throughput / 60));
+	if (minutes < 60)
+		return fmt::format("{}min", minutes);
+	return fmt::format("{}h {}min", minutes / 60, minutes % 60);
+}
+
+bool writeTransferPlan(const std::filesystem::path &     path,
+                       const std::vector<PlannedStudy> &studies,
+                       const PlanSummary &              summary,
+                       std::string &                    error_msg) {
+	const auto    time = std::chrono::system_clock::now();
+	const auto    tt   = std::chrono::system_clock::to_time_t(time);
+	const std::tm tm   = *std::localtime(&tt);
+
+	std::ofstream file{path, std::ios::trunc};
+	file << fmt::format("# fnostudyqr plan {:%Y-%m-%d %H:%M:%S}\n", tm);
+	file << fmt::format("# studies {}, instances {}, estimated {} MiB, {} without instance count\n",
+	                    studies.size(), summary.m_instances, summary.m_estimatedBytes / MIB, summary.m_unknownSize);
+	file << fmt::format("# throughput {:.1f} MiB/s, duration {}\n", summary.m_throughput / MIB,
+	                    formatPlanDuration(summary));
+	file << COLUMNS << '\n';
+	for (const auto &planned : studies) {
+		const StudyInfo &study = planned.m_study;
+		file << fmt::format("{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\n",
+		                    study.m_patientId,
+		                    study.m_date,
+		                    study.m_uid,
+		                    study.m_modalities,
+		                    study.m_series,
+		                    study.m_instances,
+		                    planned.m_estimatedBytes,
+		                    priorityName(planned.m_priority));
+	}
+
+	file.flush();
+	if (!file) {
+		error_msg = fmt::format("Cannot write plan {}", path.string());
+		return false;
+	}
+	return true;
+}
+
+bool readTransferPlan(const std::filesystem::path &path, std::vector<PlannedStudy> &studies, std::string &error_msg) {
+	std::ifstream file{path};
+	if (!file) {
+		error_msg = fmt::format("Cannot open plan {}", path.string());
+		return false;
+	}
+
+	std::string line;
+	std::size_t lineNumber{0};
+	while (std::getline(file, line)) {
+		++lineNumber;
+		if (line.empty() || line.front() == '#')
+			continue;
+
+		PlannedStudy planned;
+		if (!parseLine(line, planned)) {
+			error_msg = fmt::format("Plan {}, line {}: expected {} tab separated columns", path.string(), lineNumber,
+			                        COLUMN_COUNT);
+			return false;
+		}
+		studies.push_back(std::move(planned));
+	}
+	return true;
+}
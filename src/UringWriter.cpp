@@ -0,0 +1,211 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "UringWriter.hpp"
+
+#ifdef FNOSTUDYQR_WITH_URING
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <liburing.h>
+#include <unistd.h>
+
+#include "fmt/format.h"
+#endif
+
+bool parseWriteBackend(const std::string_view value, WriteBackend &backend) {
+	if (value == "stdio")
+		backend = WriteBackend::STDIO;
+#ifdef FNOSTUDYQR_WITH_URING
+	else if (value == "io_uring")
+		backend = WriteBackend::IO_URING;
+	else if (value == "io_uring-direct")
+		backend = WriteBackend::IO_URING_DIRECT;
+#endif
+	else
+		return false;
+	return true;
+}
+
+#ifdef FNOSTUDYQR_WITH_URING
+
+UringWriter::UringWriter() = default;
+
+UringWriter::~UringWriter() {
+	if (m_ring == nullptr)
+		return;
+
+	// kernel may still read from buffers
+	(void) this->drain();
+	io_uring_queue_exit(m_ring.get());
+	std::free(m_memory);
+}
+
+bool UringWriter::open(const bool direct, std::string &error_msg) {
+	m_ring = std::make_unique<io_uring>();
+	if (const int ret = io_uring_queue_init(QUEUE_DEPTH, m_ring.get(), 0); ret < 0) {
+		error_msg = fmt::format("Cannot set up io_uring: {}", std::strerror(-ret));
+		m_ring.reset();
+		return false;
+	}
+
+	m_memory = static_cast<char *>(std::aligned_alloc(DIRECT_ALIGNMENT, QUEUE_DEPTH * BUFFER_SIZE));
+	if (m_memory == nullptr) {
+		error_msg = "Cannot allocate io_uring buffers";
+		io_uring_queue_exit(m_ring.get());
+		m_ring.reset();
+		return false;
+	}
+
+	m_direct = direct;
+	m_lengths.assign(QUEUE_DEPTH, 0);
+	m_free.clear();
+	for (std::size_t i = QUEUE_DEPTH; i > 0; --i)
+		m_free.push_back(i - 1);
+	return true;
+}
+
+char *UringWriter::acquire() {
+	while (!m_failed && m_free.empty()) {
+		this->submit();
+		if (!this->reap())
+			m_failed = true;
+	}
+	if (m_failed)
+		return nullptr;
+
+	const std::size_t index = m_free.back();
+	m_free.pop_back();
+	return m_memory + index * BUFFER_SIZE;
+}
+
+void UringWriter::queue(const int fd, char *buffer, const std::size_t length, const std::uint64_t offset) {
+	const std::size_t index = static_cast<std::size_t>(buffer - m_memory) / BUFFER_SIZE;
+
+	// one entry per buffer, the ring never runs out of them
+	io_uring_sqe *sqe = io_uring_get_sqe(m_ring.get());
+	io_uring_prep_write(sqe, fd, buffer, static_cast<unsigned int>(length), offset);
+	io_uring_sqe_set_data64(sqe, index);
+	m_lengths[index] = length;
+	++m_queued;
+	++m_inFlight;
+}
+
+bool UringWriter::drain() {
+	this->submit();
+	while (m_inFlight > 0) {
+		if (!this->reap()) {
+			m_failed = true;
+			break;
+		}
+	}
+
+	const bool written = !m_failed;
+	m_failed           = false;
+	return written;
+}
+
+void UringWriter::submit() {
+	if (m_queued == 0)
+		return;
+	if (io_uring_submit(m_ring.get()) < 0)
+		m_failed = true;
+	m_queued = 0;
+}
+
+bool UringWriter::reap() {
+	io_uring_cqe *cqe = nullptr;
+	int           ret;
+	while ((ret = io_uring_wait_cqe(m_ring.get(), &cqe)) == -EINTR) {}
+	if (ret < 0)
+		return false;
+
+	// short writes to regular files mean the disk is full
+	const std::size_t index = io_uring_cqe_get_data64(cqe);
+	if (cqe->res < 0 || static_cast<std::size_t>(cqe->res) != m_lengths[index])
+		m_failed = true;
+	io_uring_cqe_seen(m_ring.get(), cqe);
+
+	m_free.push_back(index);
+	--m_inFlight;
+	return true;
+}
+
+UringFileConsumer::UringFileConsumer(UringWriter &writer, const std::string &path, const std::uint64_t size_hint)
+	: m_writer(writer) {
+	constexpr int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+	if (writer.direct()) {
+		m_fd     = ::open(path.c_str(), flags | O_DIRECT, 0644);
+		m_direct = m_fd >= 0;
+	}
+	// filesystems like tmpfs refuse O_DIRECT
+	if (m_fd < 0)
+		m_fd = ::open(path.c_str(), flags, 0644);
+	if (m_fd < 0) {
+		m_status = EC_InvalidStream;
+		return;
+	}
+
+	// contiguous extents for the whole instance instead of growing per write
+	if (size_hint > 0 && ::fallocate(m_fd, 0, 0, static_cast<off_t>(size_hint)) == 0)
+		m_allocated = size_hint;
+}
+
+UringFileConsumer::~UringFileConsumer() {
+	(void) this->close();
+}
+
+std::size_t UringFileConsumer::store(const void *buf, const std::size_t length) {
+	const char *data = static_cast<const char *>(buf);
+	std::size_t stored{0};
+	while (stored < length) {
+		if (m_buffer == nullptr && (m_buffer = m_writer.acquire()) == nullptr)
+			break;
+
+		const std::size_t count = std::min(length - stored, UringWriter::BUFFER_SIZE - m_filled);
+		std::memcpy(m_buffer + m_filled, data + stored, count);
+		m_filled += count;
+		stored += count;
+
+		if (m_filled == UringWriter::BUFFER_SIZE) {
+			m_writer.queue(m_fd, m_buffer, m_filled, m_offset);
+			m_offset += m_filled;
+			m_buffer = nullptr;
+			m_filled = 0;
+		}
+	}
+	return stored;
+}
+
+OFCondition UringFileConsumer::close() {
+	if (m_fd < 0)
+		return m_status;
+
+	// O_DIRECT writes whole blocks, padding is trimmed below
+	if (m_buffer != nullptr) {
+		std::size_t length = m_filled;
+		if (m_direct) {
+			length = (m_filled + UringWriter::DIRECT_ALIGNMENT - 1) / UringWriter::DIRECT_ALIGNMENT *
+			         UringWriter::DIRECT_ALIGNMENT;
+			std::memset(m_buffer + m_filled, 0, length - m_filled);
+			m_allocated = std::max(m_allocated, m_offset + length);
+		}
+		m_writer.queue(m_fd, m_buffer, length, m_offset);
+		m_buffer = nullptr;
+	}
+
+	if (!m_writer.drain() && m_status.good())
+		m_status = EC_WriteError;
+	if (m_allocated > this->size() && ::ftruncate(m_fd, static_cast<off_t>(this->size())) != 0 && m_status.good())
+		m_status = EC_WriteError;
+	if (::close(m_fd) != 0 && m_status.good())
+		m_status = EC_WriteError;
+	m_fd = -1;
+	return m_status;
+}
+
+#endif
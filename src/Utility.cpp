@@ -0,0 +1,49 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include "Utility.hpp"
+
+#include <fstream>
+
+#include "fmt/format.h"
+
+std::vector<std::string> splitFields(const std::string_view line, const char separator) {
+	std::vector<std::string> fields;
+	std::size_t              start{0};
+	while (true) {
+		const std::size_t end = line.find(separator, start);
+		fields.emplace_back(line.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start));
+		if (end == std::string_view::npos)
+			break;
+		start = end + 1;
+	}
+	return fields;
+}
+
+bool writeFileAtomically(const std::filesystem::path &                path,
+                         const std::function<void(std::ostream &)> &write_content,
+                         std::string &                               error_msg) {
+	std::filesystem::path partPath = path;
+	partPath += ".part";
+
+	std::error_code ec;
+	{
+		std::ofstream file{partPath, std::ios::trunc};
+		write_content(file);
+		file.flush();
+		if (!file) {
+			error_msg = fmt::format("Cannot write {}", partPath.string());
+			std::filesystem::remove(partPath, ec);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(partPath, path, ec);
+	if (ec) {
+		error_msg = fmt::format("Cannot write {}: {}", path.string(), ec.message());
+		std::filesystem::remove(partPath, ec);
+		return false;
+	}
+	return true;
+}
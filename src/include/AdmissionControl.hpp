@@ -0,0 +1,69 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef ADMISSIONCONTROL_HPP
+#define ADMISSIONCONTROL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "SizeModel.hpp"
+
+struct AdmissionLimits {
+	std::uint64_t m_minFreeBytes{0};  // kept free on output volume after projected moves, 0: not checked
+	std::uint64_t m_maxDirtyBytes{0}; // page cache not written back yet, 0: not checked
+	unsigned int  m_pollInterval{5};  // seconds between checks while paused
+};
+
+/*
+ * Moves are admitted one study at a time. Each study reserves its estimated size until it finishes,
+ * new moves wait while free space minus reservations would drop below the limit or while too much
+ * received data still sits in page cache. Shared by all workers, averages are learned from finished moves.
+ */
+class AdmissionControl {
+public:
+	explicit AdmissionControl(const AdmissionLimits &limits) : m_limits(limits) {}
+
+	bool enabled() const { return m_limits.m_minFreeBytes > 0 || m_limits.m_maxDirtyBytes > 0; }
+
+	/*
+	 * NumberOfStudyRelatedInstances times largest average instance size of ModalitiesInStudy,
+	 * learned from moves or typical size of the modality. 0 if instances are unknown.
+	 * Sizes persisted in directory by earlier runs are loaded once per directory.
+	 */
+	std::uint64_t estimate(const std::filesystem::path &directory, std::string_view modalities, unsigned int instances);
+
+	// blocks until bytes fit within limits and reserves them, false if stopped meanwhile
+	bool admit(const std::filesystem::path &directory, std::uint64_t bytes);
+
+	void release(std::uint64_t bytes);
+
+	// size of finished move, updates averages of its modalities
+	void record(std::string_view modalities, unsigned int instances, std::uint64_t bytes);
+
+	// paused moves are refused, e.g. on service shutdown
+	void stop();
+
+private:
+	// mutex held, reason says which limit is crossed
+	bool fits(const std::filesystem::path &directory, std::uint64_t bytes, std::string &reason) const;
+
+	AdmissionLimits         m_limits;
+	mutable std::mutex      m_mutex;
+	std::condition_variable m_released;
+	std::uint64_t           m_reserved{0};
+	bool                    m_stopped{false};
+	SizeModel               m_sizes;
+	std::filesystem::path   m_sizesDirectory{};
+	bool                    m_sizesLoaded{false};
+};
+
+// Dirty + Writeback of /proc/meminfo, 0 where not available
+std::uint64_t dirtyPageCacheBytes();
+
+#endif //ADMISSIONCONTROL_HPP
@@ -5,6 +5,10 @@
 #ifndef CALLBACKS_HPP
 #define CALLBACKS_HPP
 
+#include <cstdint>
+#include <set>
+#include <string>
+
 #include "dcmtk/config/osconfig.h"
 #include "dcmtk/dcmdata/dcfilefo.h"
 #include "dcmtk/dcmdata/dcmetinf.h"
@@ -14,15 +18,45 @@
 
 #include "fmt/format.h"
 
+class SessionCapture;
+
 typedef struct {
 	T_ASC_Association *         assoc;
 	T_ASC_PresentationContextID presID;
+	SessionCapture *            capture; // pending responses are recorded if set
+	std::uint64_t               session;
 } MoveCallbackInfo;
 
+class ContentStore;
+class InstanceIndex;
+class StudyArchive;
+class StudyManifest;
+class UringWriter;
+class RateLimiter;
+
+// receiving side of one C-MOVE, passed to sub-operation callbacks as callback data
+struct ReceiveContext {
+	std::set<std::string> m_receivedInstances{}; // SOPInstanceUIDs stored without error
+	InstanceIndex *       m_index{nullptr};      // stored instances are added if set
+	ContentStore *        m_store{nullptr};      // instances are written into shared store and linked if set
+	bool                  m_perSeries{false};    // instances go to <study>/<SeriesInstanceUID>/
+	std::set<std::string> m_seriesDirectories{}; // created during this move, checked once per series
+	StudyArchive *        m_archive{nullptr};    // instances are appended to study archive instead of files if set
+	StudyManifest *       m_manifest{nullptr};   // stored instances are listed with hashes if set
+	bool                  m_sha256{false};       // SHA-256 computed besides XXH64
+	UringWriter *         m_uring{nullptr};      // instance files are written through io_uring if set
+	std::uint64_t         m_sizeHint{0};         // size of last instance, next file is preallocated to it
+	unsigned int          m_storedInstances{0};  // written during this move
+	std::uint64_t         m_storedBytes{0};
+	RateLimiter *         m_rateLimiter{nullptr};   // received data is read at limited rate if set
+	SessionCapture *      m_capture{nullptr};       // stores are recorded under m_captureSession if set
+	std::uint64_t         m_captureSession{0};
+};
+
 struct StoreCallbackData {
 	OFString           m_filename;
-	DcmFileFormat *    m_fileformat{nullptr};
 	T_ASC_Association *m_assoc{nullptr};
+	ReceiveContext *   m_context{nullptr};
 };
 
 typedef void (*DIMSE_MoveUserCallback_)(
@@ -59,12 +93,12 @@ void storeSCPCallback( /* in */
 	T_DIMSE_StoreProgress *progress,
 	T_DIMSE_C_StoreRQ *    in_request,
 	char *                 filename,
-	DcmDataset **          in_dataset,
 	/* out */
 	T_DIMSE_C_StoreRSP *out_response,
 	DcmDataset **       status_detail);
 
-void subOpCallback(void * /* subOpCallbackData */,
+// sub_op_callback_data is ReceiveContext or nullptr
+void subOpCallback(void *                     sub_op_callback_data,
                    T_ASC_Network *            assoc_net,
                    T_ASC_Association **       sub_assoc,
                    const std::string &        output_directory,
@@ -77,7 +111,8 @@ OFCondition storeSCP(T_ASC_Association *         assoc,
                      T_ASC_PresentationContextID pres_id,
                      const std::string &         output_directory,
                      T_DIMSE_BlockingMode        block_mode,
-                     int                         dimse_timeout);
+                     int                         dimse_timeout,
+                     ReceiveContext *            context);
 
 OFCondition echoSCP(T_ASC_Association *         assoc,
                     T_DIMSE_Message *           message,
@@ -89,13 +124,26 @@ OFCondition acceptSubAssoc(T_ASC_Network *     assoc_net,
 OFCondition subOpSCP(T_ASC_Association ** sub_assoc,
                      const std::string &  output_directory,
                      T_DIMSE_BlockingMode block_mode,
-                     int                  dimse_timeout);
+                     int                  dimse_timeout,
+                     ReceiveContext *     context);
+
+// readiness reported by waitForMoveEvent
+enum class MoveEvent {
+	Timeout,          // nothing readable within timeout
+	MainReadable,     // C-MOVE-RSP (or other data) waiting on main association
+	SubAssocRequest,  // incoming association request on receive port
+	SubAssocReadable, // C-STORE/C-ECHO/release waiting on sub-association
+	Error,            // select() failed, waiting again would fail the same way
+};
 
-int selectReadable(T_ASC_Association *  assoc,
-                   T_ASC_Network *      net,
-                   T_ASC_Association *  sub_assoc,
-                   T_DIMSE_BlockingMode block_mode,
-                   int                  timeout);
+/*
+ * Blocks until one of the watched sockets is readable, nullptr arguments are not watched.
+ * Negative timeout (seconds) waits indefinitely, interrupted waits are resumed.
+ */
+MoveEvent waitForMoveEvent(T_ASC_Association *assoc,
+                           T_ASC_Network *    net,
+                           T_ASC_Association *sub_assoc,
+                           int                timeout);
 
 
 #endif //CALLBACKS_HPP
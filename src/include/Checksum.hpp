@@ -0,0 +1,53 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// streaming XXH64, fed with bytes as they are written
+class XxHash64 {
+public:
+	explicit XxHash64(std::uint64_t seed = 0);
+
+	void update(const void *data, std::size_t length);
+
+	std::uint64_t digest() const;
+
+private:
+	std::uint64_t m_seed;
+	std::uint64_t m_accumulators[4];
+	unsigned char m_buffer[32]{};
+	std::size_t   m_bufferSize{0};
+	std::uint64_t m_totalLength{0};
+};
+
+// streaming SHA-256, optional second digest for manifests
+class Sha256 {
+public:
+	Sha256();
+
+	void update(const void *data, std::size_t length);
+
+	// 64 lowercase hex digits
+	std::string hexDigest() const;
+
+private:
+	void compress(const unsigned char *block);
+
+	std::uint32_t m_state[8];
+	unsigned char m_buffer[64]{};
+	std::size_t   m_bufferSize{0};
+	std::uint64_t m_totalLength{0};
+};
+
+// 16 lowercase hex digits
+std::string formatChecksum(std::uint64_t checksum);
+
+bool parseChecksum(const std::string &value, std::uint64_t &checksum);
+
+#endif //CHECKSUM_HPP
@@ -0,0 +1,59 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef CONTENTSTORE_HPP
+#define CONTENTSTORE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "InstanceIndex.hpp"
+#include "OutputLayout.hpp"
+
+// dst is replaced by a hard link to src, reflink or copy where links are not possible
+bool linkInstanceFile(const std::filesystem::path &src, const std::filesystem::path &dst, std::error_code &ec);
+
+/*
+ * Instances shared by output directories of different runs, stored once under
+ * objects/<hash prefix>/<hash>-<file name> where the file name carries the SOPInstanceUID.
+ * Output directories only get links to the objects, the store has its own InstanceIndex.
+ */
+class ContentStore {
+public:
+	bool open(const std::filesystem::path &directory, std::string &error_msg);
+
+	const std::filesystem::path &directory() const { return m_index.directory(); }
+
+	const InstanceIndex &index() const { return m_index; }
+
+	// unique partial file for an instance being received
+	std::filesystem::path partPath(const std::string &filename);
+
+	/*
+	 * Moves completely received part into the store, an identical object already stored is kept.
+	 * instance.m_path is the file name in output directory, it is replaced by the object path.
+	 * Returns object path, empty on failure.
+	 */
+	std::filesystem::path commit(const std::filesystem::path &part, IndexedInstance instance, std::error_code &ec);
+
+	/*
+	 * Links stored instances of study into study_directory by layout.
+	 * Returns instances linked, m_path relative to study_directory.
+	 */
+	std::vector<IndexedInstance> materialize(const std::string &          study_uid,
+	                                         const std::filesystem::path &study_directory,
+	                                         const OutputLayout &         layout) const;
+
+private:
+	InstanceIndex              m_index;
+	std::uint64_t              m_session{0}; // distinguishes parts of processes sharing the store
+	std::atomic<std::uint64_t> m_parts{0};
+};
+
+#endif //CONTENTSTORE_HPP
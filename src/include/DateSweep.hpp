@@ -0,0 +1,75 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef DATESWEEP_HPP
+#define DATESWEEP_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "PatientRecord.hpp"
+#include "QueryPlanner.hpp"
+#include "QuerySinks.hpp"
+#include "StudyQueryRetriever.hpp"
+
+struct SweepOptions {
+	unsigned int findLimit{0};   // matches returned by PACS at most, 0: rely on Refused: Out of Resources
+	unsigned int concurrency{4}; // associations querying windows in parallel
+};
+
+// result of C-FIND looks truncated by PACS limit
+bool findResultCapped(std::size_t results, DIC_US status, unsigned int find_limit);
+
+/*
+ * Sweeps a StudyDate range with C-FIND, windows hitting the PACS result limit are bisected by date
+ * and single days by StudyTime until the results fit. Windows are queried concurrently over own
+ * associations on the prototype's network, each StudyInstanceUID is reported once.
+ */
+class DateSweep {
+public:
+	using StudyCallback = std::function<void(const StudyInfo &)>;
+
+	DateSweep(const QueryRetriever &prototype, std::string modalities, SweepOptions options);
+
+	// query's StudyDate must be a closed date or range, PatientID may be empty (universal matching)
+	OFCondition run(const PatientRecord &query, const StudyCallback &on_study);
+
+	std::size_t queries() const { return m_queries; }
+
+	std::size_t splits() const { return m_splits; }
+
+private:
+	// StudyDate range, StudyTime in seconds of day, whole day if single day isn't split yet
+	struct Window {
+		DateRange m_range{};
+		int       m_firstSecond{0};
+		int       m_lastSecond{24 * 60 * 60 - 1};
+	};
+
+	void work(const PatientRecord &query, const StudyCallback &on_study);
+
+	void queryWindow(QueryRetriever &retriever, const PatientRecord &query, const Window &window,
+	                 const StudyCallback &on_study);
+
+	const QueryRetriever &m_prototype;
+	std::string           m_modalities;
+	SweepOptions          m_options;
+
+	std::mutex                      m_mutex;
+	std::condition_variable         m_condition;
+	std::deque<Window>              m_windows;
+	std::size_t                     m_pending{0}; // queued or being queried
+	std::unordered_set<std::string> m_seen;
+	OFCondition                     m_result{EC_Normal};
+	OFCondition                     m_setupResult{EC_Normal}; // last worker failing to negotiate association
+	std::size_t                     m_queries{0};
+	std::size_t                     m_splits{0};
+};
+
+#endif //DATESWEEP_HPP
@@ -0,0 +1,65 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef INSTANCEINDEX_HPP
+#define INSTANCEINDEX_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct IndexedInstance {
+	std::string   m_studyUid{};
+	std::string   m_seriesUid{};
+	std::string   m_sopUid{};
+	std::string   m_path{};     // relative to indexed directory
+	std::uint64_t m_size{0};
+	std::uint64_t m_checksum{0}; // XXH64 of file
+	std::string   m_transferSyntax{};
+};
+
+/*
+ * Instances received into an output directory, kept in <directory>/.fnostudyqr-index.
+ * One tab separated line per instance is appended as instances arrive, later lines
+ * replace earlier ones of the same SOPInstanceUID, a torn last line is ignored.
+ * TransferSyntaxUID column is missing in lines of older versions.
+ */
+class InstanceIndex {
+public:
+	static constexpr const char *FILENAME{".fnostudyqr-index"};
+
+	bool open(const std::filesystem::path &directory, std::string &error_msg);
+
+	const std::filesystem::path &directory() const { return m_directory; }
+
+	// thread safe, instances are appended by receive of each worker
+	void add(IndexedInstance instance);
+
+	// indexed and still on disk with recorded size
+	bool contains(const std::string &sop_uid) const;
+
+	// SOPInstanceUIDs of study passing contains()
+	std::set<std::string> instances(const std::string &study_uid) const;
+
+	// entries of study passing contains()
+	std::vector<IndexedInstance> entries(const std::string &study_uid) const;
+
+	std::size_t size() const;
+
+private:
+	bool present(const IndexedInstance &instance) const;
+
+	std::filesystem::path                                  m_directory;
+	std::ofstream                                          m_file;
+	std::unordered_map<std::string, IndexedInstance>       m_instances; // by SOPInstanceUID
+	std::unordered_map<std::string, std::set<std::string>> m_studies;   // SOPInstanceUIDs by StudyInstanceUID
+	mutable std::mutex                                     m_mutex;
+};
+
+#endif //INSTANCEINDEX_HPP
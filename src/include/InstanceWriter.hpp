@@ -0,0 +1,105 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef INSTANCEWRITER_HPP
+#define INSTANCEWRITER_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/dcostrma.h"
+
+#include "Checksum.hpp"
+
+class RateLimiter;
+
+// size and checksum are updated as bytes pass to the file or memory behind
+class ChecksumConsumer : public DcmConsumer {
+public:
+	OFBool good() const override { return m_status.good(); }
+
+	OFCondition status() const override { return m_status; }
+
+	OFBool isFlushed() const override { return OFTrue; }
+
+	offile_off_t avail() const override;
+
+	offile_off_t write(const void *buf, offile_off_t buflen) override;
+
+	void flush() override {}
+
+	// reports write errors not seen before
+	virtual OFCondition close() { return m_status; }
+
+	std::uint64_t size() const { return m_size; }
+
+	std::uint64_t checksum() const { return m_hash.digest(); }
+
+	// SHA-256 is computed too from the next byte on, costs more than XXH64
+	void computeSha256() { m_sha256 = std::make_unique<Sha256>(); }
+
+	// empty if not computed
+	std::string sha256() const { return m_sha256 ? m_sha256->hexDigest() : std::string{}; }
+
+	// writes block until limiter admits the bytes, slowing down the association read
+	void setRateLimiter(RateLimiter *limiter) { m_rateLimiter = limiter; }
+
+protected:
+	// returns bytes stored
+	virtual std::size_t store(const void *buf, std::size_t length) = 0;
+
+	OFCondition m_status{EC_Normal};
+
+private:
+	XxHash64                m_hash;
+	std::unique_ptr<Sha256> m_sha256;
+	RateLimiter *           m_rateLimiter{nullptr};
+	std::uint64_t           m_size{0};
+};
+
+// writes received bytes to a file
+class ChecksumFileConsumer : public ChecksumConsumer {
+public:
+	explicit ChecksumFileConsumer(const std::string &path);
+
+	~ChecksumFileConsumer() override;
+
+	ChecksumFileConsumer(const ChecksumFileConsumer &) = delete;
+
+	ChecksumFileConsumer &operator=(const ChecksumFileConsumer &) = delete;
+
+	void flush() override;
+
+	// flushes and closes file
+	OFCondition close() override;
+
+protected:
+	std::size_t store(const void *buf, std::size_t length) override;
+
+private:
+	std::FILE *m_file{nullptr};
+};
+
+// keeps received bytes in memory, instance is appended to an archive as a whole
+class ChecksumBufferConsumer : public ChecksumConsumer {
+public:
+	const std::string &data() const { return m_data; }
+
+protected:
+	std::size_t store(const void *buf, std::size_t length) override;
+
+private:
+	std::string m_data;
+};
+
+// DcmOutputStream over any consumer, DIMSE_receiveDataSetInFile writes through it
+class ConsumerOutputStream : public DcmOutputStream {
+public:
+	explicit ConsumerOutputStream(DcmConsumer &consumer) : DcmOutputStream(&consumer) {}
+};
+
+#endif //INSTANCEWRITER_HPP
@@ -0,0 +1,91 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef JOBRUNNER_HPP
+#define JOBRUNNER_HPP
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fmt/color.h"
+#include "fmt/format.h"
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/dctag.h"
+
+#include "OutputLayout.hpp"
+#include "PatientRecord.hpp"
+#include "TransferPlan.hpp"
+#include "UringWriter.hpp"
+
+class PeerPool;
+
+enum E_addModalities { ADD_MODALITIES_ALL, ADD_MODALITIES_MISSING };
+enum E_dumpFormat { DUMP_FORMAT_CSV, DUMP_FORMAT_JSON };
+
+// everything one find/dump/move run needs besides the association
+struct JobOptions {
+	std::string     queryModality{};
+	E_addModalities addModalities{ADD_MODALITIES_MISSING};
+
+	// --tag as given on command line/job file (CSV header) and resolved key
+	std::vector<std::pair<std::string, DcmTagKey>> queryTags{};
+
+	// read from plan, records are built from it and find is skipped
+	std::vector<PlannedStudy> plannedStudies{};
+
+	bool         coalesceQueries{false}; // one C-FIND per patient and merged date range
+	unsigned int findLimit{0};           // PACS C-FIND match limit, capped results are swept by date
+	std::string  sweepRange{};           // StudyDate range swept for all patients, records are built from results
+	unsigned int sweepConcurrency{4};
+	std::string  planFile{};             // find only, studies and size estimates are written to plan
+	bool         retrieveTags{false};
+	bool         retrieveFiles{false};
+	bool         incremental{false}; // move only instances missing in output directory's index
+	bool         skipPresent{false};  // records and studies moved completely by earlier runs skip find/move
+	std::string  storeDirectory{};   // shared content-addressed store, empty: instances written to output only
+	bool         sha256{false};      // SHA-256 in study manifests besides XXH64
+	WriteBackend writeBackend{WriteBackend::STDIO};
+	bool         logMissingStudies{true};
+	std::string  outputDirectory{"./download"};
+	OutputLayout outputLayout{};
+	std::string  dumpFilepath{"./dumped_tags"};
+	E_dumpFormat dumpFormat{DUMP_FORMAT_CSV};
+	std::string  missingStudiesDirectory{}; // empty: working directory
+
+	studyDateRangeExtend extendStudyDate{};
+};
+
+// progress of a job, stdout for batch runs, result file for service jobs
+class JobReport {
+public:
+	JobReport(std::FILE *out, const bool colored) : m_out(out), m_colored(colored) {}
+
+	template<typename... Args>
+	void print(fmt::format_string<Args...> format, Args &&... args) {
+		fmt::print(m_out, format, std::forward<Args>(args)...);
+	}
+
+	// "<msg> - <status>", status is colored on terminals only
+	void status(const std::string &msg, fmt::color color, const std::string &status);
+
+	void flush() { std::fflush(m_out); }
+
+private:
+	std::FILE *m_out;
+	bool       m_colored;
+};
+
+/*
+ * Runs find, optional tag dump and optional move for records over already negotiated associations.
+ * Returns 0 on success, otherwise an exit code.
+ */
+int runJob(PeerPool &                  peers,
+           const JobOptions &          options,
+           std::vector<PatientRecord> &record_list,
+           JobReport &                 report);
+
+#endif //JOBRUNNER_HPP
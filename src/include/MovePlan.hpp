@@ -0,0 +1,46 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef MOVEPLAN_HPP
+#define MOVEPLAN_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "PatientRecord.hpp"
+
+// study moved once, no matter how many records matched it
+struct PlannedMove {
+	std::string              m_uid{};
+	std::string              m_patientId{};
+	RecordPriority           m_priority{RecordPriority::MEDIUM}; // highest of referencing records
+	std::vector<std::size_t> m_records{};                        // indices into record list, for reporting
+};
+
+class MovePlan {
+public:
+	// adds all studies of record, known StudyInstanceUIDs only gain a reference
+	void addRecord(const PatientRecord &record, std::size_t record_index);
+
+	// returns false if uid was already planned
+	bool addStudy(const std::string &uid, const PatientRecord &record, std::size_t record_index);
+
+	bool contains(const std::string &uid) const { return m_index.contains(uid); }
+
+	const std::vector<PlannedMove> &moves() const { return m_moves; }
+
+	// indices into moves() by priority
+	std::vector<std::size_t> schedule() const;
+
+	// references dropped because the study was already planned
+	std::size_t duplicates() const { return m_duplicates; }
+
+private:
+	std::vector<PlannedMove>                     m_moves;
+	std::unordered_map<std::string, std::size_t> m_index;
+	std::size_t                                  m_duplicates{0};
+};
+
+#endif //MOVEPLAN_HPP
@@ -0,0 +1,52 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef OUTPUTLAYOUT_HPP
+#define OUTPUTLAYOUT_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class ArchiveFormat { NONE, TAR, TAR_ZSTD };
+
+// where received instances land below output directory
+struct OutputLayout {
+	bool          m_sharded{false};               // studies in <output>/<xx>/<yy>/<StudyInstanceUID>
+	bool          m_perSeries{false};             // instances in <study>/<SeriesInstanceUID>/
+	ArchiveFormat m_archive{ArchiveFormat::NONE}; // one <study>.tar[.zst] instead of study directory
+};
+
+// flat, sharded, series or sharded-series
+bool parseOutputLayout(std::string_view value, OutputLayout &layout);
+
+// none, tar or tar.zst, the latter only when built with zstd
+bool parseArchiveFormat(std::string_view value, ArchiveFormat &format);
+
+// ".tar" or ".tar.zst"
+const char *archiveExtension(ArchiveFormat format);
+
+std::filesystem::path studyDirectoryPath(const std::filesystem::path &output_directory,
+                                         const std::string &          study_uid,
+                                         const OutputLayout &         layout);
+
+// directory of instance within its study directory, study directory itself if series is unknown
+std::filesystem::path instanceDirectoryPath(const std::filesystem::path &study_directory,
+                                            const std::string &          series_uid,
+                                            const OutputLayout &         layout);
+
+/*
+ * Creates directories of all studies before moves start, shard directories are created once,
+ * archived studies only get their parent. existing counts study directories present before,
+ * false and error_msg on first failure.
+ */
+bool prepareStudyDirectories(const std::filesystem::path &   output_directory,
+                             const std::vector<std::string> &study_uids,
+                             const OutputLayout &            layout,
+                             std::size_t &                   existing,
+                             std::string &                   error_msg);
+
+#endif //OUTPUTLAYOUT_HPP
@@ -10,11 +10,16 @@
 #include <vector>
 #include <set>
 
+// ordering of work, also sent as DIMSE priority of C-FIND/C-MOVE requests
+enum class RecordPriority { LOW = 0, MEDIUM = 1, HIGH = 2 };
+
 struct PatientRecord {
 	std::string           m_id{};
 	std::string           m_name{};
 	std::string           m_study_date{};
+	std::string           m_study_time{}; // HHMMSS-HHMMSS, only set for split queries
 	std::string           m_modality{};
+	RecordPriority        m_priority{RecordPriority::MEDIUM};
 	std::set<std::string> m_uid_list{};
 
 	PatientRecord() = default;
@@ -37,11 +42,7 @@ struct studyDateRangeExtend {
 std::vector<PatientRecord> readPatientRecords(const std::string &         textFilePath,
                                               const studyDateRangeExtend &studyDateRange);
 
-static std::string nameToDcmFormat(std::string_view fullname);
-
-static std::string dateToDcmFormat(std::string_view            date,
-                                   const studyDateRangeExtend &study_date_range);
-
-static std::string idToDcmFormat(std::string_view id);
+// high/urgent, medium, low (case insensitive)
+bool parseRecordPriority(std::string_view value, RecordPriority &priority);
 
 #endif //PATIENTRECORD_HPP
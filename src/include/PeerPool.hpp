@@ -0,0 +1,165 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef PEERPOOL_HPP
+#define PEERPOOL_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AdmissionControl.hpp"
+#include "StudyQueryRetriever.hpp"
+
+// --peer host:port[:AET], AE title defaults to --ae-pacs
+struct PeerAddress {
+	std::string    m_host{};
+	unsigned short m_port{0};
+	std::string    m_aeTitle{};
+};
+
+bool parsePeerAddress(std::string_view value, PeerAddress &address);
+
+/*
+ * Move statistics per peer, shared by all pools of a process (service workers).
+ * Throughput is an exponential moving average of received instances per second.
+ */
+class PeerStatistics {
+public:
+	void moveStarted(std::size_t peer);
+
+	void moveFinished(std::size_t peer, bool success, unsigned int instances, double seconds);
+
+	// candidates ordered best first: fewest consecutive failures, then throughput divided by running moves
+	std::vector<std::size_t> rank(const std::vector<std::size_t> &candidates);
+
+private:
+	struct Entry {
+		double       m_throughput{0.0};
+		bool         m_measured{false};
+		unsigned int m_activeMoves{0};
+		unsigned int m_consecutiveFailures{0};
+	};
+
+	Entry &entry(std::size_t peer);
+
+	std::mutex         m_mutex;
+	std::vector<Entry> m_entries;
+};
+
+/*
+ * One QueryRetriever per peer over a shared network. Records are queried at all peers concurrently,
+ * StudyInstanceUIDs are merged and each study is moved from the best ranked peer holding it,
+ * falling back to the others on failure. With a single peer it behaves as plain QueryRetriever.
+ */
+class PeerPool {
+public:
+	PeerPool(const QueryRetriever &           prototype,
+	         const std::vector<PeerAddress> &extra_peers,
+	         std::mutex *                     move_mutex,
+	         PeerStatistics &                 statistics);
+
+	std::size_t size() const { return m_peers.size(); }
+
+	QueryRetriever &primary() { return *m_peers.front(); }
+
+	OFCondition ensureAssociations();
+
+	void releaseAssociations();
+
+	OFCondition prepareFindIdentifiers(const std::string &modalities);
+
+	OFCondition prepareDumpIdentifiers(const std::vector<TagValuePair> &query_tags);
+
+	// fills record's uid list with union of all peers' results, good if any peer answered
+	OFCondition performFindRequest(PatientRecord &patient_record);
+
+	// studies matched by any peer, merged by StudyInstanceUID
+	OFCondition findStudies(const PatientRecord &patient_record, std::vector<StudyInfo> &studies);
+
+	OFCondition performMoveRequest(const PatientRecord &patient_record);
+
+	// directories_prepared: study directories exist, retrievers skip per study filesystem checks
+	void setOutputDirectory(const std::string &output_directory, const OutputLayout &layout, bool directories_prepared);
+
+	void setInstanceIndex(InstanceIndex *index, bool incremental);
+
+	void setContentStore(ContentStore *store);
+
+	void setSha256(bool sha256);
+
+	void setWriteBackend(WriteBackend backend);
+
+	// local moves wait for admission, studies reserve their size estimated from find results
+	void setAdmissionControl(AdmissionControl *admission) { m_admission = admission; }
+
+	// moves are dispatched only when the schedule allows, local receives are shaped
+	void setRateLimiter(RateLimiter *limiter);
+
+	// DIMSE traffic of every peer is recorded for replay
+	void setSessionCapture(SessionCapture *capture);
+
+	// size of study found by other means than findStudies, e.g. date sweeps
+	void noteStudy(const StudyInfo &study);
+
+	// find results kept per study since prepareFindIdentifiers, empty if study was not found
+	StudyInfo studyInfo(const std::string &uid) const;
+
+	// failed status if no peer could be asked to move the last study
+	DIC_US lastMoveStatus() const { return m_lastMove.m_status; }
+
+	// instances and bytes written by local receiver during last move
+	unsigned int lastMoveStored() const { return m_lastMove.m_stored; }
+
+	std::uint64_t lastMoveBytes() const { return m_lastMove.m_bytes; }
+
+	// worst moveExitCode of all peers
+	int moveExitCode() const;
+
+	// series of each study are queried at first peer holding it
+	template<FindResultSink Sink>
+	OFCondition dumpTags(const PatientRecord &patient_record, Sink &sink);
+
+private:
+	// peers which returned uid in last find, in configuration order
+	std::vector<std::size_t> sources(const std::string &uid) const;
+
+	// sets m_lastMove
+	OFCondition moveStudy(const PatientRecord &patient_record, const std::string &uid);
+
+	// single peer moves without ranking
+	OFCondition moveOne(const PatientRecord &patient_record, const std::string &uid);
+
+	std::vector<std::unique_ptr<QueryRetriever>>    m_peers;
+	std::vector<bool>                               m_available; // association negotiated
+	std::map<std::string, std::vector<std::size_t>> m_studySources;
+	PeerStatistics &                                m_statistics;
+	std::map<std::string, StudyInfo>                m_studyInfos;
+	AdmissionControl *                              m_admission{nullptr};
+	RateLimiter *                                   m_rateLimiter{nullptr};
+	MoveResult                                      m_lastMove{};
+};
+
+template<FindResultSink Sink>
+OFCondition PeerPool::dumpTags(const PatientRecord &patient_record, Sink &sink) {
+	if (m_peers.size() == 1)
+		return primary().dumpTags(patient_record, sink);
+
+	OFCondition cond = EC_Normal;
+	for (const auto &uid : patient_record.m_uid_list) {
+		const std::vector<std::size_t> peers = sources(uid);
+		if (peers.empty())
+			continue;
+
+		PatientRecord study = patient_record;
+		study.m_uid_list    = {uid};
+		cond                = m_peers[peers.front()]->dumpTags(study, sink);
+	}
+	return cond;
+}
+
+#endif //PEERPOOL_HPP
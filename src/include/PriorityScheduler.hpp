@@ -0,0 +1,72 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef PRIORITYSCHEDULER_HPP
+#define PRIORITYSCHEDULER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+#include "PatientRecord.hpp"
+
+/*
+ * FIFO per priority level with aging: a waiting item gains one level for every aging_step items
+ * popped before it, so bulk low priority work still progresses while urgent work keeps arriving.
+ * Ties go to the higher base priority. Not synchronized.
+ */
+template<typename T>
+class PriorityScheduler {
+public:
+	explicit PriorityScheduler(const std::size_t aging_step = 8) : m_agingStep(aging_step ? aging_step : 1) {}
+
+	void push(T item, const RecordPriority priority) {
+		m_levels[static_cast<std::size_t>(priority)].push_back(Entry{std::move(item), m_popCount});
+		++m_size;
+	}
+
+	bool empty() const { return m_size == 0; }
+
+	std::size_t size() const { return m_size; }
+
+	// call only if not empty
+	T pop() {
+		std::size_t   best{0};
+		std::uint64_t bestPriority{0};
+		bool          found{false};
+
+		// heads are the oldest entries, i.e. the most aged of their level
+		for (std::size_t level = m_levels.size(); level-- > 0;) {
+			if (m_levels[level].empty())
+				continue;
+			const std::uint64_t effective = level + (m_popCount - m_levels[level].front().enqueuedAt) / m_agingStep;
+			if (!found || effective > bestPriority) {
+				best         = level;
+				bestPriority = effective;
+				found        = true;
+			}
+		}
+
+		T item = std::move(m_levels[best].front().item);
+		m_levels[best].pop_front();
+		--m_size;
+		++m_popCount;
+		return item;
+	}
+
+private:
+	struct Entry {
+		T             item;
+		std::uint64_t enqueuedAt; // m_popCount at push
+	};
+
+	std::array<std::deque<Entry>, 3> m_levels{};
+	std::size_t                      m_agingStep;
+	std::size_t                      m_size{0};
+	std::uint64_t                    m_popCount{0};
+};
+
+#endif //PRIORITYSCHEDULER_HPP
@@ -0,0 +1,91 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef QUERYENGINE_HPP
+#define QUERYENGINE_HPP
+
+#include <concepts>
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmnet/dimse.h"
+
+#include "ResponseDecoder.hpp"
+
+/*
+ * Receiver of decoded C-FIND response identifiers.
+ * consume() is called from the receive loop for every pending response and should only buffer,
+ * flush() is called once the query finished (also after a failed query).
+ */
+template<typename Sink>
+concept FindResultSink = requires(Sink &sink, const ResponseIdentifiers &identifiers) {
+	sink.consume(identifiers);
+	sink.flush();
+};
+
+OFCondition sendFindRequest(T_ASC_Association *         assoc,
+                            T_ASC_PresentationContextID pres_id,
+                            T_DIMSE_C_FindRQ *          request,
+                            DcmDataset *                request_identifiers);
+
+// receive and validate C-FIND-RSP command, response identifiers are not read
+OFCondition receiveFindResponse(T_ASC_Association *          assoc,
+                                T_DIMSE_BlockingMode         block_mode,
+                                int                          timeout,
+                                DIC_US                       msg_id,
+                                T_ASC_PresentationContextID *pres_id,
+                                T_DIMSE_C_FindRSP *          response,
+                                DcmDataset **                status_detail);
+
+void logFindResponse(int                        response_count,
+                     T_DIMSE_C_FindRSP &        response,
+                     const ResponseIdentifiers &identifiers);
+
+void sendFindCancel(T_ASC_Association *assoc, T_ASC_PresentationContextID pres_id, DIC_US msg_id);
+
+// C-FIND SCU receive loop, each pending response is decoded and handed to sink
+template<FindResultSink Sink>
+OFCondition DIMSE_queryUser(T_ASC_Association *         assoc,
+                            T_ASC_PresentationContextID pres_id,
+                            T_DIMSE_C_FindRQ *          request,
+                            DcmDataset *                request_identifiers,
+                            FindResponseDecoder &       decoder,
+                            const int                   cancel_after_n_responses,
+                            const T_DIMSE_BlockingMode  block_mode,
+                            const int                   timeout,
+                            T_DIMSE_C_FindRSP *         response,
+                            DcmDataset **               status_detail,
+                            Sink &                      sink) {
+	DIC_US status = STATUS_FIND_Pending_MatchesAreContinuing;
+	int    responseCount{0};
+
+	OFCondition cond = sendFindRequest(assoc, pres_id, request, request_identifiers);
+
+	while (cond.good() && DICOM_PENDING_STATUS(status)) {
+		cond = receiveFindResponse(assoc, block_mode, timeout, request->MessageID, &pres_id, response, status_detail);
+		if (cond.bad())
+			break;
+
+		status = response->DimseStatus;
+		responseCount++;
+
+		// only pending responses carry identifiers
+		if (!DICOM_PENDING_STATUS(status))
+			break;
+
+		cond = decoder.receive(assoc, block_mode, timeout, &pres_id);
+		if (cond.bad())
+			break;
+
+		logFindResponse(responseCount, *response, decoder.identifiers());
+		sink.consume(decoder.identifiers());
+
+		if (cancel_after_n_responses == responseCount)
+			sendFindCancel(assoc, pres_id, request->MessageID);
+	}
+
+	sink.flush();
+	return cond;
+}
+
+#endif //QUERYENGINE_HPP
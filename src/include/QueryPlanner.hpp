@@ -0,0 +1,44 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef QUERYPLANNER_HPP
+#define QUERYPLANNER_HPP
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "PatientRecord.hpp"
+
+// inclusive StudyDate range
+struct DateRange {
+	std::chrono::sys_days m_first{};
+	std::chrono::sys_days m_last{};
+
+	bool contains(const std::chrono::sys_days day) const { return m_first <= day && day <= m_last; }
+};
+
+// YYYYMMDD or YYYYMMDD-YYYYMMDD
+bool parseDateRange(std::string_view value, DateRange &range);
+
+bool parseDate(std::string_view value, std::chrono::sys_days &day);
+
+// YYYYMMDD for single day, YYYYMMDD-YYYYMMDD otherwise
+std::string formatDateRange(const DateRange &range);
+
+// one C-FIND covering records of same PatientID with overlapping/adjacent dates
+struct PlannedQuery {
+	PatientRecord            m_query{};   // id, merged date range, highest priority
+	DateRange                m_range{};
+	std::vector<std::size_t> m_records{}; // indices into record list
+};
+
+/*
+ * Groups records by PatientID and merges overlapping or adjacent date ranges, modality is not part of the key
+ * as C-FIND matches ModalitiesInStudy of the job. Records with unparsable dates get a query of their own.
+ */
+std::vector<PlannedQuery> planFindQueries(const std::vector<PatientRecord> &record_list);
+
+#endif //QUERYPLANNER_HPP
@@ -0,0 +1,146 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef QUERYSINKS_HPP
+#define QUERYSINKS_HPP
+
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/dctag.h"
+#include "dcmtk/dcmdata/dcspchrs.h"
+
+#include "ResponseDecoder.hpp"
+
+// collects StudyInstanceUIDs of matched studies
+class StudyUidSink {
+public:
+	explicit StudyUidSink(std::set<std::string> &uid_list) : m_uidList(uid_list) {}
+
+	void consume(const ResponseIdentifiers &identifiers);
+
+	void flush() {}
+
+private:
+	std::set<std::string> &m_uidList;
+};
+
+// collects values of one UID key, e.g. SeriesInstanceUID or SOPInstanceUID of lower level queries
+class UidSink {
+public:
+	UidSink(const DcmTagKey &key, std::set<std::string> &uids) : m_key(key), m_uids(uids) {}
+
+	void consume(const ResponseIdentifiers &identifiers);
+
+	void flush() {}
+
+private:
+	DcmTagKey              m_key;
+	std::set<std::string> &m_uids;
+};
+
+// matched study as returned by study level C-FIND
+struct StudyInfo {
+	std::string  m_uid{};
+	std::string  m_patientId{};
+	std::string  m_date{};      // StudyDate, may be empty
+	unsigned int m_series{0};    // NumberOfStudyRelatedSeries, 0 if not returned
+	unsigned int m_instances{0}; // NumberOfStudyRelatedInstances, 0 if not returned
+	std::string  m_modalities{}; // ModalitiesInStudy, may be empty
+};
+
+class StudyInfoSink {
+public:
+	explicit StudyInfoSink(std::vector<StudyInfo> &studies) : m_studies(studies) {}
+
+	void consume(const ResponseIdentifiers &identifiers);
+
+	void flush() {}
+
+private:
+	std::vector<StudyInfo> &m_studies;
+};
+
+// one row per series: PatientID, StudyInstanceUID, SeriesDescription, requested tags
+class TagRowBuilder {
+public:
+	explicit TagRowBuilder(const std::vector<DcmTagKey> &query_tags);
+
+	// returns false for derived/secondary images, topograms, reports, ...
+	bool build(const ResponseIdentifiers &identifiers, std::vector<std::string> &row) const;
+
+	const std::vector<std::string> &columnNames() const { return m_columnNames; }
+
+private:
+	bool containsFilterWord(const OFString &string_val) const;
+
+	std::vector<DcmTagKey>   m_queryTags;
+	std::vector<std::string> m_columnNames{"PatientID", "StudyInstanceUID", "SeriesDescription"};
+	const std::set<OFString> m_filterWords{"secondary", "derived", "localizer", "topog", "scout", "report", "dose", "protocol"};
+};
+
+// keeps rows in memory
+class TagTableSink {
+public:
+	explicit TagTableSink(const std::vector<DcmTagKey> &query_tags) : m_builder(query_tags) {}
+
+	void consume(const ResponseIdentifiers &identifiers);
+
+	void flush() {}
+
+	const std::vector<std::string> &columnNames() const { return m_builder.columnNames(); }
+
+	const std::vector<std::vector<std::string>> &rows() const { return m_rows; }
+
+private:
+	TagRowBuilder                         m_builder;
+	std::vector<std::vector<std::string>> m_rows{};
+};
+
+// appends ';' separated rows to CSV file, written in batches
+class CsvTagSink {
+public:
+	CsvTagSink(const std::string &filepath, const std::vector<DcmTagKey> &query_tags);
+
+	~CsvTagSink();
+
+	void consume(const ResponseIdentifiers &identifiers);
+
+	void flush();
+
+private:
+	TagRowBuilder            m_builder;
+	std::ofstream            m_file;
+	std::string              m_buffer{};
+	std::vector<std::string> m_row{};
+};
+
+// appends one JSON object per row (JSON Lines) in UTF-8, written in batches
+class JsonTagSink {
+public:
+	JsonTagSink(const std::string &filepath, const std::vector<DcmTagKey> &query_tags);
+
+	~JsonTagSink();
+
+	void consume(const ResponseIdentifiers &identifiers);
+
+	void flush();
+
+private:
+	TagRowBuilder            m_builder;
+	std::ofstream            m_file;
+	std::string              m_buffer{};
+	std::vector<std::string> m_row{};
+
+	// SpecificCharacterSet of the last response, converter is reselected when it changes
+	DcmSpecificCharacterSet m_converter{};
+	OFString                m_charset{};
+	bool                    m_charsetSelected{false};
+	bool                    m_convert{false};
+};
+
+#endif //QUERYSINKS_HPP
@@ -0,0 +1,71 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef RATELIMITER_HPP
+#define RATELIMITER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// rate during minutes of day [m_start, m_end), windows ending before they start wrap midnight
+struct RateWindow {
+	unsigned int  m_start{0};
+	unsigned int  m_end{0};
+	std::uint64_t m_bytesPerSecond{0}; // 0: no new retrievals
+};
+
+// "07:00-18:00=100,18:00-22:00=400" in Mbit/s, later windows win where they overlap
+bool parseRateSchedule(std::string_view value, std::vector<RateWindow> &schedule);
+
+/*
+ * Token bucket shared by all receives of the process. Received data is charged as it is read off the
+ * association, the receiving thread sleeps off any deficit, so the sender is slowed by TCP flow control
+ * instead of refused C-STOREs. Times outside the schedule windows are unlimited.
+ */
+class RateLimiter {
+public:
+	static constexpr std::uint64_t UNLIMITED{UINT64_MAX};
+
+	explicit RateLimiter(std::vector<RateWindow> schedule) : m_schedule(std::move(schedule)) {}
+
+	bool enabled() const { return !m_schedule.empty(); }
+
+	/*
+	 * Blocks until bytes fit the current rate. Moves running into a window without retrievals
+	 * continue at a trickle, the association would time out otherwise.
+	 */
+	void consume(std::size_t bytes);
+
+	// blocks while the schedule allows no retrievals or the bucket is in deficit, false if stopped
+	bool waitForDispatch();
+
+	// sleeping receivers and dispatch waiters return, e.g. on service shutdown
+	void stop();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// mutex held, rate of the current window re-evaluated once per second
+	std::uint64_t currentRate(Clock::time_point now);
+
+	// mutex held, adds tokens for time since last call up to burst of rate
+	void refill(Clock::time_point now, std::uint64_t rate);
+
+	std::vector<RateWindow> m_schedule;
+	std::mutex              m_mutex;
+	std::condition_variable m_stopCondition;
+	bool                    m_stopped{false};
+	double                  m_tokens{0};
+	Clock::time_point       m_refilled{};
+	std::uint64_t           m_rate{UNLIMITED};
+	Clock::time_point       m_rateChecked{};
+};
+
+#endif //RATELIMITER_HPP
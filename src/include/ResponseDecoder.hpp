@@ -0,0 +1,91 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef RESPONSEDECODER_HPP
+#define RESPONSEDECODER_HPP
+
+#include <string>
+#include <vector>
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/ofstd/ofcond.h"
+#include "dcmtk/dcmdata/dcxfer.h"
+#include "dcmtk/dcmdata/dctag.h"
+#include "dcmtk/dcmnet/dimse.h"
+
+// values of requested tags extracted from a C-FIND response identifier
+class ResponseIdentifiers {
+public:
+	// requested tags are kept sorted, values are reset
+	void setRequestedTags(const std::vector<DcmTagKey> &tags);
+
+	// clear received values, keep requested tags
+	void reset();
+
+	// same semantics as DcmItem::findAndGetOFString, value is cleared if tag was not received
+	OFCondition findAndGetOFString(const DcmTagKey &key, OFString &value) const;
+
+	// same semantics as DcmItem::findAndGetOFStringArray, all values of multi-valued strings
+	OFCondition findAndGetOFStringArray(const DcmTagKey &key, OFString &value) const;
+
+	// one "(gggg,eeee) value" line per received tag, used for logging
+	std::string dump() const;
+
+	struct Entry {
+		DcmTagKey m_key;
+		DcmEVR    m_vr{EVR_UNKNOWN}; // dictionary VR, used for implicit VR transfer syntax
+		OFString  m_value{};
+		OFString  m_values{}; // backslash separated, multi-valued strings only
+		bool      m_present{false};
+	};
+
+	// requested tags, m_present is set for received ones
+	const std::vector<Entry> &entries() const { return m_entries; }
+
+private:
+	friend class FindResponseDecoder;
+
+	std::vector<Entry> m_entries{};
+};
+
+/*
+ * Receives C-FIND response identifiers without building a DcmDataset.
+ * PDVs are collected into a reusable buffer and only the top level elements
+ * of the requested tags are decoded, everything else is skipped.
+ * Transfer syntaxes other than LE implicit, LE/BE explicit fall back to
+ * DIMSE_receiveDataSetInMemory.
+ */
+class FindResponseDecoder {
+public:
+	FindResponseDecoder() = default;
+
+	void setRequestedTags(const std::vector<DcmTagKey> &tags);
+
+	// receive data set following a C-FIND-RSP command
+	OFCondition receive(T_ASC_Association *          assoc,
+	                    T_DIMSE_BlockingMode         block_mode,
+	                    int                          timeout,
+	                    T_ASC_PresentationContextID *pres_id);
+
+	// decode identifiers from data set bytes in one of the supported transfer syntaxes
+	OFCondition decode(const std::vector<Uint8> &buffer, E_TransferSyntax xfer);
+
+	const ResponseIdentifiers &identifiers() const { return m_identifiers; }
+
+private:
+	OFCondition readDataSetPDVs(T_ASC_Association *          assoc,
+	                            T_DIMSE_BlockingMode         block_mode,
+	                            int                          timeout,
+	                            T_ASC_PresentationContextID *pres_id);
+
+	OFCondition receiveFallback(T_ASC_Association *          assoc,
+	                            T_DIMSE_BlockingMode         block_mode,
+	                            int                          timeout,
+	                            T_ASC_PresentationContextID *pres_id);
+
+	ResponseIdentifiers m_identifiers;
+	std::vector<Uint8>  m_buffer{};
+};
+
+#endif //RESPONSEDECODER_HPP
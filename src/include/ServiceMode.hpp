@@ -0,0 +1,98 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef SERVICEMODE_HPP
+#define SERVICEMODE_HPP
+
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "JobRunner.hpp"
+#include "PeerPool.hpp"
+#include "PriorityScheduler.hpp"
+
+struct ServiceOptions {
+	std::string  spoolDirectory{};
+	unsigned int workers{2};
+	unsigned int pollInterval{2}; // seconds between spool directory scans
+
+	std::vector<PeerAddress> peers{}; // queried besides peer of network owner
+	AdmissionLimits          admission{};
+	std::vector<RateWindow>  rateSchedule{};
+	std::string              captureFile{}; // DIMSE traffic of all workers is recorded if set
+};
+
+/*
+ * Long running mode, network (and receive port) is initialized once, each worker keeps its own associations
+ * (one per peer) open between jobs.
+ *
+ * Jobs are patient list files with ".job" extension dropped into spool directory (write under other name and
+ * rename, rename is atomic). Lines starting with '#' set job options, named as command line options:
+ *   #add-modality-missing=CT\MR   #add-modality-all=CT   #tag=0008,0060   #extend-date=2
+ *   #retrieve-tags   #retrieve-files   #coalesce   #dump-format=json   #output-directory=/data/job1
+ *   #priority=high (order of jobs, records are ordered by their own priority column)
+ * Options not set by job are taken from command line.
+ *
+ * Spool layout: processing/ (claimed jobs), results/ (per-job report, tags, missing studies),
+ * done/ and failed/ (finished job files).
+ */
+class ServiceMode {
+public:
+	// network_owner is configured from command line, it owns the shared network and its settings are copied to workers
+	ServiceMode(QueryRetriever &network_owner, JobOptions defaults, ServiceOptions options);
+
+	~ServiceMode();
+
+	// blocks until SIGINT/SIGTERM, returns exit code
+	int run();
+
+private:
+	bool prepareSpool();
+
+	void requeueUnfinished();
+
+	void claimJobs();
+
+	// #priority of job file, header lines only
+	static RecordPriority readJobPriority(const std::filesystem::path &job_path);
+
+	void workerLoop(unsigned int index);
+
+	void processJob(PeerPool &peers, const std::filesystem::path &job_path);
+
+	bool parseJob(const std::filesystem::path &job_path,
+	              JobOptions &                 options,
+	              std::vector<PatientRecord> & record_list,
+	              std::string &                error_msg) const;
+
+	QueryRetriever &m_networkOwner;
+	JobOptions      m_defaults;
+	ServiceOptions  m_options;
+
+	std::filesystem::path m_spool;
+	std::filesystem::path m_processing;
+	std::filesystem::path m_results;
+	std::filesystem::path m_done;
+	std::filesystem::path m_failed;
+
+	std::mutex     m_moveMutex;
+	PeerStatistics m_peerStatistics;
+
+	// shared by workers, moves of all jobs reserve space on the same volumes and share the link
+	AdmissionControl m_admission;
+	RateLimiter      m_rateLimiter;
+	SessionCapture   m_capture;
+
+	std::mutex                               m_queueMutex;
+	std::condition_variable                  m_queueCondition;
+	PriorityScheduler<std::filesystem::path> m_queue{4};
+	bool                                     m_stopping{false};
+	std::vector<std::thread>                 m_workers;
+};
+
+#endif //SERVICEMODE_HPP
@@ -0,0 +1,142 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef SESSIONCAPTURE_HPP
+#define SESSIONCAPTURE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/dctag.h"
+#include "dcmtk/dcmnet/dimse.h"
+
+class ResponseIdentifiers;
+
+// non-empty top level values of an identifier, sorted by tag
+using CapturedValues = std::vector<std::pair<DcmTagKey, std::string>>;
+
+CapturedValues captureValues(DcmDataset &dataset);
+
+// "gggg,eeee=value\t...", requests with the same key are answered by the same captured session
+std::string captureKey(const CapturedValues &values);
+
+/*
+ * DIMSE traffic of a run written to a tab separated capture file, one line per event:
+ *   F/M  <session> <us> <identifier values>             C-FIND-RQ / C-MOVE-RQ
+ *   f    <session> <us> <status> <identifier values>    C-FIND-RSP
+ *   m    <session> <us> <status> <remaining> <completed> <failed> <warning>
+ *   S    <session> <us> <status> <SOPClassUID> <SOPInstanceUID> <SeriesInstanceUID> <TransferSyntaxUID> <bytes>
+ * Times are microseconds since the capture was opened. Tab, CR, LF and backslash in values
+ * are escaped as \t, \r, \n and \\. Thread safe, sessions of concurrent associations interleave.
+ */
+class SessionCapture {
+public:
+	bool open(const std::filesystem::path &path, std::string &error_msg);
+
+	bool enabled() const { return m_file.is_open(); }
+
+	// returns session id the responses are recorded under
+	std::uint64_t findRequest(DcmDataset &identifiers);
+
+	void findResponse(std::uint64_t session, DIC_US status, const ResponseIdentifiers *identifiers);
+
+	std::uint64_t moveRequest(DcmDataset &identifiers);
+
+	void moveResponse(std::uint64_t session, const T_DIMSE_C_MoveRSP &response);
+
+	void store(std::uint64_t      session,
+	           DIC_US             status,
+	           const std::string &sop_class_uid,
+	           const std::string &sop_instance_uid,
+	           const std::string &series_uid,
+	           const std::string &transfer_syntax,
+	           std::uint64_t      bytes);
+
+private:
+	std::uint64_t request(char type, DcmDataset &identifiers);
+
+	void write(const std::string &line);
+
+	std::uint64_t now() const;
+
+	std::mutex                            m_mutex;
+	std::ofstream                         m_file;
+	std::chrono::steady_clock::time_point m_start{};
+	std::uint64_t                         m_sessions{0};
+};
+
+// forwards find results to sink, pending responses are recorded if capture is set
+template<typename Sink>
+class CaptureSink {
+public:
+	CaptureSink(SessionCapture *capture, const std::uint64_t session, Sink &sink)
+		: m_capture(capture), m_session(session), m_sink(sink) {}
+
+	void consume(const ResponseIdentifiers &identifiers) {
+		if (m_capture != nullptr)
+			m_capture->findResponse(m_session, STATUS_Pending, &identifiers);
+		m_sink.consume(identifiers);
+	}
+
+	void flush() { m_sink.flush(); }
+
+private:
+	SessionCapture *m_capture;
+	std::uint64_t   m_session;
+	Sink &          m_sink;
+};
+
+struct CapturedFindResponse {
+	std::uint64_t  m_offset{0}; // microseconds after request
+	DIC_US         m_status{STATUS_Success};
+	CapturedValues m_identifiers{};
+};
+
+struct CapturedFind {
+	CapturedValues                    m_request{};
+	std::vector<CapturedFindResponse> m_responses{};
+};
+
+struct CapturedMoveResponse {
+	std::uint64_t m_offset{0};
+	DIC_US        m_status{STATUS_Success};
+	DIC_US        m_remaining{0};
+	DIC_US        m_completed{0};
+	DIC_US        m_failed{0};
+	DIC_US        m_warning{0};
+};
+
+struct CapturedStore {
+	std::uint64_t m_offset{0};
+	DIC_US        m_status{STATUS_Success};
+	std::string   m_sopClassUid{};
+	std::string   m_sopInstanceUid{};
+	std::string   m_seriesUid{};
+	std::string   m_transferSyntax{};
+	std::uint64_t m_bytes{0};
+};
+
+struct CapturedMove {
+	CapturedValues                    m_request{};
+	std::vector<CapturedMoveResponse> m_responses{};
+	std::vector<CapturedStore>        m_stores{};
+};
+
+// sessions of a capture by captureKey of their request, first session of a key wins
+struct Capture {
+	std::map<std::string, CapturedFind> m_finds;
+	std::map<std::string, CapturedMove> m_moves;
+};
+
+bool readCapture(const std::filesystem::path &path, Capture &capture, std::string &error_msg);
+
+#endif //SESSIONCAPTURE_HPP
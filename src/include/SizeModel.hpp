@@ -0,0 +1,53 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef SIZEMODEL_HPP
+#define SIZEMODEL_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+
+/*
+ * Average instance size per modality and measured transfer rate, learned from finished moves and
+ * kept in <output>/.fnostudyqr-sizes. Modalities without history fall back to typical sizes.
+ */
+class SizeModel {
+public:
+	static constexpr const char *FILENAME{".fnostudyqr-sizes"};
+
+	// missing file is no error, the model starts empty
+	void load(const std::filesystem::path &directory);
+
+	// written to partial file and renamed
+	bool save(std::string &error_msg) const;
+
+	std::uint64_t instanceSize(std::string_view modality) const;
+
+	// instances times largest instance size of ModalitiesInStudy (backslash separated), 0 if instances unknown
+	std::uint64_t estimate(std::string_view modalities, unsigned int instances) const;
+
+	// size of a finished move, counted for each of its modalities
+	void record(std::string_view modalities, unsigned int instances, std::uint64_t bytes);
+
+	void recordTransfer(std::uint64_t bytes, double seconds);
+
+	// bytes per second of recorded transfers, 0 if none
+	double throughput() const;
+
+private:
+	struct Average {
+		std::uint64_t m_bytes{0};
+		std::uint64_t m_instances{0};
+	};
+
+	std::filesystem::path                       m_directory;
+	std::map<std::string, Average, std::less<>> m_averages; // by modality
+	std::uint64_t                               m_transferredBytes{0};
+	double                                      m_transferSeconds{0};
+};
+
+#endif //SIZEMODEL_HPP
@@ -0,0 +1,72 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef STUDYARCHIVE_HPP
+#define STUDYARCHIVE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "InstanceIndex.hpp"
+#include "OutputLayout.hpp"
+
+struct ZSTD_CCtx_s;
+
+/*
+ * Instances of one study appended to a tar stream as they are received, no file per instance.
+ * Members are <StudyInstanceUID>/[<SeriesInstanceUID>/]<file name>, finish() adds
+ * <StudyInstanceUID>/index.tsv (member, data offset, size, Study/Series/SOP Instance UID, XXH64)
+ * and renames the partial archive. Offsets are in the uncompressed stream.
+ */
+class StudyArchive {
+public:
+	StudyArchive() = default;
+
+	~StudyArchive();
+
+	StudyArchive(const StudyArchive &) = delete;
+
+	StudyArchive &operator=(const StudyArchive &) = delete;
+
+	bool open(const std::filesystem::path &path,
+	          const std::string &          study_uid,
+	          ArchiveFormat                format,
+	          bool                         per_series,
+	          std::string &                error_msg);
+
+	// instance.m_path is replaced by the member name
+	bool append(const std::string &filename, const std::string &data, IndexedInstance instance);
+
+	// archives without members are removed
+	bool finish(std::string &error_msg);
+
+	std::size_t members() const { return m_entries.size(); }
+
+private:
+	struct Entry {
+		IndexedInstance m_instance;
+		std::uint64_t   m_offset{0};
+	};
+
+	bool write(const void *data, std::size_t length);
+
+	bool writeMember(const std::string &member, const std::string &data, std::uint64_t &data_offset);
+
+	void close();
+
+	std::FILE *            m_file{nullptr};
+	std::filesystem::path  m_path;
+	std::filesystem::path  m_partPath;
+	std::string            m_studyUid;
+	bool                   m_perSeries{false};
+	std::uint64_t          m_offset{0}; // uncompressed bytes written
+	std::vector<Entry>     m_entries;
+	ZSTD_CCtx_s *          m_zstd{nullptr};
+	std::vector<char>      m_compressed;
+};
+
+#endif //STUDYARCHIVE_HPP
@@ -0,0 +1,56 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef STUDYCATALOG_HPP
+#define STUDYCATALOG_HPP
+
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include "InstanceIndex.hpp"
+#include "PatientRecord.hpp"
+
+/*
+ * Studies moved completely into an output directory and the records all of whose studies arrived,
+ * kept in <directory>/.fnostudyqr-studies next to the instance index. Lines are appended as moves
+ * finish, later lines replace earlier ones. Re-submitted records are answered from it without
+ * C-FIND as long as the index still holds every instance and their StudyDate range had ended
+ * before the record was written.
+ */
+class StudyCatalog {
+public:
+	static constexpr const char *FILENAME{".fnostudyqr-studies"};
+
+	bool open(const std::filesystem::path &directory, std::string &error_msg);
+
+	// study moved without failed sub-operations, instances expected in output directory
+	void addStudy(const std::string &uid, unsigned int instances);
+
+	// record (PatientID, StudyDate, Modality) whose studies were all added
+	void addRecord(const PatientRecord &record);
+
+	// recorded and at least the expected number of instances indexed and on disk
+	bool complete(const std::string &uid, const InstanceIndex &index) const;
+
+	// StudyInstanceUIDs of an earlier identical record if all of them are still complete, open ranges never are
+	bool satisfied(const PatientRecord &record, const InstanceIndex &index, std::set<std::string> &uids) const;
+
+	std::size_t studies() const { return m_studies.size(); }
+
+private:
+	struct CatalogRecord {
+		std::set<std::string> m_uids;
+		std::string           m_written; // YYYYMMDD, empty in catalogs of older versions
+	};
+
+	std::filesystem::path                          m_directory;
+	std::ofstream                                  m_file;
+	std::unordered_map<std::string, unsigned int>  m_studies; // expected instances by StudyInstanceUID
+	std::unordered_map<std::string, CatalogRecord> m_records; // by record key
+};
+
+#endif //STUDYCATALOG_HPP
@@ -0,0 +1,76 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef STUDYMANIFEST_HPP
+#define STUDYMANIFEST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "InstanceIndex.hpp"
+
+struct ManifestEntry {
+	std::string   m_sopUid{};
+	std::string   m_path{}; // relative to study directory
+	std::uint64_t m_size{0};
+	std::uint64_t m_checksum{0}; // XXH64
+	std::string   m_sha256{};    // empty if not computed
+	std::string   m_transferSyntax{};
+};
+
+/*
+ * Instances of a study directory with hashes computed while they were received, kept in
+ * <study>/.fnostudyqr-manifest. Entries of an existing manifest are kept, instances received
+ * again replace them by SOPInstanceUID.
+ */
+class StudyManifest {
+public:
+	static constexpr const char *FILENAME{".fnostudyqr-manifest"};
+
+	// existing manifest of study_directory is loaded, missing one is no error
+	void load(const std::filesystem::path &study_directory);
+
+	void add(ManifestEntry entry);
+
+	// instance.m_path relative to study directory, sha256 may be empty
+	void add(const IndexedInstance &instance, std::string sha256);
+
+	std::size_t size() const { return m_entries.size(); }
+
+	// written to partial file and renamed
+	bool write(std::string &error_msg) const;
+
+private:
+	std::filesystem::path                m_directory;
+	std::map<std::string, ManifestEntry> m_entries; // by SOPInstanceUID
+};
+
+// entries of manifest file, false if it cannot be read
+bool readManifest(const std::filesystem::path &manifest_path, std::vector<ManifestEntry> &entries);
+
+struct VerifySummary {
+	std::size_t m_manifests{0};
+	std::size_t m_unreadable{0}; // manifests that could not be read
+	std::size_t m_verified{0};
+	std::size_t m_missing{0};
+	std::size_t m_mismatched{0}; // size, XXH64 or SHA-256 differ
+	std::string m_error{};       // directory walk stopped early if set
+
+	// nothing found counts as failure, a wrong directory must not pass
+	bool failed() const {
+		return m_manifests == 0 || m_unreadable + m_missing + m_mismatched > 0 || !m_error.empty();
+	}
+};
+
+/*
+ * Checks every instance listed by manifests below root against its size and hashes,
+ * files are read by threads in parallel. Failures are printed as they are found.
+ */
+VerifySummary verifyManifests(const std::filesystem::path &root, unsigned int threads);
+
+#endif //STUDYMANIFEST_HPP
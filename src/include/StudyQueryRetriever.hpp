@@ -5,6 +5,8 @@
 #ifndef STUDYQUERYRETRIEVER_HPP
 #define STUDYQUERYRETRIEVER_HPP
 
+#include <cstdint>
+#include <mutex>
 #include <string>
 
 #include "dcmtk/config/osconfig.h"
@@ -29,10 +31,19 @@
 
 #include "PatientRecord.hpp"
 #include "Callbacks.hpp"
+#include "OutputLayout.hpp"
+#include "ResponseDecoder.hpp"
+#include "QueryEngine.hpp"
+#include "QuerySinks.hpp"
+#include "RateLimiter.hpp"
+#include "SessionCapture.hpp"
+#include "UringWriter.hpp"
 
 constexpr int EXITCODE_EMPTY_RECORD_LIST        = 10;
 constexpr int EXITCODE_NO_MODALITIES_SPECIFIED = 11;
 constexpr int EXITCODE_TEXT_FILE_ERROR         = 12;
+constexpr int EXITCODE_CANNOT_CREATE_QUERY_IDENTIFIERS = 13;
+constexpr int EXITCODE_VERIFICATION_FAILED             = 14; // --verify found no manifest or a damaged study
 
 constexpr int EXITCODE_CANNOT_INITIALIZE_NETWORK      = 60;
 constexpr int EXITCODE_CANNOT_NEGOTIATE_NETWORK       = 61;
@@ -42,17 +53,18 @@ constexpr int EXITCODE_CANNOT_CLOSE_ASSOCIATION       = 67;
 constexpr int EXITCODE_CMOVE_WARNING                  = 68;
 constexpr int EXITCODE_CMOVE_ERROR                    = 69;
 
-static int      cmove_status_code = EXITCODE_NO_ERROR;
-static OFLogger qrLogger          = OFLog::getLogger("dcmtk.apps.studyQRlogger");
+// one logger shared by all translation units and QueryRetriever instances
+inline OFLogger qrLogger = OFLog::getLogger("dcmtk.apps.studyQRlogger");
 
 class DcmDataset;
 class DcmTransportLayer;
+class ContentStore;
+class InstanceIndex;
 class OFConsoleApplication;
 struct T_ASC_Association;
 struct T_ASC_Parameters;
 struct T_DIMSE_C_FindRQ;
 struct T_DIMSE_C_FindRSP;
-class QueryCallback;
 
 struct QuerySyntax {
 	const char *findSyntax;
@@ -61,6 +73,38 @@ struct QuerySyntax {
 
 using TagValuePair = std::pair<DcmTagKey, OFString>;
 
+// outcome of the last study moved by a QueryRetriever
+struct MoveResult {
+	DIC_US        m_status{STATUS_Success}; // final C-MOVE-RSP
+	DIC_US        m_completed{0};
+	unsigned int  m_stored{0}; // instances and bytes written by local receiver
+	std::uint64_t m_bytes{0};
+};
+
+// query identifier built once, only values of registered keys are patched per request
+class QueryIdentifierTemplate {
+public:
+	OFCondition addKey(const DcmTagKey &key, const char *value = "");
+
+	OFCondition setValue(const DcmTagKey &key, const char *value);
+
+	void clear();
+
+	bool empty() const { return m_elements.empty(); }
+
+	std::vector<DcmTagKey> keys() const;
+
+	DcmDataset *dataset() { return &m_dataset; }
+
+private:
+	DcmDataset                                      m_dataset;
+	std::vector<std::pair<DcmTagKey, DcmElement *>> m_elements;
+};
+
+/*
+ * C-FIND/C-MOVE SCU over one association. Instances share no mutable state and may run on separate
+ * threads; instances attached to one network serialize their moves through its move mutex.
+ */
 class QueryRetriever {
 public:
 	QueryRetriever();
@@ -71,24 +115,89 @@ public:
 
 	OFCondition dropNetwork();
 
+	/*
+	 * Use network initialized elsewhere, it is not dropped by this instance.
+	 * Moves to own receive port are serialized through move_mutex, sub-associations
+	 * arriving on shared port cannot be told apart.
+	 */
+	void attachNetwork(T_ASC_Network *net, std::mutex *move_mutex);
+
+	T_ASC_Network *network() const { return m_net; }
+
+	// peer address, AE titles and output directory
+	void copySettings(const QueryRetriever &other);
+
+	// received instances are added to index, incremental moves skip indexed instances
+	void setInstanceIndex(InstanceIndex *index, const bool incremental) {
+		m_instanceIndex = index;
+		m_incremental   = incremental;
+	}
+
+	// received instances are written into shared store, stored ones are linked instead of moved
+	void setContentStore(ContentStore *store) { m_contentStore = store; }
+
+	// SHA-256 is computed besides XXH64 for study manifests
+	void setSha256(const bool sha256) { m_sha256 = sha256; }
+
+	// backend writing instance files of local receives
+	void setWriteBackend(const WriteBackend backend) { m_writeBackend = backend; }
+
+	// received data is read no faster than limiter allows
+	void setRateLimiter(RateLimiter *limiter) { m_rateLimiter = limiter; }
+
+	// DIMSE traffic of finds and moves is recorded if set
+	void setSessionCapture(SessionCapture *capture) { m_capture = capture; }
+
+	// study directories were created by caller before moves, no filesystem checks per study
+	void setDirectoriesPrepared(const bool prepared) { m_directoriesPrepared = prepared; }
+
 	OFCondition setupAssociation();
 
+	// keeps idle association, renegotiates if peer released/aborted it meanwhile
+	OFCondition ensureAssociation();
+
+	OFCondition releaseAssociation();
+
 	OFCondition removeAssociation(const OFCondition &queryCondition);
 
 	OFCondition addPresentationContext(E_TransferSyntax            outNetworkTransferSyntax,
 	                                   T_ASC_PresentationContextID presID,
 	                                   const char *                abstractSyntax) const;
 
-	OFCondition performFindRequest(PatientRecord &    patient_record,
-	                               const std::string &modalities,
-	                               QueryCallback *    callback) const;
+	// build C-FIND identifiers once, call before performFindRequest/dumpTags
+	OFCondition prepareFindIdentifiers(const std::string &modalities);
+
+	OFCondition prepareDumpIdentifiers(const std::vector<TagValuePair> &query_tags);
+
+	// collect StudyInstanceUIDs of record's studies
+	OFCondition performFindRequest(PatientRecord &patient_record);
+
+	// matched studies with StudyDate and instance count, record's uid list is not touched
+	OFCondition findStudies(const PatientRecord &patient_record, std::vector<StudyInfo> &studies);
 
 	OFCondition performMoveRequest(const PatientRecord &patient_record);
 
-	OFCondition dumpTags(const PatientRecord &      patient_record,
-	                     const std::string &        dump_filepath,
-	                     std::vector<TagValuePair> &query_tags,
-	                     QueryCallback *            callback) const;
+	// series level C-FIND for each study of record, results are passed to sink
+	template<FindResultSink Sink>
+	OFCondition dumpTags(const PatientRecord &patient_record, Sink &sink);
+
+	// final C-FIND-RSP status of last query
+	DIC_US lastFindStatus() const { return m_lastFindStatus; }
+
+	const MoveResult &lastMove() const { return m_lastMove; }
+
+	// final C-MOVE-RSP of last moved study
+	DIC_US lastMoveStatus() const { return m_lastMove.m_status; }
+
+	DIC_US lastMoveCompleted() const { return m_lastMove.m_completed; }
+
+	// instances and bytes written by local receiver during last move
+	unsigned int lastMoveStored() const { return m_lastMove.m_stored; }
+
+	std::uint64_t lastMoveBytes() const { return m_lastMove.m_bytes; }
+
+	// EXITCODE_CMOVE_WARNING/ERROR once a move of this instance ended with failed sub-operations or error
+	int moveExitCode() const { return m_moveExitCode; }
 
 	unsigned short        m_port{0}; // tcp/ip port of peer
 	unsigned short        m_retrievePort{0};
@@ -98,10 +207,42 @@ public:
 	std::string           m_calledAETitle{};   // aep
 	std::string           m_receiverAETitle{}; // aer
 	std::string           m_outputDirectory{};
+	OutputLayout          m_outputLayout{};
 	std::string           m_studyDirectory{};
 
 private:
+	OFCondition patchFindIdentifiers(const PatientRecord &patient_record);
+
+	/*
+	 * After a move finishing with failed sub-operations, lists the study's instances with SERIES/IMAGE level
+	 * C-FIND and requests those missing in context by instance level C-MOVE.
+	 */
+	OFCondition fillMissingInstances(const PatientRecord &patient_record,
+	                                 const std::string &  study_uid,
+	                                 const std::string &  study_directory,
+	                                 ReceiveContext &     context,
+	                                 std::size_t &        still_missing);
+
+	// fills request, returns 0 if no C-FIND presentation context was accepted
+	T_ASC_PresentationContextID prepareFindRequest(T_DIMSE_C_FindRQ &request, T_DIMSE_Priority priority) const;
+
+	template<FindResultSink Sink>
+	OFCondition find(QueryIdentifierTemplate &identifiers,
+	                 FindResponseDecoder &    decoder,
+	                 T_DIMSE_Priority         priority,
+	                 Sink &                   sink);
+
+	InstanceIndex *    m_instanceIndex{nullptr};
+	bool               m_incremental{false};
+	ContentStore *     m_contentStore{nullptr};
+	bool               m_directoriesPrepared{false};
+	bool               m_sha256{false};
+	WriteBackend       m_writeBackend{WriteBackend::STDIO};
+	RateLimiter *      m_rateLimiter{nullptr};
+	SessionCapture *   m_capture{nullptr};
 	T_ASC_Network *    m_net{nullptr};
+	bool               m_ownsNetwork{true};
+	std::mutex *       m_moveMutex{nullptr};
 	T_ASC_Association *m_assoc{nullptr};
 	T_ASC_Parameters * m_params{nullptr};
 	OFBool             m_secureConnection{OFFalse};
@@ -114,126 +255,19 @@ private:
 	OFBool               m_ignorePendingDatasets{OFTrue};
 	int                  m_acseTimeout{30};
 	int                  m_dimseTimeout{0};
-};
-
-class QueryCallback {
-public:
-	QueryCallback();
-
-	virtual ~QueryCallback() = default;
-
-	// store received uids to std::set
-	virtual void callback(T_DIMSE_C_FindRQ *     request,
-	                      int                    responseCount,
-	                      T_DIMSE_C_FindRSP *    response,
-	                      DcmDataset *           responseIdentifiers,
-	                      std::set<std::string> &uid_list) = 0;
 
-	// write received tags to file
-	virtual void callback(T_DIMSE_C_FindRQ *         request,
-	                      int                        response_count,
-	                      T_DIMSE_C_FindRSP *        response,
-	                      DcmDataset *               response_identifiers,
-	                      const std::string &        dump_filepath,
-	                      std::vector<TagValuePair> &query_tags) = 0;
+	// run state, each instance serves its own association and may run on its own thread
+	DIC_US     m_lastFindStatus{STATUS_Success};
+	MoveResult m_lastMove{};
+	int        m_moveExitCode{EXITCODE_NO_ERROR};
 
-	void setAssociation(T_ASC_Association *assoc);
-
-	void setPresentationContextID(T_ASC_PresentationContextID pres_id);
-
-protected:
-	T_ASC_Association *         m_assoc;
-	T_ASC_PresentationContextID m_presID;
-};
-
-class QueryDefaultCallback final : public QueryCallback {
-public:
-	explicit QueryDefaultCallback(int cancelAfterNResponses);
-
-	~QueryDefaultCallback() override = default;
-
-	// store received study uids to std::set
-	void callback(T_DIMSE_C_FindRQ *     request,
-	              int                    response_count,
-	              T_DIMSE_C_FindRSP *    response,
-	              DcmDataset *           response_identifiers,
-	              std::set<std::string> &uid_list) override;
-
-	// write received tags to file
-	void callback(T_DIMSE_C_FindRQ *         request,
-	              int                        response_count,
-	              T_DIMSE_C_FindRSP *        response,
-	              DcmDataset *               response_identifiers,
-	              const std::string &        dump_filepath,
-	              std::vector<TagValuePair> &query_tags) override;
-
-	bool containsFilterWord(const OFString& string_val) const;
-
-private:
-	const int m_cancelAfterNResponses{0};
-	bool m_ignoreEmptyTags{false};
-	const std::set<OFString> m_filterWords{"secondary", "derived", "localizer", "topog", "scout", "report", "dose", "protocol"};
+	QueryIdentifierTemplate m_findIdentifiers;
+	QueryIdentifierTemplate m_dumpIdentifiers;
+	FindResponseDecoder     m_findDecoder;
+	FindResponseDecoder     m_dumpDecoder;
 };
 
-static void progressCallback(void *                 callback_data,
-                             T_DIMSE_C_FindRQ *     request,
-                             int                    response_count,
-                             T_DIMSE_C_FindRSP *    response,
-                             DcmDataset *           response_identifiers,
-                             std::set<std::string> &uid_list);
-
-// store received tags to file
-static void progressCallback(void *                     callback_data,
-                             T_DIMSE_C_FindRQ *         request,
-                             int                        response_count,
-                             T_DIMSE_C_FindRSP *        response,
-                             DcmDataset *               response_identifiers,
-                             const std::string &        dump_filepath,
-                             std::vector<TagValuePair> &query_tags);
-
-typedef void (*DIMSE_QueryUserCallback)(void *                 callbackData,
-                                        T_DIMSE_C_FindRQ *     request,
-                                        int                    responseCount,
-                                        T_DIMSE_C_FindRSP *    response,
-                                        DcmDataset *           responseIdentifiers,
-                                        std::set<std::string> &uid_list);
-
-// store received tags to file
-typedef void (*DIMSE_DumpUserCallback)(void *                     callbackData,
-                                       T_DIMSE_C_FindRQ *         request,
-                                       int                        responseCount,
-                                       T_DIMSE_C_FindRSP *        response,
-                                       DcmDataset *               responseIdentifiers,
-                                       const std::string &        dump_filepath,
-                                       std::vector<TagValuePair> &query_tags);
-
-OFCondition DIMSE_queryUser(T_ASC_Association *         assoc,
-                            T_ASC_PresentationContextID pres_id,
-                            T_DIMSE_C_FindRQ *          request,
-                            DcmDataset *                request_identifiers,
-                            int                         response_count,
-                            DIMSE_QueryUserCallback     callback,
-                            void *                      callback_data,
-                            T_DIMSE_BlockingMode        block_mode,
-                            int                         timeout,
-                            T_DIMSE_C_FindRSP *         response,
-                            DcmDataset **               status_detail,
-                            std::set<std::string> &     uid_list);
-
-// store received tags to file
-OFCondition DIMSE_queryUser(T_ASC_Association *         assoc,
-                            T_ASC_PresentationContextID pres_id,
-                            T_DIMSE_C_FindRQ *          request,
-                            DcmDataset *                request_identifiers,
-                            int                         response_count,
-                            DIMSE_DumpUserCallback      callback,
-                            void *                      callback_data,
-                            T_DIMSE_BlockingMode        block_mode,
-                            int                         timeout,
-                            T_DIMSE_C_FindRSP *         response,
-                            DcmDataset **               status_detail,
-                            const std::string &         dump_filepath,
-                            std::vector<TagValuePair> & query_tags);
+T_DIMSE_Priority toDimsePriority(RecordPriority priority);
 
 OFCondition DIMSE_moveUser_(T_ASC_Association *          assoc,
                             T_ASC_PresentationContextID  pres_id,
@@ -254,6 +288,72 @@ OFCondition DIMSE_moveUser_(T_ASC_Association *          assoc,
                             const std::string &          output_directory);
 
 
+template<FindResultSink Sink>
+OFCondition QueryRetriever::find(QueryIdentifierTemplate &identifiers,
+                                 FindResponseDecoder &    decoder,
+                                 const T_DIMSE_Priority   priority,
+                                 Sink &                   sink) {
+	T_DIMSE_C_FindRQ  request{};
+	T_DIMSE_C_FindRSP response{};
+	DcmDataset *      statusDetail = nullptr;
+
+	const T_ASC_PresentationContextID presID = prepareFindRequest(request, priority);
+	if (presID == 0) {
+		OFLOG_FATAL(qrLogger, "No presentation context");
+		return DIMSE_NOVALIDPRESENTATIONCONTEXTID;
+	}
+
+	const std::uint64_t session = m_capture != nullptr ? m_capture->findRequest(*identifiers.dataset()) : 0;
+	CaptureSink<Sink>   captureSink(m_capture, session, sink);
+
+	OFLOG_INFO(qrLogger, fmt::format("Sending FIND Request (MsgID {})\n", request.MessageID));
+	const OFCondition cond = DIMSE_queryUser(m_assoc,
+	                                         presID,
+	                                         &request,
+	                                         identifiers.dataset(),
+	                                         decoder,
+	                                         m_cancelAfterNResponses,
+	                                         m_blockMode,
+	                                         m_dimseTimeout,
+	                                         &response,
+	                                         &statusDetail,
+	                                         captureSink);
+	if (cond.bad()) {
+		OFString temp_string;
+		OFLOG_ERROR(qrLogger, DimseCondition::dump(temp_string, cond).c_str());
+	}
+	m_lastFindStatus = cond.good() ? response.DimseStatus : STATUS_FIND_Failed_UnableToProcess;
+	if (m_capture != nullptr)
+		m_capture->findResponse(session, m_lastFindStatus, nullptr);
+
+	delete statusDetail;
+	return cond;
+}
+
+template<FindResultSink Sink>
+OFCondition QueryRetriever::dumpTags(const PatientRecord &patient_record, Sink &sink) {
+	if (m_dumpIdentifiers.empty()) {
+		OFLOG_FATAL(qrLogger, "C-FIND identifiers not prepared");
+		return EC_IllegalCall;
+	}
+
+	m_dumpIdentifiers.setValue(DCM_PatientID, patient_record.m_id.c_str());
+	m_dumpIdentifiers.setValue(DCM_Modality, patient_record.m_modality.c_str());
+
+	// receive C-FIND response with requested tags (override_tags) for each study
+	OFCondition cond = EC_Normal;
+	for (const auto &uid : patient_record.m_uid_list) {
+		m_dumpIdentifiers.setValue(DCM_StudyInstanceUID, uid.c_str());
+		cond = find(m_dumpIdentifiers, m_dumpDecoder, toDimsePriority(patient_record.m_priority), sink);
+		if (cond.bad())
+			break;
+	}
+	return cond;
+}
+
+// gggg,eeee or dictionary name, optionally followed by =value
+OFCondition parseQueryTag(const char *tag_string, DcmTag &tag, std::string &error_msg);
+
 DcmTag prepareQueryTag(OFConsoleApplication &app, const char *tag_string);
 
 std::string formatValues(const std::vector<TagValuePair> &query_tags);
@@ -0,0 +1,45 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef TRANSFERPLAN_HPP
+#define TRANSFERPLAN_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "PatientRecord.hpp"
+#include "QuerySinks.hpp"
+
+struct PlannedStudy {
+	StudyInfo      m_study{};
+	RecordPriority m_priority{RecordPriority::MEDIUM};
+	std::uint64_t  m_estimatedBytes{0}; // 0 if NumberOfStudyRelatedInstances was not returned
+};
+
+struct PlanSummary {
+	std::uint64_t m_instances{0};
+	std::uint64_t m_estimatedBytes{0};
+	std::size_t   m_unknownSize{0}; // studies without instance count
+	double        m_throughput{0};  // bytes per second of earlier moves, 0 if none recorded
+};
+
+PlanSummary summarizePlan(const std::vector<PlannedStudy> &studies, double throughput);
+
+// "3h 25min", "unknown" if no throughput was recorded
+std::string formatPlanDuration(const PlanSummary &summary);
+
+/*
+ * Tab separated, one study per line in move order. Lines starting with '#' carry totals and
+ * the column header, they are skipped when the plan is read.
+ */
+bool writeTransferPlan(const std::filesystem::path &     path,
+                       const std::vector<PlannedStudy> &studies,
+                       const PlanSummary &              summary,
+                       std::string &                    error_msg);
+
+bool readTransferPlan(const std::filesystem::path &path, std::vector<PlannedStudy> &studies, std::string &error_msg);
+
+#endif //TRANSFERPLAN_HPP
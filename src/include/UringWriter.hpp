@@ -0,0 +1,106 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef URINGWRITER_HPP
+#define URINGWRITER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "InstanceWriter.hpp"
+
+enum class WriteBackend {
+	STDIO,
+	IO_URING,
+	IO_URING_DIRECT, // O_DIRECT, page cache bypassed
+};
+
+// stdio, io_uring or io_uring-direct, io_uring ones only if built with liburing
+bool parseWriteBackend(std::string_view value, WriteBackend &backend);
+
+#ifdef FNOSTUDYQR_WITH_URING
+
+struct io_uring;
+
+/*
+ * io_uring with a pool of aligned buffers, shared by the instances received on one association.
+ * Full buffers are queued as writes and submitted in batches once no buffer is free,
+ * instances are received one at a time so every completion belongs to the current file.
+ */
+class UringWriter {
+public:
+	static constexpr std::size_t  BUFFER_SIZE{128 * 1024};
+	static constexpr std::size_t  DIRECT_ALIGNMENT{4096};
+	static constexpr unsigned int QUEUE_DEPTH{16};
+
+	UringWriter();
+
+	~UringWriter();
+
+	UringWriter(const UringWriter &) = delete;
+
+	UringWriter &operator=(const UringWriter &) = delete;
+
+	bool open(bool direct, std::string &error_msg);
+
+	bool direct() const { return m_direct; }
+
+	// free buffer, waits for a completion if all are in flight, nullptr after failed write
+	char *acquire();
+
+	// buffer from acquire() is written to fd at offset and free again once completed
+	void queue(int fd, char *buffer, std::size_t length, std::uint64_t offset);
+
+	// submits queued writes and waits for all of them, false if any failed
+	bool drain();
+
+private:
+	void submit();
+
+	bool reap();
+
+	std::unique_ptr<io_uring> m_ring;
+	char *                    m_memory{nullptr}; // QUEUE_DEPTH buffers
+	std::vector<std::size_t>  m_lengths;         // requested length of buffers in flight
+	std::vector<std::size_t>  m_free;            // indices of free buffers
+	unsigned int              m_queued{0};       // prepared, not submitted yet
+	unsigned int              m_inFlight{0};
+	bool                      m_direct{false};
+	bool                      m_failed{false};
+};
+
+// writes received bytes to a file through UringWriter
+class UringFileConsumer : public ChecksumConsumer {
+public:
+	// file is preallocated to size_hint, trimmed to the received size on close
+	UringFileConsumer(UringWriter &writer, const std::string &path, std::uint64_t size_hint);
+
+	~UringFileConsumer() override;
+
+	UringFileConsumer(const UringFileConsumer &) = delete;
+
+	UringFileConsumer &operator=(const UringFileConsumer &) = delete;
+
+	// waits for pending writes and closes file
+	OFCondition close() override;
+
+protected:
+	std::size_t store(const void *buf, std::size_t length) override;
+
+private:
+	UringWriter & m_writer;
+	int           m_fd{-1};
+	bool          m_direct{false};
+	char *        m_buffer{nullptr};
+	std::size_t   m_filled{0};
+	std::uint64_t m_offset{0};    // file offset of m_buffer
+	std::uint64_t m_allocated{0}; // preallocated or padded size to trim
+};
+
+#endif
+
+#endif //URINGWRITER_HPP
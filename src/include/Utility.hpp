@@ -0,0 +1,38 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef UTILITY_HPP
+#define UTILITY_HPP
+
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// sizes in reports, plans and limits
+inline constexpr std::uint64_t MIB{1024 * 1024};
+
+// fields of a line of the tab separated state files, empty fields are kept
+std::vector<std::string> splitFields(std::string_view line, char separator);
+
+// whole value must be a number in base, empty values and trailing characters fail
+template<typename T>
+bool parseNumber(const std::string_view value, T &number, const int base = 10) {
+	const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), number, base);
+	return !value.empty() && ec == std::errc{} && end == value.data() + value.size();
+}
+
+/*
+ * Content is written to <path>.part, which replaces path only once it was written completely,
+ * readers never see a partial file. The partial file is removed on failure.
+ */
+bool writeFileAtomically(const std::filesystem::path &                path,
+                         const std::function<void(std::ostream &)> &write_content,
+                         std::string &                               error_msg);
+
+#endif //UTILITY_HPP
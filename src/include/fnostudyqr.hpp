@@ -0,0 +1,26 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef FNOSTUDYQR_HPP
+#define FNOSTUDYQR_HPP
+
+/*
+ * Public header of the fnostudyqr_core library, embedding callers include only this one:
+ *   readPatientRecords, PatientRecord       patient list parsing
+ *   QueryRetriever                          one association, findStudies returns StudyInfo of matched
+ *                                           studies, performMoveRequest leaves its outcome in lastMove()
+ *   PeerPool, runJob                        several peers and whole jobs as run by the command line tool
+ * Associations stay open between calls (ensureAssociation), one QueryRetriever or PeerPool per thread.
+ */
+
+// FNOSTUDYQR_VERSION and its parts, generated by CMake
+#include "fnostudyqrVersion.hpp"
+
+#include "JobRunner.hpp"
+#include "PatientRecord.hpp"
+#include "PeerPool.hpp"
+#include "QuerySinks.hpp"
+#include "StudyQueryRetriever.hpp"
+
+#endif //FNOSTUDYQR_HPP
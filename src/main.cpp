@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <thread>
 
 #include "fmt/chrono.h"
 #include "fmt/color.h"
@@ -12,14 +14,20 @@
 #include "dcmtk/dcmdata/cmdlnarg.h"
 #include "dcmtk/ofstd/ofconapp.h"
 
+#include "JobRunner.hpp"
 #include "PatientRecord.hpp"
+#include "PeerPool.hpp"
+#include "QueryPlanner.hpp"
+#include "ServiceMode.hpp"
+#include "StudyManifest.hpp"
 #include "StudyQueryRetriever.hpp"
-
-enum E_addModalities { ADD_MODALITIES_ALL, ADD_MODALITIES_MISSING };
+#include "TransferPlan.hpp"
+#include "Utility.hpp"
+#include "fnostudyqr.hpp"
 
 int main(int argc, char *argv[]) {
   constexpr auto FNO_CONSOLE_APPLICATION{"fnostudyqr"};
-  constexpr auto *APP_VERSION{"0.7.2"};
+  constexpr auto *APP_VERSION{FNOSTUDYQR_VERSION};
   constexpr auto APP_RELEASE_DATE{"2025-01-05"};
 
   const std::string rcsid =
@@ -52,19 +60,42 @@ int main(int argc, char *argv[]) {
   const char *opt_aeReceiver{USER_APPLICATION_TITLE}; // ae-receiver/aem
 
   OFString opt_outputDirectory{"./download"};
+  OFString opt_storeDirectory{};
   const char *opt_filepath{nullptr}; // filepath to queried patient list
 
   const char *opt_queryModality{nullptr};
   E_addModalities opt_addModalities{E_addModalities::ADD_MODALITIES_MISSING};
 
   std::vector<OFString> opt_overrideTags{};
+  OFBool opt_coalesceQueries{OFFalse};
+  OFCmdUnsignedInt opt_findLimit{0};
+  const char *opt_sweepRange{nullptr};
+  OFCmdUnsignedInt opt_sweepThreads{4};
+  const char *opt_planFile{nullptr};
+  const char *opt_executePlan{nullptr};
   OFBool opt_retrieveTags{OFFalse};
   OFBool opt_retrieveFiles{OFFalse};
+  OFBool opt_incremental{OFFalse};
+  OFBool opt_skipPresent{OFFalse};
+  OFBool opt_sha256{OFFalse};
+  WriteBackend opt_writeBackend{WriteBackend::STDIO};
 
   OFString opt_dumpFilepath{"./dumped_tags"};
+  E_dumpFormat opt_dumpFormat{E_dumpFormat::DUMP_FORMAT_CSV};
+  OutputLayout opt_outputLayout{};
   OFBool opt_logMissingStudies{OFTrue};
   studyDateRangeExtend opt_extendStudyDate{};
 
+  std::vector<PeerAddress> opt_peers{};
+
+  const char *opt_spoolDirectory{nullptr};
+  OFCmdUnsignedInt opt_serviceWorkers{2};
+  OFCmdUnsignedInt opt_servicePoll{2};
+
+  AdmissionLimits opt_admissionLimits{};
+  std::vector<RateWindow> opt_rateSchedule{};
+  const char *opt_captureFile{nullptr};
+
   cmd.setParamColumn(LONGCOL + SHORTCOL + 4);
   cmd.addParam("pacs-ip", "hostname of DICOM peer");
   cmd.addParam("pacs-port", "tcp/ip port number of peer");
@@ -75,6 +106,10 @@ int main(int argc, char *argv[]) {
                 OFCommandLine::AF_Exclusive);
   cmd.addOption("--version", "print version information and exit",
                 OFCommandLine::AF_Exclusive);
+  cmd.addOption("--verify", "-vf", 1, "[d]irectory: string",
+                "check instances listed by study manifests below d\n"
+                "against size and hashes, then exit",
+                OFCommandLine::AF_Exclusive);
   OFLog::addOptions(cmd);
 
   cmd.addGroup("network options:");
@@ -97,6 +132,11 @@ int main(int argc, char *argv[]) {
                             USER_APPLICATION_TITLE)
                     .c_str());
 
+  cmd.addSubGroup("additional peers:");
+  cmd.addOption("--peer", "-peer", 1, "[p]eer: host:port[:aetitle]",
+                "also query peer p, studies are moved from fastest peer\n"
+                "holding them (AE title defaults to --ae-pacs)");
+
   cmd.addSubGroup("port for incoming network associations:");
   cmd.addOption("--receive-port", "-port", 1, "[n]umber: integer",
                 "port number for incoming associations");
@@ -105,7 +145,7 @@ int main(int argc, char *argv[]) {
   cmd.addOption(
       "--patient-list-file", "-plist", 1, "filepath: string path",
       "text file with patient/study information to query/retrieve\nrequired "
-      "order: PatientName,PatientID,StudyDate,(Modality)");
+      "order: PatientID;StudyDate;(Modality);(Priority: high, medium, low)");
   cmd.addOption(
       "--add-modality-missing", "-am", 1, "modality: string",
       "add modality to missing modalities in read patient records (default)");
@@ -119,20 +159,87 @@ int main(int argc, char *argv[]) {
       "extend all study dates to range match <date1> - <date2>\n<date1> = "
       "StudyDate - month\n<date2> = StudyDate + month");
 
+  cmd.addOption("--coalesce", "-co",
+                "one C-FIND per patient for overlapping/adjacent study dates,\n"
+                "studies are assigned to records by StudyDate");
+  cmd.addOption("--find-limit", "-fl", 1, "[n]umber: integer (default: 0)",
+                "C-FIND match limit of PACS, capped results are re-queried\n"
+                "by bisecting StudyDate (then StudyTime)");
+  cmd.addOption("--sweep-range", "-sr", 1, "[r]ange: YYYYMMDD-YYYYMMDD",
+                "query studies of all patients in date range instead of\n"
+                "patient list, splitting windows hitting --find-limit");
+  cmd.addOption("--sweep-threads", 1, "[n]umber: integer (default: 4)",
+                "number of concurrent sweep queries");
+  cmd.addOption("--plan", "-pl", 1, "[f]ile: string",
+                "dry run, only find studies and write them with size\n"
+                "estimates and projected duration to plan f");
+  cmd.addOption("--execute-plan", "-xp", 1, "[f]ile: string",
+                "move studies of plan f written by --plan, find is skipped");
+
   cmd.addGroup("output options:");
   cmd.addOption("--output-directory", "-od", 1,
                 "[d]irectory: string (default: \"./download\"",
                 "write received data to directory d");
+  cmd.addOption("--layout", "-ly", 1,
+                "[l]ayout: flat, sharded, series, sharded-series (default: flat)",
+                "sharded: <d>/<xx>/<yy>/<StudyInstanceUID>,\n"
+                "series: instances in <study>/<SeriesInstanceUID>");
+  cmd.addOption("--archive", "-ar", 1,
+                "[f]ormat: none, tar, tar.zst (default: none)",
+                "append instances of each study to <study>.tar[.zst]\n"
+                "as received, index written at study completion");
+  cmd.addOption("--write-backend", "-wb", 1,
+                "[b]ackend: stdio, io_uring, io_uring-direct (default: stdio)",
+                "write received instances through io_uring with batched\n"
+                "submissions, io_uring-direct bypasses page cache (O_DIRECT)");
+  cmd.addOption("--store", "-st", 1, "[d]irectory: string",
+                "keep received instances once in content store d,\n"
+                "output directory gets links, stored instances are not moved");
   cmd.addOption(
       "--dump-filepath", "-df", 1,
       "[f]ilepath: string (default: \"<output-directory>/dumped_tags.csv\")",
       "CSV filepath to write retrieved tags, excluding extension");
+  cmd.addOption("--dump-format", "-dfmt", 1, "[f]ormat: csv, json (default: csv)",
+                "format of retrieved tags, json writes one UTF-8 object per line");
   cmd.addOption("--retrieve-tags", "-rt",
                 "retrieve queried tags and store them to CSV");
   cmd.addOption("--retrieve-files", "-rf",
                 "perform C-MOVE request for queried tags");
+  cmd.addOption("--sha256", "-sha",
+                "also compute SHA-256 of received instances for study\n"
+                "manifests (XXH64 is always computed)");
+  cmd.addOption("--incremental", "-inc",
+                "move only instances missing in output directory's index\n"
+                "(.fnostudyqr-index, maintained by every local receive)");
+  cmd.addOption("--skip-present", "-sp",
+                "records and studies moved completely by earlier runs into\n"
+                "output directory skip C-FIND/C-MOVE (.fnostudyqr-studies)");
   cmd.addOption("--no-missing-file", "-nf",
                 "disable writing missing studies to file");
+  cmd.addOption("--capture", "-cap", 1, "[f]ile: string",
+                "record C-FIND/C-MOVE traffic and received instances to f\n"
+                "for offline replay (fnostudyqr-replay)");
+
+  cmd.addSubGroup("admission control of moves:");
+  cmd.addOption("--min-free-space", "-mfs", 1, "[n]umber: MiB (default: 0)",
+                "pause moves while free space of output volume minus\n"
+                "estimated size of admitted studies would drop below n");
+  cmd.addOption("--max-dirty", "-mdy", 1, "[n]umber: MiB (default: 0)",
+                "pause moves while more than n MiB of received data\n"
+                "wait in page cache for writeback (Linux)");
+  cmd.addOption("--rate-limit", "-rl", 1,
+                "[s]chedule: HH:MM-HH:MM=Mbit/s[,...]",
+                "receive at most given rate within time windows, 0 starts\n"
+                "no moves, unlimited outside windows (e.g. 07:00-18:00=100)");
+
+  cmd.addGroup("service options:");
+  cmd.addOption("--service", "-srv", 1, "[d]irectory: string",
+                "run as service, process *.job patient lists dropped into "
+                "spool directory d\nother options are defaults of jobs");
+  cmd.addOption("--service-workers", "-sw", 1, "[n]umber: integer (default: 2)",
+                "number of jobs processed concurrently");
+  cmd.addOption("--service-poll", 1, "seconds: integer (default: 2)",
+                "interval of spool directory scans");
 
   prepareCmdLineArgs(argc, argv, FNO_CONSOLE_APPLICATION);
   if (app.parseCommandLine(cmd, argc, argv)) {
@@ -141,6 +248,22 @@ int main(int argc, char *argv[]) {
         app.printHeader(OFTrue);
         return EXITCODE_NO_ERROR;
       }
+      if (cmd.findOption("--verify")) {
+        const char *verifyDirectory{nullptr};
+        app.checkValue(cmd.getValue(verifyDirectory));
+        const VerifySummary summary = verifyManifests(
+            verifyDirectory, std::max(1u, std::thread::hardware_concurrency()));
+        fmt::print("{} manifest(s), {} unreadable, {} instance(s) verified, "
+                   "{} missing, {} mismatched\n",
+                   summary.m_manifests, summary.m_unreadable,
+                   summary.m_verified, summary.m_missing,
+                   summary.m_mismatched);
+        if (summary.m_manifests == 0 && summary.m_error.empty())
+          OFLOG_ERROR(qrLogger, fmt::format("No manifest found below {}",
+                                            verifyDirectory));
+        return summary.failed() ? EXITCODE_VERIFICATION_FAILED
+                                : EXITCODE_NO_ERROR;
+      }
     }
 
     cmd.getParam(1, opt_pacsIP); // ip address of PACS
@@ -166,6 +289,20 @@ int main(int argc, char *argv[]) {
       queryRetriever.m_receiverAETitle = opt_aeReceiver;
     }
 
+    if (cmd.findOption("--peer", 0, OFCommandLine::FOM_FirstFromLeft)) {
+      do {
+        const char *peerValue{nullptr};
+        app.checkValue(cmd.getValue(peerValue));
+        PeerAddress peer{};
+        if (!parsePeerAddress(peerValue, peer))
+          app.printError(
+              fmt::format("invalid --peer \"{}\", expected host:port[:aetitle]",
+                          peerValue)
+                  .c_str());
+        opt_peers.push_back(peer);
+      } while (cmd.findOption("--peer", 0, OFCommandLine::FOM_NextFromLeft));
+    }
+
     if (cmd.findOption("--receive-port")) {
       app.checkValue(cmd.getValueAndCheckMinMax(opt_recievePort, 1, 65535));
       queryRetriever.m_retrievePort =
@@ -176,6 +313,34 @@ int main(int argc, char *argv[]) {
       app.checkValue(cmd.getValue(opt_outputDirectory));
     }
 
+    if (cmd.findOption("--layout")) {
+      OFString layout;
+      app.checkValue(cmd.getValue(layout));
+      if (!parseOutputLayout(layout.c_str(), opt_outputLayout))
+        app.printError(
+            "unknown --layout, expected flat, sharded, series or sharded-series");
+    }
+
+    if (cmd.findOption("--archive")) {
+      OFString archive;
+      app.checkValue(cmd.getValue(archive));
+      if (!parseArchiveFormat(archive.c_str(), opt_outputLayout.m_archive))
+        app.printError("unknown --archive, expected none, tar or tar.zst "
+                       "(tar.zst requires zstd support)");
+    }
+
+    if (cmd.findOption("--write-backend")) {
+      OFString backend;
+      app.checkValue(cmd.getValue(backend));
+      if (!parseWriteBackend(backend.c_str(), opt_writeBackend))
+        app.printError("unknown --write-backend, expected stdio, io_uring or "
+                       "io_uring-direct (io_uring requires liburing support)");
+    }
+
+    if (cmd.findOption("--store")) {
+      app.checkValue(cmd.getValue(opt_storeDirectory));
+    }
+
     if (cmd.findOption("--patient-list-file"))
       app.checkValue(cmd.getValue(opt_filepath));
 
@@ -208,6 +373,46 @@ int main(int argc, char *argv[]) {
       app.checkValue(cmd.getValue(opt_dumpFilepath));
     }
 
+    if (cmd.findOption("--dump-format")) {
+      OFString dumpFormat;
+      app.checkValue(cmd.getValue(dumpFormat));
+      if (dumpFormat == "json")
+        opt_dumpFormat = E_dumpFormat::DUMP_FORMAT_JSON;
+      else if (dumpFormat == "csv")
+        opt_dumpFormat = E_dumpFormat::DUMP_FORMAT_CSV;
+      else
+        app.printError("unknown --dump-format, expected csv or json");
+    }
+
+    if (cmd.findOption("--coalesce")) {
+      opt_coalesceQueries = OFTrue;
+    }
+
+    if (cmd.findOption("--find-limit")) {
+      app.checkValue(cmd.getValueAndCheckMin(opt_findLimit, 0));
+    }
+
+    if (cmd.findOption("--sweep-range")) {
+      app.checkValue(cmd.getValue(opt_sweepRange));
+      DateRange range;
+      if (!parseDateRange(opt_sweepRange, range))
+        app.printError("invalid --sweep-range, expected YYYYMMDD-YYYYMMDD");
+    }
+
+    if (cmd.findOption("--sweep-threads")) {
+      app.checkValue(cmd.getValueAndCheckMinMax(opt_sweepThreads, 1, 64));
+    }
+
+    if (cmd.findOption("--plan")) {
+      app.checkValue(cmd.getValue(opt_planFile));
+    }
+
+    if (cmd.findOption("--execute-plan")) {
+      app.checkValue(cmd.getValue(opt_executePlan));
+      if (opt_planFile != nullptr)
+        app.printError("--plan and --execute-plan are mutually exclusive");
+    }
+
     if (cmd.findOption("--retrieve-tags")) {
       opt_retrieveTags = OFTrue;
     }
@@ -216,10 +421,52 @@ int main(int argc, char *argv[]) {
       opt_retrieveFiles = OFTrue;
     }
 
+    if (cmd.findOption("--incremental")) {
+      opt_incremental = OFTrue;
+    }
+
+    if (cmd.findOption("--skip-present")) {
+      opt_skipPresent = OFTrue;
+    }
+
+    if (cmd.findOption("--sha256")) {
+      opt_sha256 = OFTrue;
+    }
+
+    if (opt_outputLayout.m_archive != ArchiveFormat::NONE &&
+        (opt_incremental || !opt_storeDirectory.empty()))
+      app.printError(
+          "--archive cannot be combined with --incremental or --store");
+
     if (cmd.findOption("--no-missing-log")) {
       opt_logMissingStudies = OFFalse;
     }
 
+    if (cmd.findOption("--capture")) {
+      app.checkValue(cmd.getValue(opt_captureFile));
+    }
+
+    if (cmd.findOption("--min-free-space")) {
+      OFCmdUnsignedInt mebibytes{0};
+      app.checkValue(cmd.getValue(mebibytes));
+      opt_admissionLimits.m_minFreeBytes =
+          OFstatic_cast(std::uint64_t, mebibytes) * MIB;
+    }
+
+    if (cmd.findOption("--max-dirty")) {
+      OFCmdUnsignedInt mebibytes{0};
+      app.checkValue(cmd.getValue(mebibytes));
+      opt_admissionLimits.m_maxDirtyBytes =
+          OFstatic_cast(std::uint64_t, mebibytes) * MIB;
+    }
+
+    if (cmd.findOption("--rate-limit")) {
+      const char *schedule{nullptr};
+      app.checkValue(cmd.getValue(schedule));
+      if (!parseRateSchedule(schedule, opt_rateSchedule))
+        app.printError("invalid --rate-limit, expected HH:MM-HH:MM=Mbit/s[,...]");
+    }
+
     if (cmd.findOption("--extend-date")) {
       // OFCmdUnsignedInt year{};
       OFCmdUnsignedInt month{};
@@ -230,6 +477,18 @@ int main(int argc, char *argv[]) {
       opt_extendStudyDate.byMonth = OFstatic_cast(unsigned int, month);
     }
 
+    if (cmd.findOption("--service")) {
+      app.checkValue(cmd.getValue(opt_spoolDirectory));
+    }
+
+    if (cmd.findOption("--service-workers")) {
+      app.checkValue(cmd.getValueAndCheckMinMax(opt_serviceWorkers, 1, 64));
+    }
+
+    if (cmd.findOption("--service-poll")) {
+      app.checkValue(cmd.getValueAndCheckMin(opt_servicePoll, 1));
+    }
+
     OFLOG_DEBUG(mainLogger, rcsid.c_str() << OFendl);
 
     if (queryRetriever.m_retrievePort <= 0 &&
@@ -266,29 +525,95 @@ int main(int argc, char *argv[]) {
     }
     queryRetriever.m_outputDirectory = opt_outputDirectory.c_str();
 
-    if (opt_filepath == nullptr) {
+    if (opt_filepath == nullptr && opt_spoolDirectory == nullptr &&
+        opt_sweepRange == nullptr && opt_executePlan == nullptr) {
       OFLOG_ERROR(mainLogger, "No text file specified");
       return EXITCODE_COMMANDLINE_SYNTAX_ERROR;
     }
   }
 
-  const auto filepath = std::filesystem::absolute(opt_filepath);
+  JobOptions jobOptions{};
+  jobOptions.addModalities = opt_addModalities;
+  jobOptions.coalesceQueries = opt_coalesceQueries;
+  jobOptions.findLimit = OFstatic_cast(unsigned int, opt_findLimit);
+  jobOptions.sweepRange = opt_sweepRange != nullptr ? opt_sweepRange : "";
+  jobOptions.sweepConcurrency = OFstatic_cast(unsigned int, opt_sweepThreads);
+  jobOptions.planFile = opt_planFile != nullptr ? opt_planFile : "";
+  jobOptions.retrieveTags = opt_retrieveTags;
+  jobOptions.retrieveFiles = opt_retrieveFiles;
+  jobOptions.incremental = opt_incremental;
+  jobOptions.skipPresent = opt_skipPresent;
+  jobOptions.storeDirectory = opt_storeDirectory.c_str();
+  jobOptions.sha256 = opt_sha256;
+  jobOptions.writeBackend = opt_writeBackend;
+  jobOptions.outputLayout = opt_outputLayout;
+  jobOptions.logMissingStudies = opt_logMissingStudies;
+  jobOptions.outputDirectory = opt_outputDirectory.c_str();
+  jobOptions.dumpFilepath = opt_dumpFilepath.c_str();
+  jobOptions.dumpFormat = opt_dumpFormat;
+  jobOptions.extendStudyDate = opt_extendStudyDate;
+
+  // resolve tags once, job files may override them
+  for (const auto &ov_tag : opt_overrideTags) {
+    DcmTag tag = prepareQueryTag(app, ov_tag.c_str());
+    jobOptions.queryTags.emplace_back(ov_tag.c_str(), tag);
+  }
 
-  if (!std::filesystem::exists(filepath)) {
-    OFLOG_ERROR(mainLogger,
-                "Text file not found " << filepath.string().c_str());
-    return EXITCODE_TEXT_FILE_ERROR;
+  if (opt_spoolDirectory != nullptr) {
+    if (opt_queryModality != nullptr) {
+      jobOptions.queryModality = opt_queryModality;
+      std::ranges::replace(jobOptions.queryModality, '/', '\\');
+    }
+
+    ServiceOptions serviceOptions{};
+    serviceOptions.spoolDirectory = opt_spoolDirectory;
+    serviceOptions.workers = OFstatic_cast(unsigned int, opt_serviceWorkers);
+    serviceOptions.pollInterval = OFstatic_cast(unsigned int, opt_servicePoll);
+    serviceOptions.peers = opt_peers;
+    serviceOptions.admission = opt_admissionLimits;
+    serviceOptions.rateSchedule = opt_rateSchedule;
+    if (opt_captureFile != nullptr)
+      serviceOptions.captureFile = opt_captureFile;
+
+    ServiceMode service(queryRetriever, jobOptions, serviceOptions);
+    const int exitCode = service.run();
+    OFStandard::shutdownNetwork();
+    return exitCode;
   }
 
-  fmt::print("READING TEXT FILE ------------------------- \n");
-  std::vector<PatientRecord> recordList =
-      readPatientRecords(filepath.string(), opt_extendStudyDate);
+  // sweep builds records from its results, plan execution from the plan
+  std::vector<PatientRecord> recordList{};
+  if (opt_executePlan != nullptr) {
+    std::string error_msg;
+    if (!readTransferPlan(opt_executePlan, jobOptions.plannedStudies,
+                          error_msg)) {
+      OFLOG_ERROR(mainLogger, error_msg);
+      return EXITCODE_TEXT_FILE_ERROR;
+    }
+    if (jobOptions.plannedStudies.empty()) {
+      OFLOG_FATAL(mainLogger, "Plan is empty");
+      return EXITCODE_EMPTY_RECORD_LIST;
+    }
+    fmt::print("Found {} planned studies to move\n",
+               jobOptions.plannedStudies.size());
+  } else if (opt_sweepRange == nullptr) {
+    const auto filepath = std::filesystem::absolute(opt_filepath);
+
+    if (!std::filesystem::exists(filepath)) {
+      OFLOG_ERROR(mainLogger,
+                  "Text file not found " << filepath.string().c_str());
+      return EXITCODE_TEXT_FILE_ERROR;
+    }
+
+    fmt::print("READING TEXT FILE ------------------------- \n");
+    recordList = readPatientRecords(filepath.string(), opt_extendStudyDate);
 
-  if (!recordList.empty())
-    fmt::print("Found {} records to query\n", recordList.size());
-  else {
-    OFLOG_FATAL(mainLogger, "Record list is empty");
-    return EXITCODE_EMPTY_RECORD_LIST;
+    if (!recordList.empty())
+      fmt::print("Found {} records to query\n", recordList.size());
+    else {
+      OFLOG_FATAL(mainLogger, "Record list is empty");
+      return EXITCODE_EMPTY_RECORD_LIST;
+    }
   }
 
   std::string queryModality{};
@@ -307,19 +632,7 @@ int main(int argc, char *argv[]) {
   std::ranges::replace_if(
       queryModality, [](const char c) { return c == '/'; }, '\\');
 
-  for (auto &record : recordList) {
-    // add modality specified on cmd line
-    // reason: some records may have modality specified, some may not
-
-    // add to all
-    if (opt_addModalities == E_addModalities::ADD_MODALITIES_ALL) {
-      record.m_modality = queryModality;
-    } else {
-      // otherwise add only to records with no modality specified in text file
-      if (record.m_modality.empty())
-        record.m_modality = queryModality;
-    }
-  }
+  jobOptions.queryModality = queryModality;
 
   OFCondition cond = queryRetriever.initializeNetwork();
   OFString temp_string;
@@ -331,7 +644,23 @@ int main(int argc, char *argv[]) {
     return EXITCODE_CANNOT_INITIALIZE_NETWORK;
   }
 
-  cond = queryRetriever.setupAssociation();
+  std::mutex moveMutex;
+  PeerStatistics peerStatistics;
+  PeerPool peers(queryRetriever, opt_peers, &moveMutex, peerStatistics);
+  AdmissionControl admission(opt_admissionLimits);
+  peers.setAdmissionControl(&admission);
+  RateLimiter rateLimiter(opt_rateSchedule);
+  peers.setRateLimiter(&rateLimiter);
+  SessionCapture capture;
+  if (opt_captureFile != nullptr) {
+    std::string error_msg;
+    if (!capture.open(opt_captureFile, error_msg)) {
+      OFLOG_ERROR(mainLogger, error_msg);
+      return EXITCODE_CANNOT_WRITE_OUTPUT_FILE;
+    }
+    peers.setSessionCapture(&capture);
+  }
+  cond = peers.ensureAssociations();
 
   if (cond.bad()) {
     OFLOG_ERROR(mainLogger, "Failed to setup association: "
@@ -340,138 +669,17 @@ int main(int argc, char *argv[]) {
     return EXITCODE_CANNOT_NEGOTIATE_NETWORK;
   }
 
-  const auto time = std::chrono::system_clock::now();
-  const auto tt = std::chrono::system_clock::to_time_t(time);
-  const std::tm tm = *std::localtime(&tt);
-
-  const std::string missingStudiesFilename =
-      fmt::format("missing-studies-{:%Y-%m-%d-%H-%M-%S}.txt", tm);
-
-  fmt::ostream missingStudiesFile = fmt::output_file(missingStudiesFilename);
-  if (opt_logMissingStudies) {
-    missingStudiesFile.print("{:%Y-%m-%d %H:%M:%S}\n", tm);
-    missingStudiesFile.print("PatientID, StudyDate\n");
-  }
-
-  if (opt_retrieveTags) {
-    OFLOG_INFO(mainLogger, "QueryRetriever set up for dumping tags");
-  }
-
-  if (opt_retrieveFiles) {
-    OFLOG_INFO(mainLogger, "QueryRetriever set up for storing files");
-  }
-
-  fmt::print("C-FIND ---------- FIND STUDIES\n");
-  cond = EC_Normal;
-
-  for (auto &record : recordList) {
-    cond = queryRetriever.performFindRequest(record, queryModality, nullptr);
-    const std::string msg = fmt::format("PatientID: {}, StudyDate: {}",
-                                        record.m_id, record.m_study_date);
-
-    if (record.m_uid_list.empty()) {
-      fmt::print("{} - {}\n", msg,
-                 fmt::format(fg(fmt::color::red), "FAIL, STUDY NOT FOUND"));
-      missingStudiesFile.print("{}, {} - NOT FOUND\n", record.m_id,
-                               record.m_study_date);
-    } else {
-      fmt::print("{} - {}\n", msg,
-                 fmt::format(fg(fmt::color::green), "SUCCESS, {} study/ies",
-                             record.m_uid_list.size()));
-      if (opt_logMissingStudies) {
-        fmt::print("StudyInstanceUIDs: \n{}\n", record.m_uid_list);
-      }
-    }
-  }
-
-  missingStudiesFile.close();
-
-  // remove missing-studies file
-  if (!opt_logMissingStudies) {
-    OFLOG_DEBUG(mainLogger,
-                "Removing file \"" << missingStudiesFilename.c_str() << "\"");
-    std::filesystem::remove(missingStudiesFilename);
-  }
-
-  if (opt_logMissingStudies) {
-    fmt::print("Records of missing studies written to {}\n",
-               missingStudiesFilename);
-  }
-
-  if (opt_retrieveTags) {
-    fmt::print("C-FIND ---------- DUMP TAGS\n");
-
-    if (opt_overrideTags.empty()) {
-      fmt::print("no additional tags to query for, writing only defaults: "
-                 "PatientID, StudyInstanceUID, SeriesDescription\n");
-    }
-
-    OFString header{"PatientID;StudyInstanceUID;SeriesDescription"};
-    auto iter = opt_overrideTags.begin();
-    while (iter != opt_overrideTags.end()) {
-      if (iter != opt_overrideTags.end()) {
-        header += ";";
-      }
-      header += *iter;
-      ++iter;
-    }
-
-    const std::string dumpFilePath = fmt::format("{}-{:%Y-%m-%d-%H-%M-%S}.csv",
-                                                 opt_dumpFilepath.c_str(), tm);
-    fmt::ostream fileStream =
-        fmt::output_file(dumpFilePath, fmt::file::CREATE | fmt::file::WRONLY |
-                                           fmt::file::APPEND);
-    fileStream.print("{}\n", header.c_str());
-    fileStream.close();
-
-    cond = EC_Normal;
-    for (const auto &record : recordList) {
-      if (record.m_uid_list.empty()) {
-        OFLOG_DEBUG(
-            mainLogger,
-            fmt::format("not querying tags for \"{}\", no study instance uids",
-                        record.m_id));
-        continue;
-      }
-
-      std::vector<TagValuePair> queryTags;
-      for (const auto &ov_tag : opt_overrideTags) {
-        DcmTag tag = prepareQueryTag(app, ov_tag.c_str());
-        queryTags.emplace_back(tag, ""); // adds TagValuePar<tag, "">
-      }
-
-      cond = queryRetriever.dumpTags(record, dumpFilePath, queryTags, nullptr);
-    }
-    fmt::print("Writing tags: {}\n", header.c_str());
-    fmt::print("Tags written to: {}\n", dumpFilePath);
-  }
-
-  // TODO: Perhaps add in the future? Replace with current opt_overrideTags
-  // querying? DcmPathProcessor proc; for (const auto &tag : m_overrideTags) {
-  //     cond = proc.applyPathWithValue(requestedDataset, tag);
-  //     if (cond.bad()) {
-  //         DCMNET_ERROR("bad override tag: " << tag);
-  //         return cond;
-  //     }
-  // }
-
-  if (opt_retrieveFiles) {
-    fmt::print("C-MOVE ---------- MOVE STUDIES\n");
-    cond = EC_Normal;
-    for (const auto &record : recordList) {
-      if (record.m_uid_list.empty()) {
-        const std::string msg = fmt::format("PatientID: {}, StudyDate: {}",
-                                            record.m_id, record.m_study_date);
-        fmt::print(
-            "{} - {}\n", msg,
-            fmt::format(fg(fmt::color::red), "FAIL, MISSING StudyInstanceUID"));
-        continue;
-      }
-      cond = queryRetriever.performMoveRequest(record);
-    }
+  JobReport report(stdout, true);
+  int exitCode = runJob(peers, jobOptions, recordList, report);
+  if (exitCode == EXITCODE_CANNOT_CREATE_QUERY_IDENTIFIERS) {
+    OFLOG_ERROR(mainLogger, "Exiting program");
+    return exitCode;
   }
+  // moves finished with warnings or errors
+  if (!exitCode)
+    exitCode = peers.moveExitCode();
+  peers.releaseAssociations();
 
-  int exitCode = cond.good() ? 0 : 2;
   cond = queryRetriever.dropNetwork();
 
   if (cond.bad()) {
@@ -0,0 +1,44 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include <filesystem>
+#include <string>
+
+#include "AdmissionControl.hpp"
+#include "Check.hpp"
+#include "SizeModel.hpp"
+#include "Utility.hpp"
+
+int main() {
+	const auto learned = std::filesystem::temp_directory_path() / "fnostudyqr-admission-learned";
+	const auto empty   = std::filesystem::temp_directory_path() / "fnostudyqr-admission-empty";
+	std::filesystem::remove_all(learned);
+	std::filesystem::remove_all(empty);
+	std::filesystem::create_directories(learned);
+	std::filesystem::create_directories(empty);
+
+	// earlier run learned 4 MiB CT instances, typical CT size is 0.5 MiB
+	SizeModel sizes;
+	sizes.load(learned);
+	sizes.record("CT", 100, 400 * MIB);
+	std::string error_msg;
+	CHECK(sizes.save(error_msg));
+
+	AdmissionControl admission(AdmissionLimits{});
+	CHECK(admission.estimate(empty, "CT", 10) == 5 * MIB);
+	CHECK(admission.estimate(learned, "CT", 10) == 40 * MIB);
+	CHECK(admission.estimate(learned, "MR\\CT", 10) == 40 * MIB);
+	CHECK(admission.estimate(learned, "CT", 0) == 0);
+
+	// finished moves update the loaded model
+	admission.record("CT", 100, 1200 * MIB);
+	CHECK(admission.estimate(learned, "CT", 10) == 80 * MIB);
+
+	// other output directory has its own history
+	CHECK(admission.estimate(empty, "CT", 10) == 5 * MIB);
+
+	std::filesystem::remove_all(learned);
+	std::filesystem::remove_all(empty);
+	return checkExitCode();
+}
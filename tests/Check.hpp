@@ -0,0 +1,27 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <cstdio>
+
+// assert-like check that stays active in release builds and lets the test continue
+#define CHECK(expr) checkResult((expr), #expr, __FILE__, __LINE__)
+
+inline int checkFailures{0};
+
+inline void checkResult(const bool passed, const char *expr, const char *file, const int line) {
+	if (passed)
+		return;
+	std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+	++checkFailures;
+}
+
+// process exit code for ctest
+inline int checkExitCode() {
+	return checkFailures == 0 ? 0 : 1;
+}
+
+#endif //CHECK_HPP
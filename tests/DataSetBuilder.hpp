@@ -0,0 +1,73 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#ifndef DATASETBUILDER_HPP
+#define DATASETBUILDER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/dctag.h"
+#include "dcmtk/dcmdata/dcxfer.h"
+
+// hand-built data set in one of the decoder's transfer syntaxes
+class DataSetBuilder {
+public:
+	explicit DataSetBuilder(const E_TransferSyntax xfer)
+		: m_explicitVR(xfer != EXS_LittleEndianImplicit),
+		  m_bigEndian(xfer == EXS_BigEndianExplicit) {}
+
+	DataSetBuilder &element(const DcmTagKey &key, const char *vr, const std::string_view value) {
+		header(key, vr, static_cast<Uint32>(value.size()));
+		m_data.insert(m_data.end(), value.begin(), value.end());
+		return *this;
+	}
+
+	// header only, value is appended by the caller or missing on purpose
+	DataSetBuilder &header(const DcmTagKey &key, const char *vr, const Uint32 length) {
+		put16(key.getGroup());
+		put16(key.getElement());
+		// items and delimiters have no VR in any transfer syntax
+		if (!m_explicitVR || key.getGroup() == 0xfffe) {
+			put32(length);
+			return *this;
+		}
+		const std::string_view name{vr};
+		m_data.insert(m_data.end(), name.begin(), name.end());
+		if (name == "OB" || name == "OW" || name == "SQ" || name == "UN" || name == "UT") {
+			put16(0);
+			put32(length);
+		} else {
+			put16(static_cast<Uint16>(length));
+		}
+		return *this;
+	}
+
+	std::string us(const Uint16 value) const {
+		return m_bigEndian
+			       ? std::string{static_cast<char>(value >> 8), static_cast<char>(value & 0xff)}
+			       : std::string{static_cast<char>(value & 0xff), static_cast<char>(value >> 8)};
+	}
+
+	void put16(const Uint16 value) {
+		const std::string bytes = us(value);
+		m_data.insert(m_data.end(), bytes.begin(), bytes.end());
+	}
+
+	void put32(const Uint32 value) {
+		put16(static_cast<Uint16>(m_bigEndian ? value >> 16 : value & 0xffff));
+		put16(static_cast<Uint16>(m_bigEndian ? value & 0xffff : value >> 16));
+	}
+
+	const std::vector<Uint8> &data() const { return m_data; }
+
+private:
+	bool               m_explicitVR;
+	bool               m_bigEndian;
+	std::vector<Uint8> m_data{};
+};
+
+#endif //DATASETBUILDER_HPP
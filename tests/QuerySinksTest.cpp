@@ -0,0 +1,80 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Check.hpp"
+#include "DataSetBuilder.hpp"
+#include "QuerySinks.hpp"
+
+#include "dcmtk/dcmdata/dcdeftag.h"
+
+namespace {
+	// series level response with PatientName as the only dumped tag
+	std::vector<Uint8> seriesResponse(const std::string_view charset, const std::string_view patient_name) {
+		DataSetBuilder builder(EXS_LittleEndianExplicit);
+		if (!charset.empty())
+			builder.element(DCM_SpecificCharacterSet, "CS", charset);
+		builder.element(DCM_ImageType, "CS", "ORIGINAL\\PRIMARY")
+		       .element(DCM_SeriesDescription, "LO", "Hlava")
+		       .element(DCM_PatientName, "PN", patient_name)
+		       .element(DCM_PatientID, "LO", "P1")
+		       .element(DCM_StudyInstanceUID, "UI", "1.2.3");
+		return builder.data();
+	}
+
+	std::vector<std::string> readLines(const std::filesystem::path &path) {
+		std::vector<std::string> lines;
+		std::ifstream            file(path);
+		for (std::string line; std::getline(file, line);)
+			lines.push_back(line);
+		return lines;
+	}
+
+	bool contains(const std::string &line, const std::string_view text) {
+		return line.find(text) != std::string::npos;
+	}
+}
+
+int main() {
+	const auto path = std::filesystem::temp_directory_path() / "fnostudyqr-query-sinks-test.jsonl";
+	std::filesystem::remove(path);
+
+	FindResponseDecoder decoder;
+	decoder.setRequestedTags({DCM_SpecificCharacterSet, DCM_ImageType, DCM_SeriesDescription, DCM_PatientName,
+	                          DCM_PatientID, DCM_StudyInstanceUID});
+	{
+		JsonTagSink sink(path.string(), {DCM_PatientName});
+		// Latin-1 converted from SpecificCharacterSet, without it escaped as Latin-1, UTF-8 kept
+		const std::pair<std::string_view, std::string_view> responses[] = {
+			{"ISO_IR 100", "M\xfcller^Hans"},
+			{"", "M\xfcller^Hans"},
+			{"ISO_IR 192", "Dvo\xc5\x99\xc3\xa1k^Anton\xc3\xadn"},
+			// ISO 2022 code extension in the second value, PS3.5 H.3.1
+			{"\\ISO 2022 IR 87", "Yamada^Tarou=\x1b$B;3ED\x1b(B^\x1b$BB@O:\x1b(B"}
+		};
+		for (const auto &[charset, name] : responses) {
+			CHECK(decoder.decode(seriesResponse(charset, name), EXS_LittleEndianExplicit).good());
+			sink.consume(decoder.identifiers());
+		}
+	}
+
+	const auto lines = readLines(path);
+	CHECK(lines.size() == 4);
+	if (lines.size() == 4) {
+		CHECK(contains(lines[0], "\"PatientName\":\"M\xc3\xbcller^Hans\""));
+		CHECK(contains(lines[1], "\"PatientName\":\"M\\u00fcller^Hans\""));
+		CHECK(contains(lines[2], "\"PatientName\":\"Dvo\xc5\x99\xc3\xa1k^Anton\xc3\xadn\""));
+		CHECK(contains(lines[3], "\"PatientName\":\"Yamada^Tarou=\xe5\xb1\xb1\xe7\x94\xb0^\xe5\xa4\xaa\xe9\x83\x8e\""));
+		CHECK(contains(lines[0], "\"SeriesDescription\":\"hlava\""));
+	}
+
+	std::filesystem::remove(path);
+	return checkExitCode();
+}
@@ -0,0 +1,113 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include <string>
+#include <vector>
+
+#include "Check.hpp"
+#include "DataSetBuilder.hpp"
+#include "ResponseDecoder.hpp"
+
+#include "dcmtk/dcmdata/dcdeftag.h"
+
+namespace {
+	const DcmTagKey PRIVATE_TAG{0x0009, 0x1001};
+
+	std::string value(const FindResponseDecoder &decoder, const DcmTagKey &key) {
+		OFString text;
+		if (decoder.identifiers().findAndGetOFString(key, text).bad())
+			return "<missing>";
+		return text.c_str();
+	}
+
+	FindResponseDecoder makeDecoder() {
+		FindResponseDecoder decoder;
+		decoder.setRequestedTags({DCM_PatientName, DCM_StudyDate, DCM_StudyInstanceUID, DCM_Rows,
+		                          DCM_NumberOfStudyRelatedInstances, PRIVATE_TAG});
+		return decoder;
+	}
+
+	void testTransferSyntax(const E_TransferSyntax xfer) {
+		DataSetBuilder builder(xfer);
+		builder.element(DCM_StudyDate, "DA", "20260101")
+		       .element({0x0009, 0x0010}, "LO", "PRIVATE CREATOR ")
+		       .element(PRIVATE_TAG, "UN", "JK")
+		       .element(DCM_PatientName, "PN", "DOE^JOHN")
+		       .element(DCM_StudyInstanceUID, "UI", std::string_view{"1.2.3\0", 6})
+		       .element(DCM_Rows, "US", builder.us(512))
+		       .element(DCM_NumberOfStudyRelatedInstances, "IS", " 42\\7 ");
+
+		FindResponseDecoder decoder = makeDecoder();
+		CHECK(decoder.decode(builder.data(), xfer).good());
+		CHECK(value(decoder, DCM_PatientName) == "DOE^JOHN");
+		CHECK(value(decoder, DCM_StudyDate) == "20260101");
+		CHECK(value(decoder, DCM_StudyInstanceUID) == "1.2.3");
+		CHECK(value(decoder, DCM_Rows) == "512");
+		CHECK(value(decoder, DCM_NumberOfStudyRelatedInstances) == "42");
+		OFString values;
+		CHECK(decoder.identifiers().findAndGetOFStringArray(DCM_NumberOfStudyRelatedInstances, values).good());
+		CHECK(values == "42\\7");
+		CHECK(decoder.identifiers().findAndGetOFStringArray(DCM_PatientName, values).good());
+		CHECK(values == "DOE^JOHN");
+		// same as DcmDataset reading the private tag as UN: first byte in hex
+		CHECK(value(decoder, PRIVATE_TAG) == "4a");
+		CHECK(value(decoder, DCM_PatientID) == "<missing>");
+	}
+
+	void testOddLengths() {
+		DataSetBuilder builder(EXS_LittleEndianExplicit);
+		builder.element(DCM_PatientName, "PN", "ABC")
+		       .element(DCM_Rows, "US", "\x01");
+
+		FindResponseDecoder decoder = makeDecoder();
+		CHECK(decoder.decode(builder.data(), EXS_LittleEndianExplicit).good());
+		CHECK(value(decoder, DCM_PatientName) == "ABC");
+		CHECK(value(decoder, DCM_Rows).empty());
+	}
+
+	void testSkippedSequence() {
+		DataSetBuilder builder(EXS_LittleEndianImplicit);
+		builder.header(DCM_ReferencedStudySequence, "SQ", 0xffffffff)
+		       .header({0xfffe, 0xe000}, "", 0xffffffff)
+		       .element(DCM_PatientName, "PN", "NESTED")
+		       .header({0xfffe, 0xe00d}, "", 0)
+		       .header({0xfffe, 0xe0dd}, "", 0)
+		       .element(DCM_StudyDate, "DA", "20250505");
+
+		FindResponseDecoder decoder = makeDecoder();
+		CHECK(decoder.decode(builder.data(), EXS_LittleEndianImplicit).good());
+		CHECK(value(decoder, DCM_PatientName) == "<missing>");
+		CHECK(value(decoder, DCM_StudyDate) == "20250505");
+	}
+
+	void testTruncated() {
+		DataSetBuilder complete(EXS_LittleEndianExplicit);
+		complete.element(DCM_StudyDate, "DA", "20260101")
+		        .element(DCM_PatientName, "PN", "DOE^JOHN");
+
+		FindResponseDecoder decoder = makeDecoder();
+		for (size_t size = complete.data().size() - 1; size > 0; --size) {
+			const std::vector<Uint8> truncated(complete.data().begin(), complete.data().begin() + size);
+			// element boundaries are the only sizes that still decode
+			const bool boundary = size == 16;
+			CHECK(decoder.decode(truncated, EXS_LittleEndianExplicit).good() == boundary);
+		}
+
+		DataSetBuilder unterminated(EXS_LittleEndianImplicit);
+		unterminated.header(DCM_ReferencedStudySequence, "SQ", 0xffffffff)
+		            .header({0xfffe, 0xe000}, "", 0xffffffff)
+		            .element(DCM_PatientName, "PN", "NESTED");
+		CHECK(decoder.decode(unterminated.data(), EXS_LittleEndianImplicit).bad());
+	}
+}
+
+int main() {
+	testTransferSyntax(EXS_LittleEndianExplicit);
+	testTransferSyntax(EXS_LittleEndianImplicit);
+	testTransferSyntax(EXS_BigEndianExplicit);
+	testOddLengths();
+	testSkippedSequence();
+	testTruncated();
+	return checkExitCode();
+}
@@ -0,0 +1,58 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include <filesystem>
+#include <string>
+
+#include "Check.hpp"
+#include "SessionCapture.hpp"
+
+#include "dcmtk/dcmdata/dcdeftag.h"
+
+namespace {
+	// LT value with every separator of the capture format
+	const std::string COMMENTS{"first line\r\nsecond\tcolumn\nC:\\scans\\"};
+
+	std::string valueOf(const CapturedValues &values, const DcmTagKey &key) {
+		for (const auto &[tag, value] : values) {
+			if (tag == key)
+				return value;
+		}
+		return "<missing>";
+	}
+}
+
+int main() {
+	const auto path = std::filesystem::temp_directory_path() / "fnostudyqr-session-capture-test.capture";
+
+	DcmDataset request;
+	request.putAndInsertString(DCM_QueryRetrieveLevel, "STUDY");
+	request.putAndInsertString(DCM_PatientID, "P1");
+	request.putAndInsertString(DCM_PatientComments, COMMENTS.c_str());
+	request.putAndInsertString(DCM_ModalitiesInStudy, "CT\\MR");
+	const std::string key = captureKey(captureValues(request));
+	{
+		SessionCapture capture;
+		std::string    error_msg;
+		CHECK(capture.open(path, error_msg));
+		const std::uint64_t session = capture.findRequest(request);
+		capture.findResponse(session, STATUS_Success, nullptr);
+	}
+
+	Capture     capture;
+	std::string error_msg;
+	CHECK(readCapture(path, capture, error_msg));
+	CHECK(capture.m_finds.size() == 1);
+	CHECK(capture.m_finds.contains(key));
+	if (capture.m_finds.size() == 1) {
+		const CapturedFind &find = capture.m_finds.begin()->second;
+		CHECK(valueOf(find.m_request, DCM_PatientComments) == COMMENTS);
+		CHECK(valueOf(find.m_request, DCM_ModalitiesInStudy) == "CT\\MR");
+		CHECK(valueOf(find.m_request, DCM_PatientID) == "P1");
+		CHECK(find.m_responses.size() == 1);
+	}
+
+	std::filesystem::remove(path);
+	return checkExitCode();
+}
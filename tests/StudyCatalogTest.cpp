@@ -0,0 +1,73 @@
+//
+// Created by Vojtěch on 19.10.2026.
+//
+
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+
+#include "Check.hpp"
+#include "InstanceIndex.hpp"
+#include "StudyCatalog.hpp"
+
+namespace {
+	PatientRecord makeRecord(const std::string &id, const std::string &study_date, const std::string &uid) {
+		PatientRecord record{id, "", study_date};
+		record.m_modality = "CT";
+		record.m_uid_list = {uid};
+		return record;
+	}
+
+	bool satisfied(const StudyCatalog &catalog, const InstanceIndex &index, const PatientRecord &record) {
+		std::set<std::string> uids;
+		return catalog.satisfied(makeRecord(record.m_id, record.m_study_date, ""), index, uids) &&
+		       uids == record.m_uid_list;
+	}
+}
+
+int main() {
+	const auto directory = std::filesystem::temp_directory_path() / "fnostudyqr-catalog-test";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+
+	std::string   error_msg;
+	InstanceIndex index;
+	CHECK(index.open(directory, error_msg));
+
+	const PatientRecord closed   = makeRecord("P1", "20200101", "1.1");
+	const PatientRecord range    = makeRecord("P2", "20191201-20200201", "1.2");
+	const PatientRecord open     = makeRecord("P3", "20200101-", "1.3");
+	const PatientRecord extended = makeRecord("P4", "20200101-29991231", "1.4");
+	{
+		StudyCatalog catalog;
+		CHECK(catalog.open(directory, error_msg));
+		for (const auto *record : {&closed, &range, &open, &extended}) {
+			// no instances expected, complete as soon as added
+			catalog.addStudy(*record->m_uid_list.begin(), 0);
+			catalog.addRecord(*record);
+		}
+
+		CHECK(satisfied(catalog, index, closed));
+		CHECK(satisfied(catalog, index, range));
+		CHECK(!satisfied(catalog, index, open));
+		CHECK(!satisfied(catalog, index, extended));
+	}
+
+	// catalog line without write date, as written by earlier versions
+	{
+		std::ofstream file{directory / StudyCatalog::FILENAME, std::ios::app};
+		file << "R\tP5\t20200101\tCT\t1.5\n";
+		file << "S\t1.5\t0\n";
+	}
+
+	StudyCatalog reopened;
+	CHECK(reopened.open(directory, error_msg));
+	CHECK(satisfied(reopened, index, closed));
+	CHECK(!satisfied(reopened, index, open));
+	CHECK(!satisfied(reopened, index, makeRecord("P5", "20200101", "1.5")));
+	CHECK(reopened.studies() == 5);
+
+	std::filesystem::remove_all(directory);
+	return checkExitCode();
+}